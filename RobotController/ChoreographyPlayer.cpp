@@ -0,0 +1,88 @@
+#include "ChoreographyPlayer.h"
+
+// Demo: forward, spin right, spin left, back up, stop
+static const ChoreographyStep DEMO_STEPS[] = {
+    {0, 0, 0},
+    {500, 180, 180},
+    {2000, 180, -180},
+    {3000, -180, 180},
+    {4000, -150, -150},
+    {5500, 0, 0}};
+
+// Figure eight
+static const ChoreographyStep FIGURE_EIGHT_STEPS[] = {
+    {0, 0, 0},
+    {500, 200, 110},
+    {4500, 110, 200},
+    {8500, 0, 0}};
+
+static const ChoreographyScript SCRIPTS[] = {
+    {DEMO_STEPS, sizeof(DEMO_STEPS) / sizeof(DEMO_STEPS[0])},
+    {FIGURE_EIGHT_STEPS, sizeof(FIGURE_EIGHT_STEPS) / sizeof(FIGURE_EIGHT_STEPS[0])}};
+
+const ChoreographyScript *findChoreographyScript(uint8_t scriptId)
+{
+    if (scriptId == 0 || scriptId > sizeof(SCRIPTS) / sizeof(SCRIPTS[0]))
+        return nullptr;
+    return &SCRIPTS[scriptId - 1];
+}
+
+#ifdef ARDUINO
+ChoreographyPlayer choreography;
+#endif
+
+ChoreographyPlayer::ChoreographyPlayer()
+{
+    _script = nullptr;
+    _startTime = 0;
+    _step = 0;
+}
+
+void ChoreographyPlayer::start(const ChoreographyScript *script, uint32_t startTime)
+{
+    _script = script;
+    _startTime = startTime;
+    _step = 0;
+}
+
+void ChoreographyPlayer::stop()
+{
+    _script = nullptr;
+}
+
+bool ChoreographyPlayer::update(uint32_t sharedTime, int16_t &left, int16_t &right)
+{
+    if (_script == nullptr)
+        return false;
+
+    // Armed but not started yet: hold still
+    int32_t elapsed = sharedTime - _startTime;
+    if (elapsed < 0)
+    {
+        left = 0;
+        right = 0;
+        return true;
+    }
+
+    // Advance to the last step that is due
+    while (_step + 1 < _script->stepCount && _script->steps[_step + 1].time <= (uint32_t)elapsed)
+        _step++;
+
+    left = _script->steps[_step].left;
+    right = _script->steps[_step].right;
+
+    // Finished once the last step is reached
+    if (_step + 1 >= _script->stepCount)
+        _script = nullptr;
+    return true;
+}
+
+bool ChoreographyPlayer::isPlaying() const
+{
+    return _script != nullptr;
+}
+
+uint32_t ChoreographyPlayer::getStartTime() const
+{
+    return _startTime;
+}
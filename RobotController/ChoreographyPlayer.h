@@ -0,0 +1,53 @@
+#ifndef CHOREOGRAPHY_PLAYER_H
+#define CHOREOGRAPHY_PLAYER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One timestamped setpoint, held until the next step
+struct ChoreographyStep
+{
+    uint32_t time; // ms from the start of the script
+    int16_t left;  // -255..255, negative is backward
+    int16_t right;
+};
+
+// A script is a list of steps sorted by time; the last step should stop the motors
+struct ChoreographyScript
+{
+    const ChoreographyStep *steps;
+    uint16_t stepCount;
+};
+
+// Built-in scripts, looked up by the id in the base node's beacon
+const ChoreographyScript *findChoreographyScript(uint8_t scriptId);
+
+// Plays a script against shared time so every tank is at the same step
+class ChoreographyPlayer
+{
+public:
+    // Constructor
+    ChoreographyPlayer();
+
+    // Arm a script to start at the given shared time (ms)
+    void start(const ChoreographyScript *script, uint32_t startTime);
+    void stop();
+
+    // Get the setpoint for the current shared time (ms); false when not playing
+    bool update(uint32_t sharedTime, int16_t &left, int16_t &right);
+
+    // Get player state
+    bool isPlaying() const;
+    uint32_t getStartTime() const;
+
+private:
+    const ChoreographyScript *_script;
+    uint32_t _startTime;
+    uint16_t _step; // Current step, only moves forward
+};
+
+#ifdef ARDUINO
+extern ChoreographyPlayer choreography;
+#endif
+
+#endif // CHOREOGRAPHY_PLAYER_H
@@ -0,0 +1,178 @@
+#include "ClockSync.h"
+#include "FleetTelemetry.h"
+
+size_t packClockBeacon(const ClockBeacon &beacon, uint8_t *frame)
+{
+    frame[0] = FLEET_MAGIC;
+    frame[1] = FLEET_VERSION;
+    frame[2] = FLEET_FRAME_BEACON;
+    frame[3] = FLEET_BASE_ID;
+    for (uint8_t i = 0; i < 8; i++)
+        frame[4 + i] = beacon.baseTime >> (i * 8);
+    for (uint8_t i = 0; i < 4; i++)
+        frame[12 + i] = beacon.showStart >> (i * 8);
+    frame[16] = beacon.scriptId;
+    return CLOCK_SYNC_BEACON_SIZE;
+}
+
+bool unpackClockBeacon(const uint8_t *frame, size_t length, ClockBeacon &beacon)
+{
+    if (length < CLOCK_SYNC_BEACON_SIZE || frame[0] != FLEET_MAGIC || frame[1] != FLEET_VERSION ||
+        frame[2] != FLEET_FRAME_BEACON)
+        return false;
+
+    beacon.baseTime = 0;
+    for (uint8_t i = 0; i < 8; i++)
+        beacon.baseTime |= (uint64_t)frame[4 + i] << (i * 8);
+    beacon.showStart = 0;
+    for (uint8_t i = 0; i < 4; i++)
+        beacon.showStart |= (uint32_t)frame[12 + i] << (i * 8);
+    beacon.scriptId = frame[16];
+    return true;
+}
+
+#ifdef ARDUINO
+ClockSync clockSync;
+#endif
+
+ClockSync::ClockSync()
+{
+    _synced = false;
+    _referenceLocal = 0;
+    _offset = 0;
+    _skew = 0;
+    _lastError = 0;
+    _resets = 0;
+
+    _bucketStart = 0;
+    _bucketBest = {0, 0};
+    _fit = {0, 0};
+    _bucketOpen = false;
+    _pointHead = 0;
+    _pointCount = 0;
+}
+
+void ClockSync::handleBeacon(uint64_t baseTime, uint64_t localTime)
+{
+    // The beacon left the base a little before it arrived here
+    int64_t measured = (int64_t)(baseTime + CLOCK_SYNC_LINK_DELAY_US) - (int64_t)localTime;
+
+    if (!_synced)
+    {
+        _synced = true;
+        _lastError = 0;
+        restart(localTime, measured);
+        return;
+    }
+
+    // Compare against where our model says the shared clock should be
+    int64_t elapsed = localTime - _referenceLocal;
+    int64_t predicted = _offset + (int64_t)(_skew * elapsed);
+    int64_t error = measured - predicted;
+    _lastError = error;
+
+    if (error > CLOCK_SYNC_STEP_US || error < -CLOCK_SYNC_STEP_US || elapsed <= 0)
+    {
+        // Base restarted or we missed a lot, start over
+        restart(localTime, measured);
+        _resets++;
+        return;
+    }
+
+    // Slew the offset part way, which filters out arrival jitter. Once the fitted line
+    // exists it is the better target: it runs through the least-delayed beacons only.
+    addSample(localTime, measured);
+    int64_t target = measured;
+    if (_pointCount >= CLOCK_SYNC_SKEW_MIN_POINTS)
+        target = _fit.offset + (int64_t)(_skew * (int64_t)(localTime - _fit.local));
+    _referenceLocal = localTime;
+    _offset = predicted + (int64_t)((target - predicted) * CLOCK_SYNC_OFFSET_GAIN);
+}
+
+void ClockSync::addSample(uint64_t localTime, int64_t measured)
+{
+    // A late beacon makes the measured offset smaller, so the largest one had the least delay
+    if (_bucketOpen && localTime - _bucketStart >= (uint64_t)CLOCK_SYNC_SKEW_BUCKET_MS * 1000)
+    {
+        _points[_pointHead] = _bucketBest;
+        _pointHead = (_pointHead + 1) % CLOCK_SYNC_SKEW_POINTS;
+        if (_pointCount < CLOCK_SYNC_SKEW_POINTS)
+            _pointCount++;
+        _bucketOpen = false;
+        fitSkew();
+    }
+
+    if (!_bucketOpen)
+    {
+        _bucketOpen = true;
+        _bucketStart = localTime;
+        _bucketBest = {localTime, measured};
+    }
+    else if (measured > _bucketBest.offset)
+        _bucketBest = {localTime, measured};
+}
+
+void ClockSync::fitSkew()
+{
+    if (_pointCount < CLOCK_SYNC_SKEW_MIN_POINTS)
+        return;
+
+    // Least-squares slope of offset over local time, relative to the oldest point so the
+    // sums keep their precision. Runs once per bucket, so double is affordable.
+    const SkewPoint &oldest = _points[(_pointHead + CLOCK_SYNC_SKEW_POINTS - _pointCount) % CLOCK_SYNC_SKEW_POINTS];
+    double sumT = 0, sumY = 0, sumTT = 0, sumTY = 0;
+    for (uint8_t i = 0; i < _pointCount; i++)
+    {
+        double t = (double)(int64_t)(_points[i].local - oldest.local);
+        double y = (double)(_points[i].offset - oldest.offset);
+        sumT += t;
+        sumY += y;
+        sumTT += t * t;
+        sumTY += t * y;
+    }
+
+    double denominator = _pointCount * sumTT - sumT * sumT;
+    if (denominator <= 0)
+        return;
+
+    _skew = (_pointCount * sumTY - sumT * sumY) / denominator;
+    _fit.local = oldest.local + (uint64_t)(sumT / _pointCount);
+    _fit.offset = oldest.offset + (int64_t)(sumY / _pointCount);
+}
+
+void ClockSync::restart(uint64_t localTime, int64_t measured)
+{
+    _referenceLocal = localTime;
+    _offset = measured;
+    _skew = 0;
+    _bucketOpen = false;
+    _pointHead = 0;
+    _pointCount = 0;
+    addSample(localTime, measured);
+}
+
+uint64_t ClockSync::toShared(uint64_t localTime) const
+{
+    int64_t elapsed = localTime - _referenceLocal;
+    return localTime + _offset + (int64_t)(_skew * elapsed);
+}
+
+bool ClockSync::isSynced(uint64_t localTime) const
+{
+    return _synced && localTime - _referenceLocal < (uint64_t)CLOCK_SYNC_LOST_MS * 1000;
+}
+
+int32_t ClockSync::getLastError() const
+{
+    return _lastError;
+}
+
+float ClockSync::getSkewPpm() const
+{
+    return _skew * 1000000;
+}
+
+uint32_t ClockSync::getResets() const
+{
+    return _resets;
+}
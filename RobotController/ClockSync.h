@@ -0,0 +1,90 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default settings
+#define CLOCK_SYNC_BEACON_PERIOD_MS 250
+#define CLOCK_SYNC_BEACON_SIZE 17
+#define CLOCK_SYNC_LINK_DELAY_US 400 // Typical ESP-NOW air time plus stack latency
+#define CLOCK_SYNC_STEP_US 20000     // Larger errors reset the estimate instead of slewing
+#define CLOCK_SYNC_LOST_MS 1500      // No beacon for this long counts as out of sync
+#define CLOCK_SYNC_OFFSET_GAIN 0.3f
+#define CLOCK_SYNC_SKEW_BUCKET_MS 4000 // Least-delayed beacon of each bucket is a skew point
+#define CLOCK_SYNC_SKEW_POINTS 16      // Skew is fitted over this many buckets (about a minute)
+#define CLOCK_SYNC_SKEW_MIN_POINTS 4   // Fewer than this and the skew stays at 0
+
+// Clock beacon broadcast by the base node
+struct ClockBeacon
+{
+    uint64_t baseTime;   // Base node clock (us) when sent
+    uint32_t showStart;  // Shared time (ms) the script starts at, 0 = no show
+    uint8_t scriptId;
+};
+
+// Fixed little-endian layout, shares the fleet frame header
+size_t packClockBeacon(const ClockBeacon &beacon, uint8_t *frame);
+bool unpackClockBeacon(const uint8_t *frame, size_t length, ClockBeacon &beacon);
+
+// Tracks the base node's clock from beacons: an offset plus a skew for crystal drift.
+// Arrival jitter is far larger than the drift between two beacons, so the skew comes from
+// a long baseline instead: the beacon that arrived quickest in each bucket, which has the
+// least jitter, and a least-squares line through the last CLOCK_SYNC_SKEW_POINTS of them.
+// Once there is a line, the offset is slewed toward it rather than toward each beacon.
+class ClockSync
+{
+public:
+    // Constructor
+    ClockSync();
+
+    // Feed a beacon's base time with the local time it arrived at
+    void handleBeacon(uint64_t baseTime, uint64_t localTime);
+
+    // Convert local time (us) to shared time (us)
+    uint64_t toShared(uint64_t localTime) const;
+
+    // Get sync state
+    bool isSynced(uint64_t localTime) const;
+    int32_t getLastError() const; // us, how far off the prediction for the last beacon was
+    float getSkewPpm() const;
+    uint32_t getResets() const;
+
+private:
+    struct SkewPoint
+    {
+        uint64_t local;
+        int64_t offset; // Shared minus local
+    };
+
+    bool _synced;
+    uint64_t _referenceLocal;  // Local time of the last beacon
+    int64_t _offset;           // Shared minus local at the reference
+    float _skew;               // Shared clock drift relative to ours (us per us)
+    int32_t _lastError;
+    uint32_t _resets;
+
+    // Current bucket: its start and its least-delayed beacon so far
+    uint64_t _bucketStart;
+    SkewPoint _bucketBest;
+    bool _bucketOpen;
+
+    // Ring of finished buckets
+    SkewPoint _points[CLOCK_SYNC_SKEW_POINTS];
+    uint8_t _pointHead;
+    uint8_t _pointCount;
+
+    // Point the fitted line runs through, the mean of the buckets
+    SkewPoint _fit;
+
+    // Helper methods
+    void addSample(uint64_t localTime, int64_t measured);
+    void fitSkew();
+    void restart(uint64_t localTime, int64_t measured);
+};
+
+#ifdef ARDUINO
+extern ClockSync clockSync;
+#endif
+
+#endif // CLOCK_SYNC_H
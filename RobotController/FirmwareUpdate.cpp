@@ -0,0 +1,322 @@
+#include "FirmwareUpdate.h"
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+static uint32_t readU32(const uint8_t *data)
+{
+    return data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void writeU32(uint8_t *data, uint32_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+// CRC-32 (IEEE, as in zlib), bitwise to keep the table out of RAM
+static uint32_t crc32(const uint8_t *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (length--)
+    {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+#ifdef ARDUINO
+// Replies go back over the serial link the frames came in on
+static void writeUpdateReply(const uint8_t *data, size_t length)
+{
+    Serial.write(data, length);
+}
+
+FirmwareUpdate firmwareUpdate(updatePartition, writeUpdateReply);
+#endif
+
+FirmwareUpdate::FirmwareUpdate(UpdatePartition &partition, FirmwareUpdateOutput output)
+    : _partition(partition), _output(output)
+{
+    _active = false;
+    _complete = false;
+    _selfTestDone = false;
+    _lastFrameTime = 0;
+
+    _session = false;
+    _imageSize = 0;
+    _offset = 0;
+    memset(_imageHash, 0, sizeof(_imageHash));
+
+    _verifying = false;
+    _verifyOffset = 0;
+
+    _frameLength = 0;
+}
+
+void FirmwareUpdate::start(unsigned long now)
+{
+    _active = true;
+    _lastFrameTime = now;
+    _frameLength = 0;
+}
+
+void FirmwareUpdate::stop()
+{
+    // The session is kept so a later BEGIN with the same image resumes it
+    _active = false;
+    _frameLength = 0;
+}
+
+bool FirmwareUpdate::isActive() const
+{
+    return _active;
+}
+
+void FirmwareUpdate::receive(const uint8_t *data, size_t length, unsigned long now)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t byte = data[i];
+
+        // Hunt for the sync byte between frames
+        if (_frameLength == 0 && byte != FIRMWARE_UPDATE_SYNC)
+            continue;
+
+        _frame[_frameLength++] = byte;
+        if (_frameLength < 4)
+            continue;
+
+        uint16_t payloadLength = _frame[2] | (_frame[3] << 8);
+        if (payloadLength > sizeof(_frame) - 8)
+        {
+            _frameLength = 0;
+            sendStatus(UPDATE_BAD_FRAME);
+            continue;
+        }
+
+        if (_frameLength < 4 + payloadLength + 4)
+            continue;
+
+        _frameLength = 0;
+        _lastFrameTime = now;
+
+        if (crc32(_frame + 1, 3 + payloadLength) != readU32(_frame + 4 + payloadLength))
+        {
+            sendStatus(UPDATE_BAD_FRAME);
+            continue;
+        }
+
+        handleFrame(_frame[1], _frame + 4, payloadLength);
+    }
+}
+
+void FirmwareUpdate::update(unsigned long now)
+{
+    if (_verifying)
+        verifySlice();
+
+    if (_active && now - _lastFrameTime > FIRMWARE_UPDATE_TIMEOUT_MS)
+        stop();
+}
+
+bool FirmwareUpdate::isComplete() const
+{
+    return _complete;
+}
+
+void FirmwareUpdate::checkSelfTest(unsigned long now, bool healthy)
+{
+    if (_selfTestDone)
+        return;
+
+    if (!_partition.isPendingVerify())
+    {
+        _selfTestDone = true;
+        return;
+    }
+
+    // An unhealthy image rolls back straight away, a healthy one once it has run long enough
+    if (!healthy)
+        _partition.rollback();
+    else if (now > FIRMWARE_UPDATE_SELF_TEST_MS)
+    {
+        _partition.markValid();
+        _selfTestDone = true;
+    }
+}
+
+uint32_t FirmwareUpdate::getImageSize() const
+{
+    return _imageSize;
+}
+
+uint32_t FirmwareUpdate::getOffset() const
+{
+    return _offset;
+}
+
+void FirmwareUpdate::handleFrame(uint8_t type, const uint8_t *payload, uint16_t length)
+{
+    FirmwareUpdateStatus status;
+
+    switch (type)
+    {
+    case FIRMWARE_UPDATE_BEGIN:
+        status = handleBegin(payload, length);
+        break;
+    case FIRMWARE_UPDATE_DATA:
+        status = handleData(payload, length);
+        break;
+    case FIRMWARE_UPDATE_END:
+        status = handleEnd();
+        if (_verifying)
+            return; // verifySlice() replies when the hash is done
+        break;
+    case FIRMWARE_UPDATE_ABORT:
+        _partition.abort();
+        _session = false;
+        _verifying = false;
+        _offset = 0;
+        status = UPDATE_OK;
+        break;
+    default:
+        status = UPDATE_BAD_FRAME;
+        break;
+    }
+
+    sendStatus(status);
+}
+
+FirmwareUpdateStatus FirmwareUpdate::handleBegin(const uint8_t *payload, uint16_t length)
+{
+    if (length != 4 + SHA256_DIGEST_SIZE)
+        return UPDATE_BAD_FRAME;
+
+    uint32_t imageSize = readU32(payload);
+    const uint8_t *imageHash = payload + 4;
+
+    // Same image as the interrupted session: carry on where it stopped
+    if (_session && imageSize == _imageSize && memcmp(imageHash, _imageHash, SHA256_DIGEST_SIZE) == 0)
+        return UPDATE_OK;
+
+    _session = false;
+    _verifying = false;
+    _offset = 0;
+    if (!_partition.begin(imageSize))
+        return UPDATE_TOO_LARGE;
+
+    _session = true;
+    _imageSize = imageSize;
+    memcpy(_imageHash, imageHash, SHA256_DIGEST_SIZE);
+    return UPDATE_OK;
+}
+
+FirmwareUpdateStatus FirmwareUpdate::handleData(const uint8_t *payload, uint16_t length)
+{
+    if (!_session)
+        return UPDATE_NO_SESSION;
+    if (length < 4)
+        return UPDATE_BAD_FRAME;
+
+    uint32_t offset = readU32(payload);
+    uint32_t dataLength = length - 4;
+
+    // Chunks must arrive in order; a repeat of the last one is acknowledged again
+    if (offset + dataLength == _offset)
+        return UPDATE_OK;
+    if (offset != _offset || offset + dataLength > _imageSize)
+        return UPDATE_BAD_OFFSET;
+
+    if (!_partition.write(offset, payload + 4, dataLength))
+        return UPDATE_WRITE_ERROR;
+
+    _offset += dataLength;
+    return UPDATE_OK;
+}
+
+FirmwareUpdateStatus FirmwareUpdate::handleEnd()
+{
+    if (!_session)
+        return UPDATE_NO_SESSION;
+    if (_offset != _imageSize)
+        return UPDATE_BAD_OFFSET;
+
+    // Hashing the whole image takes longer than the watchdog gives one loop pass, so it
+    // is read back a slice per update() call. A repeated END doesn't restart it.
+    if (!_verifying)
+    {
+        _verifying = true;
+        _verifyOffset = 0;
+        _verifySha.reset();
+    }
+    return UPDATE_OK;
+}
+
+void FirmwareUpdate::verifySlice()
+{
+    uint8_t block[256];
+    uint32_t sliceEnd = _imageSize - _verifyOffset < FIRMWARE_UPDATE_VERIFY_SLICE
+                            ? _imageSize
+                            : _verifyOffset + FIRMWARE_UPDATE_VERIFY_SLICE;
+
+    // Hash the image as read back from the partition
+    while (_verifyOffset < sliceEnd)
+    {
+        uint32_t length = sliceEnd - _verifyOffset < sizeof(block) ? sliceEnd - _verifyOffset : sizeof(block);
+        if (!_partition.read(_verifyOffset, block, length))
+        {
+            finishImage(false);
+            return;
+        }
+        _verifySha.update(block, length);
+        _verifyOffset += length;
+    }
+
+    if (_verifyOffset < _imageSize)
+        return;
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    _verifySha.finish(digest);
+    finishImage(memcmp(digest, _imageHash, SHA256_DIGEST_SIZE) == 0);
+}
+
+void FirmwareUpdate::finishImage(bool verified)
+{
+    FirmwareUpdateStatus status = UPDATE_OK;
+    _verifying = false;
+    _session = false;
+
+    // Start over if what landed in flash isn't the image the host sent
+    if (!verified)
+    {
+        _partition.abort();
+        _offset = 0;
+        status = UPDATE_HASH_MISMATCH;
+    }
+    else if (!_partition.activate())
+        status = UPDATE_ACTIVATE_ERROR;
+    else
+        _complete = true;
+
+    sendStatus(status);
+}
+
+void FirmwareUpdate::sendStatus(FirmwareUpdateStatus status)
+{
+    uint8_t frame[4 + 5 + 4];
+    frame[0] = FIRMWARE_UPDATE_SYNC;
+    frame[1] = FIRMWARE_UPDATE_STATUS;
+    frame[2] = 5;
+    frame[3] = 0;
+    frame[4] = status;
+    writeU32(frame + 5, _offset);
+    writeU32(frame + 9, crc32(frame + 1, 8));
+    _output(frame, sizeof(frame));
+}
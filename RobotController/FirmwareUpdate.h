@@ -0,0 +1,121 @@
+#ifndef FIRMWARE_UPDATE_H
+#define FIRMWARE_UPDATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Sha256.h"
+#include "UpdatePartition.h"
+
+/*
+ * Serial firmware update protocol (all fields little-endian):
+ *
+ *   frame    = 0xA5, type, length (u16), payload, crc32 (u32 over type, length and payload)
+ *   BEGIN    = image size (u32), SHA-256 of the image (32 bytes)
+ *   DATA     = offset (u32), image bytes
+ *   END      = (empty) verify the hash and switch partitions, the STATUS reply comes
+ *              once the whole image is read back and hashed
+ *   ABORT    = (empty)
+ *   STATUS   = status (u8), next offset (u32), sent in reply to every frame
+ *
+ * The host waits for each STATUS before sending the next frame. Sending BEGIN
+ * again with the same size and hash resumes at the returned offset.
+ */
+
+// Frame types
+#define FIRMWARE_UPDATE_SYNC 0xA5
+#define FIRMWARE_UPDATE_BEGIN 0x01
+#define FIRMWARE_UPDATE_DATA 0x02
+#define FIRMWARE_UPDATE_END 0x03
+#define FIRMWARE_UPDATE_ABORT 0x04
+#define FIRMWARE_UPDATE_STATUS 0x81
+
+// Default settings
+#define FIRMWARE_UPDATE_MAX_CHUNK 512
+#define FIRMWARE_UPDATE_RX_BUFFER 1024 // Serial receive buffer, holds a full frame
+#define FIRMWARE_UPDATE_TIMEOUT_MS 30000 // Leave update mode after this long without a frame
+#define FIRMWARE_UPDATE_SELF_TEST_MS 10000 // A new image must run this long before it is kept
+#define FIRMWARE_UPDATE_VERIFY_SLICE 4096 // Image bytes hashed per update() call
+
+// Status codes sent back to the host
+enum FirmwareUpdateStatus
+{
+    UPDATE_OK,
+    UPDATE_BAD_FRAME,
+    UPDATE_BAD_OFFSET,
+    UPDATE_NO_SESSION,
+    UPDATE_TOO_LARGE,
+    UPDATE_WRITE_ERROR,
+    UPDATE_HASH_MISMATCH,
+    UPDATE_ACTIVATE_ERROR
+};
+
+// Sends reply bytes back over the link
+typedef void (*FirmwareUpdateOutput)(const uint8_t *data, size_t length);
+
+class FirmwareUpdate
+{
+public:
+    // Constructor
+    FirmwareUpdate(UpdatePartition &partition, FirmwareUpdateOutput output);
+
+    // Enter and leave update mode. While active, all link bytes go to receive().
+    void start(unsigned long now);
+    void stop();
+    bool isActive() const;
+
+    // Feed received bytes
+    void receive(const uint8_t *data, size_t length, unsigned long now);
+
+    // Hash a slice of a finished image, leave update mode when the host went away. Call
+    // once per loop pass.
+    void update(unsigned long now);
+
+    // True once a verified image was activated and the device should restart
+    bool isComplete() const;
+
+    // Self test of a freshly booted image: keep it if healthy, otherwise roll back
+    void checkSelfTest(unsigned long now, bool healthy);
+
+    // Get progress
+    uint32_t getImageSize() const;
+    uint32_t getOffset() const;
+
+private:
+    UpdatePartition &_partition;
+    FirmwareUpdateOutput _output;
+
+    bool _active;
+    bool _complete;
+    bool _selfTestDone;
+    unsigned long _lastFrameTime;
+
+    // Current image session
+    bool _session;
+    uint32_t _imageSize;
+    uint32_t _offset;
+    uint8_t _imageHash[SHA256_DIGEST_SIZE];
+
+    // Read-back check after END, a slice per update() call
+    bool _verifying;
+    uint32_t _verifyOffset;
+    Sha256 _verifySha;
+
+    // Frame being received
+    uint8_t _frame[4 + 4 + FIRMWARE_UPDATE_MAX_CHUNK + 4];
+    uint16_t _frameLength;
+
+    // Helper methods
+    void handleFrame(uint8_t type, const uint8_t *payload, uint16_t length);
+    FirmwareUpdateStatus handleBegin(const uint8_t *payload, uint16_t length);
+    FirmwareUpdateStatus handleData(const uint8_t *payload, uint16_t length);
+    FirmwareUpdateStatus handleEnd();
+    void verifySlice();
+    void finishImage(bool verified);
+    void sendStatus(FirmwareUpdateStatus status);
+};
+
+#ifdef ARDUINO
+extern FirmwareUpdate firmwareUpdate;
+#endif
+
+#endif // FIRMWARE_UPDATE_H
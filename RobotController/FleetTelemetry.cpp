@@ -0,0 +1,176 @@
+#include "FleetTelemetry.h"
+#include <string.h>
+
+static void writeU16(uint8_t *data, uint16_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static uint16_t readU16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+size_t packFleetStatus(const FleetStatus &status, uint8_t *frame)
+{
+    frame[0] = FLEET_MAGIC;
+    frame[1] = FLEET_VERSION;
+    frame[2] = FLEET_FRAME_STATUS;
+    frame[3] = status.tankId;
+    writeU16(frame + 4, status.sequence);
+    writeU16(frame + 6, status.uptime);
+    writeU16(frame + 8, status.uptime >> 16);
+    writeU16(frame + 10, status.leftPower);
+    writeU16(frame + 12, status.rightPower);
+    frame[14] = status.flags;
+    frame[15] = status.batteryMv > 255 * 50 ? 255 : status.batteryMv / 50; // 50 mV steps, up to 12.75 V
+    frame[16] = status.reportRate;
+    frame[17] = status.reportAge > 2550 ? 255 : status.reportAge / 10; // 10 ms steps
+    frame[18] = status.freeHeapKb;
+    return FLEET_STATUS_FRAME_SIZE;
+}
+
+bool unpackFleetStatus(const uint8_t *frame, size_t length, FleetStatus &status)
+{
+    if (length < FLEET_STATUS_FRAME_SIZE || frame[0] != FLEET_MAGIC || frame[1] != FLEET_VERSION ||
+        frame[2] != FLEET_FRAME_STATUS)
+        return false;
+
+    status.tankId = frame[3];
+    status.sequence = readU16(frame + 4);
+    status.uptime = readU16(frame + 6) | ((uint32_t)readU16(frame + 8) << 16);
+    status.leftPower = (int16_t)readU16(frame + 10);
+    status.rightPower = (int16_t)readU16(frame + 12);
+    status.flags = frame[14];
+    status.batteryMv = frame[15] * 50;
+    status.reportRate = frame[16];
+    status.reportAge = frame[17] * 10;
+    status.freeHeapKb = frame[18];
+    return true;
+}
+
+#ifdef ARDUINO
+FleetTelemetry fleetTelemetry(fleetTransport);
+FleetAggregator fleetAggregator;
+#endif
+
+FleetTelemetry::FleetTelemetry(FleetTransport &transport)
+    : _transport(transport)
+{
+    _tankId = 0;
+    _sequence = 0;
+    _lastSendTime = 0;
+    _lastLeftPower = 0;
+    _lastRightPower = 0;
+    _lastFlags = 0;
+    _framesSent = 0;
+    _sendErrors = 0;
+}
+
+bool FleetTelemetry::begin(uint8_t tankId)
+{
+    _tankId = tankId;
+    return _transport.begin();
+}
+
+void FleetTelemetry::update(unsigned long now, FleetStatus &status)
+{
+    // Send on a fixed period, or sooner when the drive state changes. A tank being driven
+    // changes power on nearly every report, so changes are held to a minimum interval or a
+    // dozen tanks would flood the channel at their report rate.
+    bool changed = status.leftPower != _lastLeftPower || status.rightPower != _lastRightPower ||
+                   status.flags != _lastFlags;
+    unsigned long interval = changed ? FLEET_STATUS_MIN_INTERVAL_MS : FLEET_STATUS_PERIOD_MS;
+    if (now - _lastSendTime < interval)
+        return;
+
+    status.tankId = _tankId;
+    status.sequence = _sequence++;
+    status.uptime = now;
+
+    uint8_t frame[FLEET_STATUS_FRAME_SIZE];
+    size_t length = packFleetStatus(status, frame);
+    if (_transport.send(frame, length))
+        _framesSent++;
+    else
+        _sendErrors++;
+
+    _lastSendTime = now;
+    _lastLeftPower = status.leftPower;
+    _lastRightPower = status.rightPower;
+    _lastFlags = status.flags;
+}
+
+uint32_t FleetTelemetry::getFramesSent() const
+{
+    return _framesSent;
+}
+
+uint32_t FleetTelemetry::getSendErrors() const
+{
+    return _sendErrors;
+}
+
+FleetAggregator::FleetAggregator()
+{
+    memset(_tanks, 0, sizeof(_tanks));
+    _tankCount = 0;
+}
+
+bool FleetAggregator::handleFrame(const uint8_t *frame, size_t length, int8_t rssi, unsigned long now)
+{
+    FleetStatus status;
+    if (!unpackFleetStatus(frame, length, status) || status.tankId == FLEET_BASE_ID)
+        return false;
+
+    Entry *entry = findTank(status.tankId);
+    if (entry == nullptr)
+        return false;
+
+    // Count frames that never arrived, ignoring a tank that restarted
+    if (entry->framesReceived > 0 && status.uptime >= entry->status.uptime)
+    {
+        uint16_t gap = status.sequence - entry->status.sequence;
+        if (gap > 1 && gap < 0x8000)
+            entry->framesLost += gap - 1;
+    }
+
+    entry->status = status;
+    entry->lastSeen = now;
+    entry->rssi = rssi;
+    entry->framesReceived++;
+    return true;
+}
+
+uint8_t FleetAggregator::getTankCount() const
+{
+    return _tankCount;
+}
+
+const FleetAggregator::Entry *FleetAggregator::getTank(uint8_t index) const
+{
+    return index < _tankCount ? &_tanks[index] : nullptr;
+}
+
+bool FleetAggregator::isOnline(const Entry &entry, unsigned long now) const
+{
+    return now - entry.lastSeen < FLEET_STALE_MS;
+}
+
+FleetAggregator::Entry *FleetAggregator::findTank(uint8_t tankId)
+{
+    for (uint8_t i = 0; i < _tankCount; i++)
+    {
+        if (_tanks[i].status.tankId == tankId)
+            return &_tanks[i];
+    }
+
+    if (_tankCount >= FLEET_MAX_TANKS)
+        return nullptr;
+
+    Entry *entry = &_tanks[_tankCount++];
+    memset(entry, 0, sizeof(*entry));
+    entry->status.tankId = tankId;
+    return entry;
+}
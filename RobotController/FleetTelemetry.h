@@ -0,0 +1,113 @@
+#ifndef FLEET_TELEMETRY_H
+#define FLEET_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FleetTransport.h"
+
+// Frame header
+#define FLEET_MAGIC 0x54 // 'T'
+#define FLEET_VERSION 1
+#define FLEET_FRAME_STATUS 0x01
+#define FLEET_FRAME_BEACON 0x02 // Clock beacon from the base node, see ClockSync.h
+
+// Default settings
+#define FLEET_STATUS_PERIOD_MS 200 // Heartbeat while the drive state holds still
+#define FLEET_STATUS_MIN_INTERVAL_MS 50 // Drive state changes go out no faster than this
+#define FLEET_MAX_TANKS 16
+#define FLEET_STALE_MS 2000 // Base node marks a tank offline after this long
+#define FLEET_BASE_ID 0xFF  // Tank id that makes a node the base
+#define FLEET_STATUS_FRAME_SIZE 19
+
+// Status flags
+#define FLEET_FLAG_CONTROLLER 0x01
+#define FLEET_FLAG_WATCHDOG 0x02
+#define FLEET_FLAG_FAILSAFE 0x04
+#define FLEET_FLAG_IDLE 0x08
+
+// One tank's status, as carried in a status frame
+struct FleetStatus
+{
+    uint8_t tankId;
+    uint16_t sequence;
+    uint32_t uptime;      // ms
+    int16_t leftPower;    // -255..255, negative is backward
+    int16_t rightPower;   // -255..255
+    uint8_t flags;
+    uint16_t batteryMv;   // 0 when not measured
+    uint8_t reportRate;   // Controller reports per second
+    uint16_t reportAge;   // ms since the last controller report, capped
+    uint8_t freeHeapKb;   // Capped at 255
+};
+
+// Fixed little-endian layout, independent of compiler padding
+size_t packFleetStatus(const FleetStatus &status, uint8_t *frame);
+bool unpackFleetStatus(const uint8_t *frame, size_t length, FleetStatus &status);
+
+// Tank side: broadcasts this tank's status
+class FleetTelemetry
+{
+public:
+    // Constructor
+    FleetTelemetry(FleetTransport &transport);
+
+    // Start sending as the given tank id
+    bool begin(uint8_t tankId);
+
+    // Call once per loop pass with the current status
+    void update(unsigned long now, FleetStatus &status);
+
+    // Get counters
+    uint32_t getFramesSent() const;
+    uint32_t getSendErrors() const;
+
+private:
+    FleetTransport &_transport;
+    uint8_t _tankId;
+    uint16_t _sequence;
+    unsigned long _lastSendTime;
+    int16_t _lastLeftPower;
+    int16_t _lastRightPower;
+    uint8_t _lastFlags;
+    uint32_t _framesSent;
+    uint32_t _sendErrors;
+};
+
+// Base node: collects status frames from every tank
+class FleetAggregator
+{
+public:
+    struct Entry
+    {
+        FleetStatus status;
+        unsigned long lastSeen;
+        int8_t rssi;
+        uint32_t framesReceived;
+        uint32_t framesLost; // Gaps in the sequence numbers
+    };
+
+    // Constructor
+    FleetAggregator();
+
+    // Add one received status frame
+    bool handleFrame(const uint8_t *frame, size_t length, int8_t rssi, unsigned long now);
+
+    // Get tanks
+    uint8_t getTankCount() const;
+    const Entry *getTank(uint8_t index) const;
+    bool isOnline(const Entry &entry, unsigned long now) const;
+
+private:
+    Entry _tanks[FLEET_MAX_TANKS];
+    uint8_t _tankCount;
+
+    // Helper methods
+    Entry *findTank(uint8_t tankId);
+};
+
+#ifdef ARDUINO
+extern FleetTelemetry fleetTelemetry;
+extern FleetAggregator fleetAggregator;
+#endif
+
+#endif // FLEET_TELEMETRY_H
@@ -0,0 +1,184 @@
+#include "FleetTransport.h"
+
+#ifdef ARDUINO
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_timer.h>
+
+static const uint8_t BROADCAST_ADDRESS[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+EspNowTransport *EspNowTransport::_instance = nullptr;
+
+void fleetEspNowReceive(const uint8_t *data, int length, int8_t rssi)
+{
+    if (EspNowTransport::_instance != nullptr)
+        EspNowTransport::_instance->enqueue(data, length, rssi);
+}
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+static void onEspNowReceive(const esp_now_recv_info_t *info, const uint8_t *data, int length)
+{
+    fleetEspNowReceive(data, length, info->rx_ctrl != nullptr ? info->rx_ctrl->rssi : 0);
+}
+#else
+static void onEspNowReceive(const uint8_t *address, const uint8_t *data, int length)
+{
+    fleetEspNowReceive(data, length, 0);
+}
+#endif
+
+EspNowTransport fleetTransport;
+
+EspNowTransport::EspNowTransport()
+{
+    _head = 0;
+    _tail = 0;
+    portMUX_INITIALIZE(&_queueMux);
+}
+
+bool EspNowTransport::begin()
+{
+    _instance = this;
+
+    // ESP-NOW needs the Wi-Fi radio in station mode, but no access point
+    WiFi.mode(WIFI_STA);
+    if (esp_now_init() != ESP_OK)
+        return false;
+
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, BROADCAST_ADDRESS, sizeof(BROADCAST_ADDRESS));
+    peer.channel = 0;
+    peer.encrypt = false;
+    if (esp_now_add_peer(&peer) != ESP_OK)
+        return false;
+
+    return esp_now_register_recv_cb(onEspNowReceive) == ESP_OK;
+}
+
+bool EspNowTransport::send(const uint8_t *data, size_t length)
+{
+    return esp_now_send(BROADCAST_ADDRESS, data, length) == ESP_OK;
+}
+
+size_t EspNowTransport::receive(uint8_t *data, size_t size, FleetFrameInfo &info)
+{
+    size_t length = 0;
+
+    portENTER_CRITICAL(&_queueMux);
+    if (_tail != _head)
+    {
+        Frame &frame = _queue[_tail];
+        length = frame.length < size ? frame.length : size;
+        memcpy(data, frame.data, length);
+        info = frame.info;
+        _tail = (_tail + 1) % FLEET_RECEIVE_QUEUE;
+    }
+    portEXIT_CRITICAL(&_queueMux);
+
+    return length;
+}
+
+uint64_t EspNowTransport::now()
+{
+    return esp_timer_get_time();
+}
+
+void EspNowTransport::enqueue(const uint8_t *data, int length, int8_t rssi)
+{
+    if (length <= 0 || length > FLEET_MAX_FRAME)
+        return;
+
+    // Stamp on arrival, before any loop latency
+    uint64_t receivedAt = esp_timer_get_time();
+
+    // Drop the frame when the loop hasn't kept up
+    portENTER_CRITICAL(&_queueMux);
+    uint8_t next = (_head + 1) % FLEET_RECEIVE_QUEUE;
+    if (next != _tail)
+    {
+        memcpy(_queue[_head].data, data, length);
+        _queue[_head].length = length;
+        _queue[_head].info.rssi = rssi;
+        _queue[_head].info.receivedAt = receivedAt;
+        _head = next;
+    }
+    portEXIT_CRITICAL(&_queueMux);
+}
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+UdpLoopbackTransport::UdpLoopbackTransport(uint16_t port)
+{
+    _port = port;
+    _socket = -1;
+}
+
+UdpLoopbackTransport::~UdpLoopbackTransport()
+{
+    if (_socket >= 0)
+        close(_socket);
+}
+
+bool UdpLoopbackTransport::begin()
+{
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_socket < 0)
+        return false;
+
+    // Every instance binds the same port and joins the same group
+    int enable = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_socket, (sockaddr *)&address, sizeof(address)) != 0)
+        return false;
+
+    ip_mreq membership = {};
+    membership.imr_multiaddr.s_addr = inet_addr(FLEET_LOOPBACK_GROUP);
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    if (setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)
+        return false;
+
+    in_addr interface = {};
+    interface.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+    unsigned char loop = 1;
+    setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    return fcntl(_socket, F_SETFL, O_NONBLOCK) == 0;
+}
+
+bool UdpLoopbackTransport::send(const uint8_t *data, size_t length)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_port);
+    address.sin_addr.s_addr = inet_addr(FLEET_LOOPBACK_GROUP);
+    return sendto(_socket, data, length, 0, (sockaddr *)&address, sizeof(address)) == (ssize_t)length;
+}
+
+size_t UdpLoopbackTransport::receive(uint8_t *data, size_t size, FleetFrameInfo &info)
+{
+    ssize_t length = recv(_socket, data, size, 0);
+    info.rssi = 0;
+    info.receivedAt = now();
+    return length > 0 ? length : 0;
+}
+
+uint64_t UdpLoopbackTransport::now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef FLEET_TRANSPORT_H
+#define FLEET_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// Default settings
+#define FLEET_MAX_FRAME 32
+#define FLEET_RECEIVE_QUEUE 8
+#define FLEET_LOOPBACK_GROUP "239.255.42.42"
+#define FLEET_LOOPBACK_PORT 42420
+
+// Details of a received frame
+struct FleetFrameInfo
+{
+    int8_t rssi;         // 0 when unknown
+    uint64_t receivedAt; // Local clock (us) when the frame arrived
+};
+
+// Broadcast link between tanks and the base node. Every node hears every frame.
+class FleetTransport
+{
+public:
+    virtual ~FleetTransport() {}
+
+    // Bring the link up
+    virtual bool begin() = 0;
+
+    // Broadcast one frame
+    virtual bool send(const uint8_t *data, size_t length) = 0;
+
+    // Fetch one received frame if there is one (non-blocking), returns its length or 0
+    virtual size_t receive(uint8_t *data, size_t size, FleetFrameInfo &info) = 0;
+
+    // Local clock in microseconds, the one receive timestamps use
+    virtual uint64_t now() = 0;
+};
+
+#ifdef ARDUINO
+// ESP-NOW broadcast, runs alongside Bluetooth through the radio coexistence scheduler
+class EspNowTransport : public FleetTransport
+{
+public:
+    EspNowTransport();
+
+    bool begin() override;
+    bool send(const uint8_t *data, size_t length) override;
+    size_t receive(uint8_t *data, size_t size, FleetFrameInfo &info) override;
+    uint64_t now() override;
+
+private:
+    struct Frame
+    {
+        uint8_t data[FLEET_MAX_FRAME];
+        uint8_t length;
+        FleetFrameInfo info;
+    };
+
+    // Filled by the Wi-Fi task, drained by the loop
+    Frame _queue[FLEET_RECEIVE_QUEUE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    portMUX_TYPE _queueMux;
+
+    static EspNowTransport *_instance;
+
+    // Helper methods
+    void enqueue(const uint8_t *data, int length, int8_t rssi);
+    friend void fleetEspNowReceive(const uint8_t *data, int length, int8_t rssi);
+};
+
+extern EspNowTransport fleetTransport;
+#else
+// Host stand-in: UDP multicast on the loopback interface, so several processes
+// on one machine see each other's frames like ESP-NOW broadcast
+class UdpLoopbackTransport : public FleetTransport
+{
+public:
+    explicit UdpLoopbackTransport(uint16_t port = FLEET_LOOPBACK_PORT);
+    ~UdpLoopbackTransport();
+
+    bool begin() override;
+    bool send(const uint8_t *data, size_t length) override;
+    size_t receive(uint8_t *data, size_t size, FleetFrameInfo &info) override;
+    uint64_t now() override;
+
+private:
+    uint16_t _port;
+    int _socket;
+};
+#endif
+
+#endif // FLEET_TRANSPORT_H
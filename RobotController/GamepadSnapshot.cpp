@@ -0,0 +1,17 @@
+#include "GamepadSnapshot.h"
+
+#ifdef ARDUINO
+void captureGamepad(ControllerPtr controller, GamepadSnapshot &gamepad)
+{
+    gamepad.axisX = controller->axisX();
+    gamepad.axisY = controller->axisY();
+    gamepad.axisRX = controller->axisRX();
+    gamepad.axisRY = controller->axisRY();
+    gamepad.brake = controller->brake();
+    gamepad.throttle = controller->throttle();
+    gamepad.buttons = controller->buttons();
+    gamepad.miscButtons = controller->miscButtons();
+    gamepad.dpad = controller->dpad();
+    gamepad.reserved = 0;
+}
+#endif
@@ -0,0 +1,58 @@
+#ifndef GAMEPAD_SNAPSHOT_H
+#define GAMEPAD_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Button bits, same values as Bluepad32's buttons() mask
+#define GAMEPAD_BUTTON_A 0x0001
+#define GAMEPAD_BUTTON_B 0x0002
+#define GAMEPAD_BUTTON_X 0x0004
+#define GAMEPAD_BUTTON_Y 0x0008
+#define GAMEPAD_BUTTON_L1 0x0010
+#define GAMEPAD_BUTTON_R1 0x0020
+#define GAMEPAD_BUTTON_L2 0x0040
+#define GAMEPAD_BUTTON_R2 0x0080
+
+// D-pad bits, same values as Bluepad32's dpad()
+#define GAMEPAD_DPAD_UP 0x01
+#define GAMEPAD_DPAD_DOWN 0x02
+#define GAMEPAD_DPAD_RIGHT 0x04
+#define GAMEPAD_DPAD_LEFT 0x08
+
+// Everything the handlers read from a gamepad, copied out in one pass per report.
+// Plain data with no padding, so it can be compared, recorded and replayed byte for byte.
+struct GamepadSnapshot
+{
+    int16_t axisX;  // Left stick, -512..511
+    int16_t axisY;
+    int16_t axisRX; // Right stick
+    int16_t axisRY;
+    int16_t brake;    // L2 trigger, 0..1023
+    int16_t throttle; // R2 trigger, 0..1023
+    uint16_t buttons;
+    uint16_t miscButtons;
+    uint8_t dpad;
+    uint8_t reserved; // Always 0
+
+    bool a() const { return buttons & GAMEPAD_BUTTON_A; }
+    bool b() const { return buttons & GAMEPAD_BUTTON_B; }
+    bool x() const { return buttons & GAMEPAD_BUTTON_X; }
+    bool y() const { return buttons & GAMEPAD_BUTTON_Y; }
+    bool l1() const { return buttons & GAMEPAD_BUTTON_L1; }
+    bool r1() const { return buttons & GAMEPAD_BUTTON_R1; }
+
+    bool operator==(const GamepadSnapshot &other) const { return memcmp(this, &other, sizeof(*this)) == 0; }
+    bool operator!=(const GamepadSnapshot &other) const { return !(*this == other); }
+};
+
+static_assert(sizeof(GamepadSnapshot) == 18, "GamepadSnapshot must stay packed");
+
+#ifdef ARDUINO
+#include <Bluepad32.h>
+
+// Copy the controller's current state
+void captureGamepad(ControllerPtr controller, GamepadSnapshot &gamepad);
+#endif
+
+#endif // GAMEPAD_SNAPSHOT_H
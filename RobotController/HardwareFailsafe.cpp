@@ -0,0 +1,96 @@
+#include "HardwareFailsafe.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include <esp_intr_alloc.h>
+
+#define HARDWARE_FAILSAFE_TIMEOUT_TICKS (HARDWARE_FAILSAFE_TIMEOUT_MS / HARDWARE_FAILSAFE_CHECK_PERIOD_MS)
+
+HardwareFailsafe *HardwareFailsafe::_instance = nullptr;
+
+HardwareFailsafe hardwareFailsafe;
+
+HardwareFailsafe::HardwareFailsafe()
+{
+    _motors = nullptr;
+    _timer = nullptr;
+
+    _ticks = 0;
+    _setpointTick = 0;
+    _driving = false;
+
+    _tripped = false;
+    _tripCount = 0;
+}
+
+void HardwareFailsafe::begin(TankMotors &motors)
+{
+    _motors = &motors;
+    _instance = this;
+
+    // The check runs in its own timer interrupt and only touches GPIO registers and RAM, so
+    // it keeps working while the loop task is stuck. Allocated in IRAM, it also keeps firing
+    // while the flash cache is off for a Preferences or OTA write. Core 3.x routes the timer
+    // through the gptimer driver, which is only IRAM-safe when the IDF was built with
+    // CONFIG_GPTIMER_ISR_IRAM_SAFE; otherwise the check waits for the write to finish.
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    _timer = timerBegin(HARDWARE_FAILSAFE_TIMER_FREQUENCY);
+    timerAttachInterrupt(_timer, &HardwareFailsafe::onTimer);
+    timerAlarm(_timer, HARDWARE_FAILSAFE_CHECK_PERIOD_MS * (HARDWARE_FAILSAFE_TIMER_FREQUENCY / 1000), true, 0);
+#else
+    _timer = timerBegin(HARDWARE_FAILSAFE_TIMER_NUMBER, 80, true);
+    timerAttachInterruptFlag(_timer, &HardwareFailsafe::onTimer, true, ESP_INTR_FLAG_IRAM);
+    timerAlarmWrite(_timer, HARDWARE_FAILSAFE_CHECK_PERIOD_MS * (HARDWARE_FAILSAFE_TIMER_FREQUENCY / 1000), true);
+    timerAlarmEnable(_timer);
+#endif
+
+    LOG_DETAILED("Hardware failsafe started");
+}
+
+void HardwareFailsafe::acceptSetpoint(bool driving)
+{
+    _setpointTick = _ticks;
+    _driving = driving;
+
+    // A fresh setpoint means input is flowing again
+    if (_tripped)
+    {
+        _motors->restoreOutputs(FORCE_OFF_FAILSAFE);
+        _tripped = false;
+        LOG_BASIC("Hardware failsafe cleared");
+    }
+}
+
+bool HardwareFailsafe::isTripped() const
+{
+    return _tripped;
+}
+
+uint32_t HardwareFailsafe::getTripCount() const
+{
+    return _tripCount;
+}
+
+void IRAM_ATTR HardwareFailsafe::check()
+{
+    uint32_t ticks = ++_ticks;
+
+    // Only a setpoint that drives the motors can go stale
+    if (_tripped || !_driving)
+        return;
+
+    if (ticks - _setpointTick > HARDWARE_FAILSAFE_TIMEOUT_TICKS)
+    {
+        _motors->forceOff(FORCE_OFF_FAILSAFE);
+        _tripped = true;
+        _tripCount++;
+        metrics.count(METRIC_FAILSAFE_TRIPS);
+        TRACE_INSTANT(FAILSAFE_TRIP);
+    }
+}
+
+void IRAM_ATTR HardwareFailsafe::onTimer()
+{
+    if (_instance != nullptr)
+        _instance->check();
+}
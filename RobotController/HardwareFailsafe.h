@@ -0,0 +1,51 @@
+#ifndef HARDWARE_FAILSAFE_H
+#define HARDWARE_FAILSAFE_H
+
+#include <Arduino.h>
+#include "TankMotors.h"
+
+// Default settings
+#define HARDWARE_FAILSAFE_TIMER_NUMBER 1 // Hardware timer, only used by Arduino core 2.x
+#define HARDWARE_FAILSAFE_TIMER_FREQUENCY 1000000
+#define HARDWARE_FAILSAFE_CHECK_PERIOD_MS 10
+#define HARDWARE_FAILSAFE_TIMEOUT_MS 3500 // Backs up the 3 second check in loop()
+
+class HardwareFailsafe
+{
+public:
+    // Constructor
+    HardwareFailsafe();
+
+    // Start the check timer
+    void begin(TankMotors &motors);
+
+    // Report a setpoint that was just accepted. Call before applying it to the motors.
+    void acceptSetpoint(bool driving);
+
+    // Get failsafe state
+    bool isTripped() const;
+    uint32_t getTripCount() const;
+
+private:
+    TankMotors *_motors;
+    hw_timer_t *_timer;
+
+    // Timer ticks and the tick of the latest accepted setpoint
+    volatile uint32_t _ticks;
+    volatile uint32_t _setpointTick;
+    volatile bool _driving;
+
+    // Trip state, written by the timer interrupt
+    volatile bool _tripped;
+    volatile uint32_t _tripCount;
+
+    static HardwareFailsafe *_instance;
+
+    // Helper methods
+    void IRAM_ATTR check();
+    static void IRAM_ATTR onTimer();
+};
+
+extern HardwareFailsafe hardwareFailsafe;
+
+#endif // HARDWARE_FAILSAFE_H
@@ -0,0 +1,162 @@
+#include "Imu.h"
+
+#ifdef ARDUINO
+#include <Wire.h>
+#include "Logger.h"
+#include "TankConfig.h"
+
+// MPU-6050 registers
+#define MPU_REG_SMPLRT_DIV 0x19
+#define MPU_REG_CONFIG 0x1A
+#define MPU_REG_GYRO_CONFIG 0x1B
+#define MPU_REG_ACCEL_CONFIG 0x1C
+#define MPU_REG_ACCEL_XOUT_H 0x3B
+#define MPU_REG_PWR_MGMT_1 0x6B
+#define MPU_REG_WHO_AM_I 0x75
+
+// Wired to the pins in TankConfig.h
+Mpu6050Imu imu(TANK_CONFIG.imuSdaPin, TANK_CONFIG.imuSclPin);
+
+Mpu6050Imu::Mpu6050Imu(int8_t sdaPin, int8_t sclPin, uint8_t address)
+{
+    _sdaPin = sdaPin;
+    _sclPin = sclPin;
+    _address = address;
+    memset(_gyroBias, 0, sizeof(_gyroBias));
+}
+
+bool Mpu6050Imu::begin()
+{
+    if (_sdaPin < 0 || _sclPin < 0)
+        return false;
+    Wire.begin(_sdaPin, _sclPin, IMU_I2C_FREQUENCY);
+
+    // 0x68 is the MPU-6050, the MPU-6500 and MPU-9250 answer 0x70 and 0x71
+    uint8_t id = 0;
+    if (!readRegisters(MPU_REG_WHO_AM_I, &id, 1) || (id != 0x68 && id != 0x70 && id != 0x71))
+    {
+        LOG_BASIC("IMU not found at 0x%02x", _address);
+        return false;
+    }
+
+    // Wake up on the gyro clock, 1kHz sampling behind the low-pass filter, +-500dps and +-4g
+    if (!writeRegister(MPU_REG_PWR_MGMT_1, 0x01) || !writeRegister(MPU_REG_CONFIG, IMU_DLPF_CONFIG) ||
+        !writeRegister(MPU_REG_SMPLRT_DIV, 0x00) || !writeRegister(MPU_REG_GYRO_CONFIG, 0x08) ||
+        !writeRegister(MPU_REG_ACCEL_CONFIG, 0x08))
+        return false;
+    delay(50);
+
+    // The gyro reads a few dps when still, and that would look like a slow turn
+    int32_t sum[IMU_AXIS_COUNT] = {};
+    ImuReading reading;
+    for (uint16_t i = 0; i < IMU_BIAS_SAMPLES; i++)
+    {
+        if (!readRaw(reading))
+            return false;
+        for (uint8_t axis = 0; axis < IMU_AXIS_COUNT; axis++)
+            sum[axis] += reading.gyro[axis];
+        delay(2);
+    }
+    for (uint8_t axis = 0; axis < IMU_AXIS_COUNT; axis++)
+        _gyroBias[axis] = sum[axis] / IMU_BIAS_SAMPLES;
+
+    LOG_DETAILED("IMU ready, gyro bias %d/%d/%d", _gyroBias[IMU_X], _gyroBias[IMU_Y], _gyroBias[IMU_Z]);
+    return true;
+}
+
+bool Mpu6050Imu::read(ImuReading &reading)
+{
+    if (!readRaw(reading))
+        return false;
+    for (uint8_t axis = 0; axis < IMU_AXIS_COUNT; axis++)
+        reading.gyro[axis] -= _gyroBias[axis];
+    return true;
+}
+
+bool Mpu6050Imu::readRaw(ImuReading &reading)
+{
+    // Accel, temperature and gyro in one burst, big-endian
+    uint8_t data[14];
+    if (!readRegisters(MPU_REG_ACCEL_XOUT_H, data, sizeof(data)))
+        return false;
+
+    reading.timeUs = micros();
+    for (uint8_t axis = 0; axis < IMU_AXIS_COUNT; axis++)
+    {
+        reading.accel[axis] = (int16_t)(data[axis * 2] << 8 | data[axis * 2 + 1]);
+        reading.gyro[axis] = (int16_t)(data[8 + axis * 2] << 8 | data[8 + axis * 2 + 1]);
+    }
+    return true;
+}
+
+bool Mpu6050Imu::writeRegister(uint8_t reg, uint8_t value)
+{
+    Wire.beginTransmission(_address);
+    Wire.write(reg);
+    Wire.write(value);
+    return Wire.endTransmission() == 0;
+}
+
+bool Mpu6050Imu::readRegisters(uint8_t reg, uint8_t *data, uint8_t length)
+{
+    Wire.beginTransmission(_address);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(_address, length) != length)
+        return false;
+    for (uint8_t i = 0; i < length; i++)
+        data[i] = Wire.read();
+    return true;
+}
+#else
+#include <string.h>
+
+SimulatedImu::SimulatedImu()
+{
+    memset(&_reading, 0, sizeof(_reading));
+    _reading.accel[IMU_Z] = IMU_ACCEL_LSB_PER_G; // Standing flat
+    _failing = false;
+}
+
+bool SimulatedImu::begin()
+{
+    return true;
+}
+
+bool SimulatedImu::read(ImuReading &reading)
+{
+    if (_failing)
+        return false;
+    reading = _reading;
+    return true;
+}
+
+static int16_t toSensor(float value, float scale)
+{
+    float scaled = value * scale;
+    return scaled > 32767.0f ? 32767 : scaled < -32768.0f ? -32768 : (int16_t)scaled;
+}
+
+void SimulatedImu::setGyroDps(float x, float y, float z)
+{
+    _reading.gyro[IMU_X] = toSensor(x, IMU_GYRO_LSB_PER_DPS_X10 / 10.0f);
+    _reading.gyro[IMU_Y] = toSensor(y, IMU_GYRO_LSB_PER_DPS_X10 / 10.0f);
+    _reading.gyro[IMU_Z] = toSensor(z, IMU_GYRO_LSB_PER_DPS_X10 / 10.0f);
+}
+
+void SimulatedImu::setAccelG(float x, float y, float z)
+{
+    _reading.accel[IMU_X] = toSensor(x, IMU_ACCEL_LSB_PER_G);
+    _reading.accel[IMU_Y] = toSensor(y, IMU_ACCEL_LSB_PER_G);
+    _reading.accel[IMU_Z] = toSensor(z, IMU_ACCEL_LSB_PER_G);
+}
+
+void SimulatedImu::setTimeUs(uint32_t timeUs)
+{
+    _reading.timeUs = timeUs;
+}
+
+void SimulatedImu::setFailing(bool failing)
+{
+    _failing = failing;
+}
+#endif
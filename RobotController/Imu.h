@@ -0,0 +1,96 @@
+#ifndef IMU_H
+#define IMU_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// Default settings
+#define IMU_ACCEL_LSB_PER_G 8192     // +-4g range
+#define IMU_GYRO_LSB_PER_DPS_X10 655 // +-500 degrees per second range, 65.5 LSB per dps
+#define IMU_I2C_FREQUENCY 400000
+#define IMU_BIAS_SAMPLES 128 // Gyro readings averaged at begin(), the tank must stand still
+#define IMU_DLPF_CONFIG 3        // Sensor's low-pass filter on both sensors, 3 = 44Hz...
+#define IMU_FILTER_DELAY_US 4900 // ...which holds every sample back by this much (datasheet)
+
+enum ImuAxis
+{
+    IMU_X,
+    IMU_Y,
+    IMU_Z,
+    IMU_AXIS_COUNT
+};
+
+// One reading in sensor units, gyro bias already removed
+struct ImuReading
+{
+    int16_t accel[IMU_AXIS_COUNT]; // IMU_ACCEL_LSB_PER_G per g
+    int16_t gyro[IMU_AXIS_COUNT];  // IMU_GYRO_LSB_PER_DPS_X10 / 10 per degree per second
+    uint32_t timeUs;
+};
+
+// Accelerometer and gyro on the tank's body
+class ImuSensor
+{
+public:
+    virtual ~ImuSensor() {}
+
+    // Start the sensor and measure the gyro bias, false if it doesn't answer
+    virtual bool begin() = 0;
+
+    // Read all six axes, false on a bus error
+    virtual bool read(ImuReading &reading) = 0;
+};
+
+#ifdef ARDUINO
+// InvenSense MPU-6050 (or a register-compatible MPU-6500/9250) on I2C
+class Mpu6050Imu : public ImuSensor
+{
+public:
+    // Constructor
+    Mpu6050Imu(int8_t sdaPin, int8_t sclPin, uint8_t address = 0x68);
+
+    bool begin() override;
+    bool read(ImuReading &reading) override;
+
+private:
+    int8_t _sdaPin;
+    int8_t _sclPin;
+    uint8_t _address;
+    int16_t _gyroBias[IMU_AXIS_COUNT];
+
+    // Helper methods
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool readRegisters(uint8_t reg, uint8_t *data, uint8_t length);
+    bool readRaw(ImuReading &reading);
+};
+
+extern Mpu6050Imu imu;
+#else
+// Host stand-in: returns whatever the test or simulation last set
+class SimulatedImu : public ImuSensor
+{
+public:
+    // Constructor
+    SimulatedImu();
+
+    bool begin() override;
+    bool read(ImuReading &reading) override;
+
+    // Set the body's motion in real units, converted to sensor units like the chip would
+    void setGyroDps(float x, float y, float z);
+    void setAccelG(float x, float y, float z);
+    void setTimeUs(uint32_t timeUs);
+
+    // Make read() fail, like a loose wire
+    void setFailing(bool failing);
+
+private:
+    ImuReading _reading;
+    bool _failing;
+};
+#endif
+
+#endif // IMU_H
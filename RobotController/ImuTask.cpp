@@ -0,0 +1,81 @@
+#include "ImuTask.h"
+#include "Metrics.h"
+#include <string.h>
+
+#ifdef ARDUINO
+ImuTask imuTask;
+#endif
+
+ImuTask::ImuTask()
+{
+    _imu = nullptr;
+    _tiltGuard = nullptr;
+    memset(&_latest, 0, sizeof(_latest));
+    _sequence = 0;
+    _samples = 0;
+    _errors = 0;
+}
+
+void ImuTask::begin(ImuSensor &imu, TiltGuard &tiltGuard)
+{
+    _imu = &imu;
+    _tiltGuard = &tiltGuard;
+#ifdef ARDUINO
+    xTaskCreatePinnedToCore(run, "imu", IMU_TASK_STACK_SIZE, this, IMU_TASK_PRIORITY, nullptr, IMU_TASK_CORE);
+#endif
+}
+
+void ImuTask::step()
+{
+    ImuReading reading;
+    if (!_imu->read(reading))
+    {
+        // The tilt guard notices when the samples stop
+        _errors++;
+        metrics.count(METRIC_IMU_ERRORS);
+        return;
+    }
+
+    _tiltGuard->check(reading);
+
+    __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    _latest = reading;
+    __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+    _samples++;
+}
+
+bool ImuTask::getLatest(ImuReading &reading) const
+{
+    uint32_t before;
+    do
+    {
+        before = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+        reading = _latest;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((before & 1) != 0 || __atomic_load_n(&_sequence, __ATOMIC_RELAXED) != before);
+    return before != 0;
+}
+
+uint32_t ImuTask::getSamples() const
+{
+    return _samples;
+}
+
+uint32_t ImuTask::getErrors() const
+{
+    return _errors;
+}
+
+#ifdef ARDUINO
+void ImuTask::run(void *parameter)
+{
+    ImuTask *task = (ImuTask *)parameter;
+    TickType_t wake = xTaskGetTickCount();
+    while (true)
+    {
+        task->step();
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(IMU_TASK_PERIOD_MS));
+    }
+}
+#endif
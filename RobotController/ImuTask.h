@@ -0,0 +1,66 @@
+#ifndef IMU_TASK_H
+#define IMU_TASK_H
+
+#include "Imu.h"
+#include "TiltGuard.h"
+
+// Default settings
+#define IMU_TASK_PERIOD_MS 2     // 500Hz, a burst read takes about 0.5ms of it on the bus
+#define IMU_TASK_STACK_SIZE 3072
+#define IMU_TASK_PRIORITY 3      // Above the loop task, so a busy loop can't delay a cut
+#define IMU_TASK_CORE 1          // The loop's core, Bluetooth keeps core 0 busy
+#define IMU_TASK_STALE_US 20000  // A sample older than this is treated as a failed read
+
+// Worst case from crossing the cut angle to the outputs going off: the sensor's filter
+// delay, one period until the next sample, its bus transfer and the angle filter, plus a
+// period of scheduling slack
+static_assert(IMU_FILTER_DELAY_US + 2 * IMU_TASK_PERIOD_MS * 1000 + 1000 <= TILT_MAX_CUT_LATENCY_US,
+              "IMU task period too long for the tilt cut latency budget");
+
+/*
+ * Owns the IMU: reads it at a fixed rate on a task of its own, runs each sample through
+ * the tilt guard right away and keeps the newest one for the yaw and traction ticks, which
+ * no longer touch the bus. Nothing else may call the sensor's read() once this runs.
+ *
+ * The newest sample is guarded by a sequence counter (odd while it is being written), so
+ * the loop never waits on the task.
+ */
+class ImuTask
+{
+public:
+    // Constructor
+    ImuTask();
+
+    // Start sampling the sensor, begin() must already have succeeded
+    void begin(ImuSensor &imu, TiltGuard &tiltGuard);
+
+    // One sample: read, check tilt and publish. The task calls it every period; on the
+    // host, the simulation calls it instead.
+    void step();
+
+    // Copy the newest sample, false if none arrived yet
+    bool getLatest(ImuReading &reading) const;
+
+    uint32_t getSamples() const;
+    uint32_t getErrors() const;
+
+private:
+    ImuSensor *_imu;
+    TiltGuard *_tiltGuard;
+
+    ImuReading _latest;
+    volatile uint32_t _sequence; // Even when _latest is stable
+    volatile uint32_t _samples;
+    volatile uint32_t _errors;
+
+    // Helper methods
+#ifdef ARDUINO
+    static void run(void *parameter);
+#endif
+};
+
+#ifdef ARDUINO
+extern ImuTask imuTask;
+#endif
+
+#endif // IMU_TASK_H
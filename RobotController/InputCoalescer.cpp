@@ -0,0 +1,81 @@
+#include "InputCoalescer.h"
+#include "Metrics.h"
+#include <string.h>
+
+InputCoalescer inputCoalescer;
+
+InputCoalescer::InputCoalescer()
+{
+    memset(&_gamepad, 0, sizeof(_gamepad));
+    _arrivalUs = 0;
+    _source = INPUT_SOURCE_BLUETOOTH;
+    _sequence = 0;
+    _published = 0;
+    _lastTakenIndex = 0;
+    _taken = 0;
+    _coalesced = 0;
+}
+
+void InputCoalescer::publish(const GamepadSnapshot &gamepad, InputSource source, uint32_t arrivalUs)
+{
+    __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    _gamepad = gamepad;
+    _arrivalUs = arrivalUs;
+    _source = source;
+
+    __atomic_store_n(&_published, _published + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+}
+
+bool InputCoalescer::take(GamepadSnapshot &gamepad, uint32_t &arrivalUs, InputSource &source)
+{
+    uint32_t index;
+    uint32_t before;
+    do
+    {
+        before = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+        index = __atomic_load_n(&_published, __ATOMIC_RELAXED);
+        if (index == _lastTakenIndex)
+            return false;
+
+        gamepad = _gamepad;
+        arrivalUs = _arrivalUs;
+        source = (InputSource)_source;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((before & 1) != 0 || __atomic_load_n(&_sequence, __ATOMIC_RELAXED) != before);
+
+    // Every report published since the last take, except this one, was never acted on
+    _coalesced += index - _lastTakenIndex - 1;
+    if (index - _lastTakenIndex > 1)
+        metrics.count(METRIC_INPUT_COALESCED, index - _lastTakenIndex - 1);
+    _lastTakenIndex = index;
+    _taken++;
+    return true;
+}
+
+bool InputCoalescer::hasReport() const
+{
+    return _published != 0;
+}
+
+uint32_t InputCoalescer::getAgeUs(uint32_t nowUs) const
+{
+    return nowUs - __atomic_load_n(&_arrivalUs, __ATOMIC_RELAXED);
+}
+
+uint32_t InputCoalescer::getPublished() const
+{
+    return _published;
+}
+
+uint32_t InputCoalescer::getTaken() const
+{
+    return _taken;
+}
+
+uint32_t InputCoalescer::getCoalesced() const
+{
+    return _coalesced;
+}
@@ -0,0 +1,60 @@
+#ifndef INPUT_COALESCER_H
+#define INPUT_COALESCER_H
+
+#include "GamepadSnapshot.h"
+
+// Where a report came from
+enum InputSource
+{
+    INPUT_SOURCE_BLUETOOTH,
+    INPUT_SOURCE_SERIAL, // Wired joystick frames on the framed serial link
+    INPUT_SOURCE_COUNT
+};
+
+/*
+ * Latest-wins mailbox between whatever produces gamepad reports and the motor tick.
+ * A report that arrives before the previous one was taken replaces it and is counted
+ * as coalesced, so the motors never work through a backlog of stale positions, and
+ * every report carries its arrival time so the consumer knows how old it is.
+ *
+ * One producer and one consumer, on any task or core: the report is guarded by a
+ * sequence counter (odd while it is being written) instead of a lock.
+ */
+class InputCoalescer
+{
+public:
+    // Constructor
+    InputCoalescer();
+
+    // Producer side: store a new report, replacing any that wasn't taken yet
+    void publish(const GamepadSnapshot &gamepad, InputSource source, uint32_t arrivalUs);
+
+    // Consumer side: copy the latest report if it is newer than the last one taken
+    bool take(GamepadSnapshot &gamepad, uint32_t &arrivalUs, InputSource &source);
+
+    // Whether any report arrived since begin, and how old the latest one is
+    bool hasReport() const;
+    uint32_t getAgeUs(uint32_t nowUs) const;
+
+    uint32_t getPublished() const;
+    uint32_t getTaken() const;
+    uint32_t getCoalesced() const;
+
+private:
+    GamepadSnapshot _gamepad;
+    uint32_t _arrivalUs;
+    uint8_t _source;
+    volatile uint32_t _sequence; // Even when _gamepad is stable
+
+    // Written by the producer only
+    volatile uint32_t _published;
+
+    // Written by the consumer only
+    uint32_t _lastTakenIndex;
+    uint32_t _taken;
+    uint32_t _coalesced;
+};
+
+extern InputCoalescer inputCoalescer;
+
+#endif // INPUT_COALESCER_H
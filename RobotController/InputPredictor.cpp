@@ -0,0 +1,115 @@
+#include "InputPredictor.h"
+#include "Metrics.h"
+#include <stdlib.h>
+
+// The predicted axes, both sticks
+static int16_t GamepadSnapshot::*const AXES[4] = {
+    &GamepadSnapshot::axisX,
+    &GamepadSnapshot::axisY,
+    &GamepadSnapshot::axisRX,
+    &GamepadSnapshot::axisRY,
+};
+
+#ifdef ARDUINO
+InputPredictor inputPredictor;
+#endif
+
+InputPredictor::InputPredictor()
+{
+    reset();
+}
+
+void InputPredictor::reset()
+{
+    memset(&_last, 0, sizeof(_last));
+    memset(_anchor, 0, sizeof(_anchor));
+    memset(_slopes, 0, sizeof(_slopes));
+    _lastArrivalUs = 0;
+    _anchorUs = 0;
+    _hasReport = false;
+}
+
+void InputPredictor::addReport(const GamepadSnapshot &gamepad, uint32_t arrivalUs)
+{
+    if (!_hasReport)
+    {
+        for (uint8_t axis = 0; axis < 4; axis++)
+            _anchor[axis] = gamepad.*AXES[axis];
+        _anchorUs = arrivalUs;
+    }
+    else
+    {
+        // How far off the guess for this moment was, the worst axis counts
+        uint32_t elapsedUs = arrivalUs - _lastArrivalUs;
+        int32_t errorMax = 0;
+        bool extrapolated = false;
+        for (uint8_t axis = 0; axis < 4; axis++)
+        {
+            extrapolated |= _slopes[axis] != 0 && _last.*AXES[axis] != 0;
+            int32_t error = abs(predictAxis(axis, elapsedUs) - gamepad.*AXES[axis]);
+            if (error > errorMax)
+                errorMax = error;
+        }
+        if (extrapolated)
+            metrics.observe(METRIC_INPUT_PREDICTION_ERROR, errorMax);
+
+        // Reports in a burst arrive together whenever they were sampled, so the slope is
+        // only measured across a gap
+        uint32_t gapUs = arrivalUs - _anchorUs;
+        if (gapUs >= INPUT_PREDICTOR_MIN_GAP_US)
+        {
+            for (uint8_t axis = 0; axis < 4; axis++)
+            {
+                int32_t delta = gamepad.*AXES[axis] - _anchor[axis];
+                _slopes[axis] = gapUs > INPUT_PREDICTOR_HORIZON_US ? 0 : (int32_t)(((int64_t)delta << 16) / gapUs);
+                _anchor[axis] = gamepad.*AXES[axis];
+            }
+            _anchorUs = arrivalUs;
+        }
+    }
+
+    _last = gamepad;
+    _lastArrivalUs = arrivalUs;
+    _hasReport = true;
+}
+
+bool InputPredictor::predict(uint32_t nowUs, GamepadSnapshot &out) const
+{
+    out = _last;
+    uint32_t elapsedUs = nowUs - _lastArrivalUs;
+    if (!_hasReport || elapsedUs >= INPUT_PREDICTOR_HORIZON_US)
+        return false;
+
+    bool moving = false;
+    for (uint8_t axis = 0; axis < 4; axis++)
+    {
+        out.*AXES[axis] = predictAxis(axis, elapsedUs);
+        moving |= out.*AXES[axis] != _last.*AXES[axis];
+    }
+    return moving;
+}
+
+int16_t InputPredictor::predictAxis(uint8_t axis, uint32_t elapsedUs) const
+{
+    int32_t value = _last.*AXES[axis];
+    if (value == 0 || _slopes[axis] == 0)
+        return value;
+
+    // The speed falls linearly to zero over the horizon, so the distance covered is
+    // slope * (t - t^2 / 2H) and the stick comes to rest at the horizon
+    if (elapsedUs > INPUT_PREDICTOR_HORIZON_US)
+        elapsedUs = INPUT_PREDICTOR_HORIZON_US;
+    int64_t travelUs = elapsedUs - (int64_t)elapsedUs * elapsedUs / (2 * INPUT_PREDICTOR_HORIZON_US);
+    int32_t step = (int32_t)((_slopes[axis] * travelUs) >> 16);
+    step = step > INPUT_PREDICTOR_MAX_STEP ? INPUT_PREDICTOR_MAX_STEP : step < -INPUT_PREDICTOR_MAX_STEP ? -INPUT_PREDICTOR_MAX_STEP : step;
+
+    // Never through the centre, never past the end of the range
+    int32_t predicted = value + step;
+    if ((predicted ^ value) < 0)
+        predicted = 0;
+    if (predicted > INPUT_PREDICTOR_STICK_LIMIT - 1)
+        predicted = INPUT_PREDICTOR_STICK_LIMIT - 1;
+    if (predicted < -INPUT_PREDICTOR_STICK_LIMIT)
+        predicted = -INPUT_PREDICTOR_STICK_LIMIT;
+    return predicted;
+}
@@ -0,0 +1,57 @@
+#ifndef INPUT_PREDICTOR_H
+#define INPUT_PREDICTOR_H
+
+#include "GamepadSnapshot.h"
+
+// Default settings
+#define INPUT_PREDICTOR_PERIOD_US 5000   // Control rate while extrapolating (200Hz)
+#define INPUT_PREDICTOR_HORIZON_US 40000 // Longest a report is carried forward
+#define INPUT_PREDICTOR_MIN_GAP_US 4000  // Reports closer than this (a burst) don't set the slope
+#define INPUT_PREDICTOR_MAX_STEP 96      // Furthest a stick is moved past its last report
+#define INPUT_PREDICTOR_STICK_LIMIT 512
+
+/*
+ * Fills the gaps between bursty Bluetooth reports: each stick keeps moving along the
+ * slope of its last reports, slowing down over the horizon until it holds still. The
+ * guess is bounded: it never moves a stick further than INPUT_PREDICTOR_MAX_STEP from
+ * what was reported, never pushes it through the centre into the other direction, and
+ * never moves a stick that was reported centred.
+ *
+ * Slopes are fixed point (stick units per microsecond << 16), so predicting costs a few
+ * integer multiplies per axis.
+ */
+class InputPredictor
+{
+public:
+    // Constructor
+    InputPredictor();
+
+    // Take a real report, and record how far the prediction for it was off
+    void addReport(const GamepadSnapshot &gamepad, uint32_t arrivalUs);
+
+    // Write the extrapolated report for nowUs. Returns false once there's nothing left
+    // to extrapolate (past the horizon, or no stick moving), out then holds the last report.
+    bool predict(uint32_t nowUs, GamepadSnapshot &out) const;
+
+    // Forget the last report and slopes, e.g. after the controller reconnects
+    void reset();
+
+private:
+    GamepadSnapshot _last;
+    uint32_t _lastArrivalUs;
+    bool _hasReport;
+
+    // Report the slopes were measured from
+    int16_t _anchor[4];
+    uint32_t _anchorUs;
+    int32_t _slopes[4];
+
+    // Helper methods
+    int16_t predictAxis(uint8_t axis, uint32_t elapsedUs) const;
+};
+
+#ifdef ARDUINO
+extern InputPredictor inputPredictor;
+#endif
+
+#endif // INPUT_PREDICTOR_H
@@ -0,0 +1,118 @@
+#include "Logger.h"
+#include "SerialMux.h"
+#include <stdarg.h>
+
+Logger logger;
+
+Logger::Logger()
+{
+    _level = DEFAULT_LOG_LEVEL;
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    _level = level;
+}
+
+LogLevel Logger::getLevel() const
+{
+    return _level;
+}
+
+void Logger::print(LogLevel level, const char *format, ...)
+{
+    if (level > _level)
+        return;
+
+    char line[LOG_LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+
+    if (length < 0)
+        return;
+    if (length > (int)sizeof(line) - 2)
+        length = sizeof(line) - 2;
+
+    line[length++] = '\n';
+    serialMux.output(SERIAL_CHANNEL_LOG).write((const uint8_t *)line, length);
+}
+
+void Logger::send(LogTokenFrame &frame)
+{
+    size_t length;
+    const uint8_t *data = frame.finish(length);
+    serialMux.output(SERIAL_CHANNEL_LOG).write(data, length);
+}
+
+LogTokenFrame::LogTokenFrame(LogLevel level, uint32_t token)
+{
+    _data[0] = LOG_TOKEN_SYNC;
+    _data[2] = level;
+    memcpy(&_data[3], &token, sizeof(token));
+    _length = 7;
+    _truncated = false;
+}
+
+void LogTokenFrame::addInteger(int64_t value)
+{
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    uint8_t encoded[10];
+    size_t count = 0;
+    do
+    {
+        encoded[count] = (zigzag & 0x7F) | (zigzag > 0x7F ? 0x80 : 0);
+        zigzag >>= 7;
+        count++;
+    } while (zigzag != 0);
+
+    // Keep room for the checksum. Once an argument is dropped, later ones are too, so the
+    // decoder never reads an argument in the wrong place.
+    if (_truncated || _length + count > sizeof(_data) - 1)
+    {
+        _truncated = true;
+        return;
+    }
+    memcpy(&_data[_length], encoded, count);
+    _length += count;
+}
+
+void LogTokenFrame::addFloat(float value)
+{
+    if (_truncated || _length + sizeof(value) > sizeof(_data) - 1)
+    {
+        _truncated = true;
+        return;
+    }
+    memcpy(&_data[_length], &value, sizeof(value));
+    _length += sizeof(value);
+}
+
+void LogTokenFrame::addString(const char *text)
+{
+    if (text == nullptr)
+        text = "(null)";
+    if (_truncated || _length + 1 > sizeof(_data) - 1)
+    {
+        _truncated = true;
+        return;
+    }
+
+    size_t count = strnlen(text, sizeof(_data) - 2 - _length);
+    _data[_length++] = count;
+    memcpy(&_data[_length], text, count);
+    _length += count;
+}
+
+const uint8_t *LogTokenFrame::finish(size_t &length)
+{
+    uint8_t sum = 0;
+    for (size_t i = 2; i < _length; i++)
+        sum += _data[i];
+
+    _data[1] = _length - 2;
+    _data[_length] = sum;
+    length = _length + 1;
+    return _data;
+}
\ No newline at end of file
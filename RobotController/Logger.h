@@ -0,0 +1,158 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Debug levels, from silent to everything
+enum LogLevel
+{
+    LOG_LEVEL_NONE,
+    LOG_LEVEL_BASIC,
+    LOG_LEVEL_DETAILED,
+    LOG_LEVEL_VERBOSE
+};
+
+// Size-optimized build profile, set with -DTANK_SIZE_OPTIMIZED=1 (see tools/build.sh)
+#ifndef TANK_SIZE_OPTIMIZED
+#define TANK_SIZE_OPTIMIZED 0
+#endif
+
+// Most detailed level compiled in. Messages above it and their strings are dropped at build time.
+#ifndef LOG_MAX_LEVEL
+#if TANK_SIZE_OPTIMIZED
+#define LOG_MAX_LEVEL LOG_LEVEL_BASIC
+#else
+#define LOG_MAX_LEVEL LOG_LEVEL_VERBOSE
+#endif
+#endif
+
+// Default settings
+#define DEFAULT_LOG_LEVEL LOG_LEVEL_DETAILED
+#define LOG_LINE_LENGTH 128
+
+// Tokenized logging, set with -DLOG_TOKENIZED=1 (see tools/build.sh). Format strings are
+// replaced at build time by a hash of their text and never reach flash; each message goes
+// out as a binary frame with the raw arguments, and tools/log_decode.py turns it back into
+// text using a string table extracted from the sources.
+#ifndef LOG_TOKENIZED
+#define LOG_TOKENIZED 0
+#endif
+
+// Token frame: sync, length, then length bytes of level, token (u32 LE) and arguments,
+// then the low byte of their sum. Integers are zigzag varints, floating point values are
+// 32-bit floats and strings are a length byte followed by the characters.
+#define LOG_TOKEN_SYNC 0xA6
+
+// FNV-1a hash of a format string, evaluated by the compiler
+constexpr uint32_t logToken(const char *format, uint32_t hash = 2166136261u)
+{
+    return *format ? logToken(format + 1, (hash ^ (uint8_t)*format) * 16777619u) : hash;
+}
+
+// Never defined, only used to keep printf argument checking in tokenized builds
+int logFormatCheck(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Logging macros, printf-style without the trailing newline
+#if LOG_TOKENIZED
+#define LOG_AT(level, format, ...)                                      \
+    do                                                                  \
+    {                                                                   \
+        if ((level) <= LOG_MAX_LEVEL)                                   \
+        {                                                               \
+            constexpr uint32_t token = logToken(format);                \
+            (void)sizeof(logFormatCheck(format, ##__VA_ARGS__));        \
+            logger.printToken(level, token, ##__VA_ARGS__);             \
+        }                                                               \
+    } while (0)
+#else
+#define LOG_AT(level, ...)                   \
+    do                                       \
+    {                                        \
+        if ((level) <= LOG_MAX_LEVEL)        \
+            logger.print(level, __VA_ARGS__); \
+    } while (0)
+#endif
+#define LOG_BASIC(...) LOG_AT(LOG_LEVEL_BASIC, __VA_ARGS__)
+#define LOG_DETAILED(...) LOG_AT(LOG_LEVEL_DETAILED, __VA_ARGS__)
+#define LOG_VERBOSE(...) LOG_AT(LOG_LEVEL_VERBOSE, __VA_ARGS__)
+
+// Builds one token frame on the stack, dropping arguments that no longer fit
+class LogTokenFrame
+{
+public:
+    LogTokenFrame(LogLevel level, uint32_t token);
+
+    void addInteger(int64_t value);
+    void addFloat(float value);
+    void addString(const char *text);
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type add(T value)
+    {
+        addInteger((int64_t)value);
+    }
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type add(T value)
+    {
+        addFloat((float)value);
+    }
+    void add(const char *text)
+    {
+        addString(text);
+    }
+    void add(const void *pointer)
+    {
+        addInteger((int64_t)(uintptr_t)pointer);
+    }
+
+    // Close the frame and return its bytes
+    const uint8_t *finish(size_t &length);
+
+private:
+    uint8_t _data[LOG_LINE_LENGTH];
+    size_t _length;
+    bool _truncated;
+};
+
+class Logger
+{
+public:
+    // Constructor
+    Logger();
+
+    // Runtime level, anything more detailed is skipped
+    void setLevel(LogLevel level);
+    LogLevel getLevel() const;
+
+    // Format and send one line if the level is enabled
+    void print(LogLevel level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+    // Send one token frame if the level is enabled, see LOG_TOKENIZED
+    template <typename... Args>
+    void printToken(LogLevel level, uint32_t token, Args... args)
+    {
+        if (level > _level)
+            return;
+
+        LogTokenFrame frame(level, token);
+        addArguments(frame, args...);
+        send(frame);
+    }
+
+private:
+    void addArguments(LogTokenFrame &) {}
+    template <typename T, typename... Args>
+    void addArguments(LogTokenFrame &frame, T first, Args... rest)
+    {
+        frame.add(first);
+        addArguments(frame, rest...);
+    }
+    void send(LogTokenFrame &frame);
+
+    LogLevel _level;
+};
+
+extern Logger logger;
+
+#endif // LOGGER_H
@@ -0,0 +1,124 @@
+#include "LoopProfiler.h"
+
+#ifdef ARDUINO
+#include "SerialMux.h"
+#define PROFILER_PRINTF serialMux.console().printf
+#else
+#include <stdio.h>
+#include <string.h>
+#define PROFILER_PRINTF printf
+#endif
+
+LoopProfiler loopProfiler;
+
+LoopProfiler::LoopProfiler()
+{
+    _passStart = 0;
+    _passes = 0;
+    _cycleScale = 1 << 16;
+    _overhead = 0;
+    reset();
+}
+
+void LoopProfiler::begin(uint32_t cpuMhz)
+{
+    setCpuFrequency(cpuMhz);
+
+    // Time a batch of empty passes to find what the profiler itself costs
+    const uint32_t runs = 64;
+    uint32_t start = loopProfilerCycles();
+    for (uint32_t i = 0; i < runs; i++)
+    {
+        startPass();
+        endPass();
+    }
+    _overhead = scale(loopProfilerCycles() - start) / runs;
+
+    reset();
+}
+
+void LoopProfiler::setCpuFrequency(uint32_t cpuMhz)
+{
+    _cycleScale = cpuMhz > 0 ? ((uint32_t)LOOP_PROFILER_REFERENCE_MHZ << 16) / cpuMhz : 1 << 16;
+
+    // The period spanning the change would be measured in the wrong units
+    _passes = 0;
+}
+
+void LoopProfiler::reset()
+{
+    resetHistogram(_period);
+    resetHistogram(_execution);
+    _passes = 0;
+}
+
+void LoopProfiler::printReport() const
+{
+    PROFILER_PRINTF("Loop profiler overhead: %lu.%03luus per pass\n",
+                    (unsigned long)(_overhead / LOOP_PROFILER_REFERENCE_MHZ),
+                    (unsigned long)(_overhead % LOOP_PROFILER_REFERENCE_MHZ * 1000 / LOOP_PROFILER_REFERENCE_MHZ));
+    printHistogram("period", _period);
+    printHistogram("execution", _execution);
+}
+
+uint32_t LoopProfiler::binLowerBound(uint32_t index)
+{
+    if (index < (1u << LOOP_PROFILER_SUB_BITS))
+        return index;
+
+    uint32_t top = (index >> LOOP_PROFILER_SUB_BITS) + LOOP_PROFILER_SUB_BITS - 1;
+    uint32_t sub = index & ((1u << LOOP_PROFILER_SUB_BITS) - 1);
+    return (1u << top) | (sub << (top - LOOP_PROFILER_SUB_BITS));
+}
+
+void LoopProfiler::resetHistogram(Histogram &histogram)
+{
+    memset(histogram.bins, 0, sizeof(histogram.bins));
+    histogram.count = 0;
+    histogram.min = UINT32_MAX;
+    histogram.max = 0;
+    histogram.total = 0;
+}
+
+uint32_t LoopProfiler::percentile(const Histogram &histogram, uint32_t percent)
+{
+    // Lower bound of the bin that holds the given share of samples
+    uint64_t target = ((uint64_t)histogram.count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LOOP_PROFILER_BINS; i++)
+    {
+        seen += histogram.bins[i];
+        if (seen >= target && seen > 0)
+            return binLowerBound(i);
+    }
+    return histogram.max;
+}
+
+void LoopProfiler::printHistogram(const char *name, const Histogram &histogram)
+{
+    const uint32_t mhz = LOOP_PROFILER_REFERENCE_MHZ;
+
+    if (histogram.count == 0)
+    {
+        PROFILER_PRINTF("%s: no samples\n", name);
+        return;
+    }
+
+    PROFILER_PRINTF("%s: n=%lu min=%luus mean=%luus p50=%luus p99=%luus max=%luus\n", name,
+                    (unsigned long)histogram.count, (unsigned long)(histogram.min / mhz),
+                    (unsigned long)(histogram.total / histogram.count / mhz),
+                    (unsigned long)(percentile(histogram, 50) / mhz), (unsigned long)(percentile(histogram, 99) / mhz),
+                    (unsigned long)(histogram.max / mhz));
+
+    for (uint32_t i = 0; i < LOOP_PROFILER_BINS; i++)
+    {
+        if (histogram.bins[i] == 0)
+            continue;
+
+        uint32_t low = binLowerBound(i);
+        uint32_t high = i + 1 < LOOP_PROFILER_BINS ? binLowerBound(i + 1) : UINT32_MAX;
+        PROFILER_PRINTF("  %8lu.%02lu - %8lu.%02luus %lu\n", (unsigned long)(low / mhz),
+                        (unsigned long)(low % mhz * 100 / mhz), (unsigned long)(high / mhz),
+                        (unsigned long)(high % mhz * 100 / mhz), (unsigned long)histogram.bins[i]);
+    }
+}
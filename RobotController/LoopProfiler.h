@@ -0,0 +1,122 @@
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>
+#include <time.h>
+#endif
+
+// Histogram layout: one row per power of two, split into 4 sub-bins
+#define LOOP_PROFILER_SUB_BITS 2
+#define LOOP_PROFILER_BINS ((32 - LOOP_PROFILER_SUB_BITS + 1) << LOOP_PROFILER_SUB_BITS)
+
+// Times are kept in cycles of this clock; samples taken at a lower clock are scaled up
+#ifdef ARDUINO
+#define LOOP_PROFILER_REFERENCE_MHZ 240
+#else
+#define LOOP_PROFILER_REFERENCE_MHZ 1000 // Host counts nanoseconds
+#endif
+
+// Free-running cycle counter
+static inline uint32_t loopProfilerCycles()
+{
+#ifdef ARDUINO
+    return ESP.getCycleCount();
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint32_t)(time.tv_sec * 1000000000ULL + time.tv_nsec);
+#endif
+}
+
+// Always-on period and execution-time histograms for loop()
+class LoopProfiler
+{
+public:
+    // Constructor
+    LoopProfiler();
+
+    // Measure our own overhead and start counting
+    void begin(uint32_t cpuMhz);
+
+    // Call at the start and end of every loop pass
+    inline void startPass()
+    {
+        uint32_t now = loopProfilerCycles();
+        if (_passes > 0)
+            record(_period, scale(now - _passStart));
+        _passStart = now;
+        _passes++;
+    }
+
+    inline void endPass()
+    {
+        record(_execution, scale(loopProfilerCycles() - _passStart));
+    }
+
+    // Tell the profiler the CPU clock changed (cycle counts scale with it)
+    void setCpuFrequency(uint32_t cpuMhz);
+
+    // Clear both histograms
+    void reset();
+
+    // Print both histograms with summary statistics
+    void printReport() const;
+
+private:
+    struct Histogram
+    {
+        uint32_t bins[LOOP_PROFILER_BINS];
+        uint32_t count;
+        uint32_t min;
+        uint32_t max;
+        uint64_t total;
+    };
+
+    Histogram _period;
+    Histogram _execution;
+    uint32_t _passStart;
+    uint32_t _passes;
+    uint32_t _cycleScale; // Reference cycles per CPU cycle, 16.16 fixed point
+    uint32_t _overhead; // Cycles for one startPass() + endPass()
+
+    // Helper methods
+    inline uint32_t scale(uint32_t cycles) const
+    {
+        // Multiply first, so 240/160 scales by 1.5 rather than a truncated 1
+        uint64_t scaled = ((uint64_t)cycles * _cycleScale) >> 16;
+        return scaled > UINT32_MAX ? UINT32_MAX : (uint32_t)scaled;
+    }
+
+    static inline void record(Histogram &histogram, uint32_t cycles)
+    {
+        histogram.bins[binIndex(cycles)]++;
+        histogram.count++;
+        histogram.total += cycles;
+        if (cycles < histogram.min)
+            histogram.min = cycles;
+        if (cycles > histogram.max)
+            histogram.max = cycles;
+    }
+
+    static inline uint32_t binIndex(uint32_t cycles)
+    {
+        // Position of the top bit, plus the next LOOP_PROFILER_SUB_BITS bits below it
+        if (cycles < (1u << LOOP_PROFILER_SUB_BITS))
+            return cycles;
+        uint32_t top = 31 - __builtin_clz(cycles);
+        uint32_t sub = (cycles >> (top - LOOP_PROFILER_SUB_BITS)) & ((1u << LOOP_PROFILER_SUB_BITS) - 1);
+        return ((top - LOOP_PROFILER_SUB_BITS + 1) << LOOP_PROFILER_SUB_BITS) | sub;
+    }
+
+    static uint32_t binLowerBound(uint32_t index);
+    static void resetHistogram(Histogram &histogram);
+    static uint32_t percentile(const Histogram &histogram, uint32_t percent);
+    static void printHistogram(const char *name, const Histogram &histogram);
+};
+
+extern LoopProfiler loopProfiler;
+
+#endif // LOOP_PROFILER_H
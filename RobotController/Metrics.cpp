@@ -0,0 +1,75 @@
+#include "Metrics.h"
+#include <string.h>
+
+#ifdef ARDUINO
+#include "SerialMux.h"
+#define METRICS_PRINTF serialMux.console().printf
+#else
+#include <stdio.h>
+#define METRICS_PRINTF printf
+#endif
+
+#define METRIC_NAME(id, name, help) name,
+
+static const char *const COUNTER_NAMES[] = {TANK_COUNTERS(METRIC_NAME)};
+static const char *const GAUGE_NAMES[] = {TANK_GAUGES(METRIC_NAME)};
+static const char *const MINMAX_NAMES[] = {TANK_MINMAX(METRIC_NAME)};
+static const char *const HISTOGRAM_NAMES[] = {TANK_HISTOGRAMS(METRIC_NAME)};
+
+Metrics metrics;
+
+Metrics::Metrics()
+{
+    memset(_counters, 0, sizeof(_counters));
+    for (uint8_t i = 0; i < METRIC_GAUGE_COUNT; i++)
+        _gauges[i] = 0;
+    memset(_minMax, 0, sizeof(_minMax));
+    memset(_histograms, 0, sizeof(_histograms));
+}
+
+uint32_t Metrics::getCounter(MetricCounter id) const
+{
+    uint32_t total = 0;
+    for (uint8_t core = 0; core < METRICS_CORES; core++)
+        total += __atomic_load_n(&_counters[core][id], __ATOMIC_RELAXED);
+    return total;
+}
+
+void Metrics::resetMinMax()
+{
+    memset(_minMax, 0, sizeof(_minMax));
+}
+
+void Metrics::dump(unsigned long uptimeMs) const
+{
+    METRICS_PRINTF("metrics %d %lu\n", METRICS_DUMP_VERSION, uptimeMs);
+
+    for (uint8_t i = 0; i < METRIC_COUNTER_COUNT; i++)
+        METRICS_PRINTF("c %s %lu\n", COUNTER_NAMES[i], (unsigned long)getCounter((MetricCounter)i));
+
+    for (uint8_t i = 0; i < METRIC_GAUGE_COUNT; i++)
+        METRICS_PRINTF("g %s %ld\n", GAUGE_NAMES[i], (long)_gauges[i]);
+
+    for (uint8_t i = 0; i < METRIC_MINMAX_COUNT; i++)
+        METRICS_PRINTF("m %s %ld %ld %lu\n", MINMAX_NAMES[i], (long)_minMax[i].min, (long)_minMax[i].max,
+                       (unsigned long)_minMax[i].count);
+
+    for (uint8_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+    {
+        uint32_t sum = 0;
+        uint32_t buckets[METRICS_HISTOGRAM_BUCKETS] = {};
+        for (uint8_t core = 0; core < METRICS_CORES; core++)
+        {
+            sum += __atomic_load_n(&_histograms[core][i].sum, __ATOMIC_RELAXED);
+            for (uint8_t b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++)
+                buckets[b] += __atomic_load_n(&_histograms[core][i].buckets[b], __ATOMIC_RELAXED);
+        }
+
+        METRICS_PRINTF("h %s %lu", HISTOGRAM_NAMES[i], (unsigned long)sum);
+        for (uint8_t b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++)
+            METRICS_PRINTF(" %lu", (unsigned long)buckets[b]);
+        METRICS_PRINTF("\n");
+    }
+
+    METRICS_PRINTF("end\n");
+}
@@ -0,0 +1,167 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define METRICS_CORES portNUM_PROCESSORS
+#else
+#include <stdint.h>
+#define METRICS_CORES 1
+#endif
+
+/*
+ * Every metric is declared here, so the tables are fixed at compile time and recording
+ * one is a single array update. Names follow Prometheus conventions; tools/metrics_prom.py
+ * reads the help text from this file.
+ */
+#define TANK_COUNTERS(X) \
+    X(MOTOR_WRITES, "tank_motor_writes_total", "PWM duty writes to the motor driver") \
+    X(MOTOR_DIRECTION_CHANGES, "tank_motor_direction_changes_total", "Motor starts, stops and reversals") \
+    X(MOTOR_BRAKES, "tank_motor_brakes_total", "Setpoints that braked both tracks actively") \
+    X(MOTOR_CLAMPS, "tank_motor_clamps_total", "Stick or calibration values clamped to their range") \
+    X(CONTROLLER_REPORTS, "tank_controller_reports_total", "Gamepad reports processed") \
+    X(CONTROLLER_UNCHANGED, "tank_controller_unchanged_total", "Gamepad reports identical to the last one") \
+    X(CONTROLLER_DEAD_ZONE, "tank_controller_dead_zone_total", "Stick readings zeroed by the dead zone") \
+    X(INPUT_COALESCED, "tank_input_coalesced_total", "Reports replaced by a newer one before the motor tick took them") \
+    X(SERIAL_GAMEPAD_FRAMES, "tank_serial_gamepad_frames_total", "Wired joystick reports received on the framed serial link") \
+    X(SERIAL_GAMEPAD_REJECTED, "tank_serial_gamepad_rejected_total", "Wired joystick reports with the wrong size or reserved bits set") \
+    X(INPUT_PREDICTED, "tank_input_predicted_total", "Motor setpoints made from an extrapolated report") \
+    X(IMU_ERRORS, "tank_imu_errors_total", "IMU reads that failed on the I2C bus") \
+    X(TRACTION_SLIPS, "tank_traction_slips_total", "Times a spinning track had its power cut") \
+    X(CALIBRATION_CHANGES, "tank_calibration_changes_total", "Motor calibration button presses") \
+    X(FAILSAFE_TRIPS, "tank_failsafe_trips_total", "Hardware failsafe motor cuts") \
+    X(WATCHDOG_TRIPS, "tank_watchdog_trips_total", "Watchdog motor cuts after a stalled subsystem") \
+    X(TILT_TRIPS, "tank_tilt_trips_total", "Motor cuts for tipping past the cut angle or losing the IMU") \
+    X(TILT_LATE_CUTS, "tank_tilt_late_cuts_total", "Tilt cuts that took longer than the latency budget")
+
+#define TANK_GAUGES(X) \
+    X(CONTROLLER_CONNECTED, "tank_controller_connected", "1 while a controller is connected") \
+    X(FREE_HEAP, "tank_free_heap_bytes", "Free heap at the last resource sample")
+
+#define TANK_MINMAX(X) \
+    X(STICK_LEFT_Y, "tank_stick_left_y", "Raw left stick Y reading") \
+    X(STICK_RIGHT_Y, "tank_stick_right_y", "Raw right stick Y reading")
+
+#define TANK_HISTOGRAMS(X) \
+    X(CONTROLLER_INTERVAL, "tank_controller_report_interval_ms", "Time between gamepad reports") \
+    X(INPUT_AGE, "tank_input_age_us", "Age of a report when the motor tick acts on it") \
+    X(INPUT_PREDICTION_ERROR, "tank_input_prediction_error", "Worst stick error of the extrapolation when the real report arrived") \
+    X(TILT_CUT_LATENCY, "tank_tilt_cut_latency_us", "Time from the last sample under the cut angle to the outputs going off") \
+    X(YAW_ERROR, "tank_yaw_error_dps", "Gap between the expected and measured turn rate, each control tick") \
+    X(SETPOINT_STEP, "tank_setpoint_step", "Largest change in motor power from one setpoint to the next")
+
+#define METRIC_ID(id, name, help) METRIC_##id,
+
+enum MetricCounter
+{
+    TANK_COUNTERS(METRIC_ID) METRIC_COUNTER_COUNT
+};
+
+enum MetricGauge
+{
+    TANK_GAUGES(METRIC_ID) METRIC_GAUGE_COUNT
+};
+
+enum MetricMinMax
+{
+    TANK_MINMAX(METRIC_ID) METRIC_MINMAX_COUNT
+};
+
+enum MetricHistogram
+{
+    TANK_HISTOGRAMS(METRIC_ID) METRIC_HISTOGRAM_COUNT
+};
+
+// Histogram buckets: 0, then one per power of two up to 2^15, then everything above
+#define METRICS_HISTOGRAM_BUCKETS 17
+
+// Dump format version, see Metrics::dump()
+#define METRICS_DUMP_VERSION 1
+
+// Core the caller runs on, each core updates its own copy of counters and histograms
+static inline uint32_t metricsCore()
+{
+#ifdef ARDUINO
+    return xPortGetCoreID();
+#else
+    return 0;
+#endif
+}
+
+class Metrics
+{
+public:
+    // Constructor
+    Metrics();
+
+    // Lock-free, safe from interrupts and either core
+    __attribute__((always_inline)) inline void count(MetricCounter id, uint32_t amount = 1)
+    {
+        __atomic_fetch_add(&_counters[metricsCore()][id], amount, __ATOMIC_RELAXED);
+    }
+
+    __attribute__((always_inline)) inline void set(MetricGauge id, int32_t value)
+    {
+        _gauges[id] = value;
+    }
+
+    // Single writer per metric, typically the loop task
+    inline void observe(MetricMinMax id, int32_t value)
+    {
+        MinMax &minMax = _minMax[id];
+        if (minMax.count == 0 || value < minMax.min)
+            minMax.min = value;
+        if (minMax.count == 0 || value > minMax.max)
+            minMax.max = value;
+        minMax.count++;
+    }
+
+    __attribute__((always_inline)) inline void observe(MetricHistogram id, uint32_t value)
+    {
+        uint32_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+        if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+            bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+
+        Histogram &histogram = _histograms[metricsCore()][id];
+        __atomic_fetch_add(&histogram.buckets[bucket], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&histogram.sum, value, __ATOMIC_RELAXED);
+    }
+
+    // Totals across cores
+    uint32_t getCounter(MetricCounter id) const;
+
+    // Clear min/max so they follow the next stretch of driving
+    void resetMinMax();
+
+    // One line per metric, converted to Prometheus text by tools/metrics_prom.py:
+    //   metrics <version> <uptime ms>
+    //   c <name> <value>
+    //   g <name> <value>
+    //   m <name> <min> <max> <samples>
+    //   h <name> <sum> <bucket 0> ... <bucket 16>
+    //   end
+    void dump(unsigned long uptimeMs) const;
+
+private:
+    struct MinMax
+    {
+        int32_t min;
+        int32_t max;
+        uint32_t count;
+    };
+
+    struct Histogram
+    {
+        uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+        uint32_t sum;
+    };
+
+    uint32_t _counters[METRICS_CORES][METRIC_COUNTER_COUNT];
+    volatile int32_t _gauges[METRIC_GAUGE_COUNT];
+    MinMax _minMax[METRIC_MINMAX_COUNT];
+    Histogram _histograms[METRICS_CORES][METRIC_HISTOGRAM_COUNT];
+};
+
+extern Metrics metrics;
+
+#endif // METRICS_H
@@ -0,0 +1,226 @@
+#ifndef MOTOR_HAL_H
+#define MOTOR_HAL_H
+
+#include "TankConfig.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <soc/gpio_reg.h>
+#include <soc/gpio_sig_map.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#define IRAM_ATTR
+#endif
+
+/*
+ * Hardware access policies for BasicTankMotors (see TankMotors.h). Every member is static
+ * and inline, so the motor class compiles down to the target's own write sequence:
+ *
+ *   configureOutput(pin)        set a pin up as a motor output
+ *   writeDuty(pin, power)       0..255
+ *   disconnect(pin, saved)      drive the pin low whatever writeDuty() does, from any core or ISR
+ *   reconnect(pin, saved)       undo disconnect()
+ *   Lock, initLock(), lock(), unlock(), lockFromIsr(), unlockFromIsr()
+ */
+
+#ifdef ARDUINO
+// PWM on the LEDC channels, frequency and resolution from TANK_CONFIG, the default
+struct LedcMotorHal
+{
+    typedef portMUX_TYPE Lock;
+
+    static inline void configureOutput(uint8_t pin)
+    {
+        pinMode(pin, OUTPUT);
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+        ledcAttachChannel(pin, TANK_CONFIG.pwmFrequency, TANK_CONFIG.pwmResolutionBits, TANK_CONFIG.ledcChannelFor(pin));
+#else
+        ledcSetup(TANK_CONFIG.ledcChannelFor(pin), TANK_CONFIG.pwmFrequency, TANK_CONFIG.pwmResolutionBits);
+        ledcAttachPin(pin, TANK_CONFIG.ledcChannelFor(pin));
+#endif
+    }
+
+    // Power goes through the duty table, so resolution and motor dead band cost nothing here
+    static inline void writeDuty(uint8_t pin, uint8_t power)
+    {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+        ledcWrite(pin, MotorDutyTable::values[power]);
+#else
+        ledcWrite(TANK_CONFIG.ledcChannelFor(pin), MotorDutyTable::values[power]);
+#endif
+    }
+
+    // Route the pin away from the LEDC peripheral to the plain GPIO output and drive it low
+    static inline void IRAM_ATTR disconnect(uint8_t pin, uint32_t &saved)
+    {
+        uint32_t selectReg = GPIO_FUNC0_OUT_SEL_CFG_REG + pin * 4;
+        saved = REG_READ(selectReg);
+        REG_WRITE(selectReg, SIG_GPIO_OUT_IDX);
+        clearPin(pin);
+    }
+
+    static inline void reconnect(uint8_t pin, uint32_t saved)
+    {
+        REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + pin * 4, saved);
+    }
+
+    static inline void initLock(Lock &lock)
+    {
+        portMUX_INITIALIZE(&lock);
+    }
+
+    static inline void lock(Lock &lock)
+    {
+        portENTER_CRITICAL(&lock);
+    }
+
+    static inline void unlock(Lock &lock)
+    {
+        portEXIT_CRITICAL(&lock);
+    }
+
+    static inline void IRAM_ATTR lockFromIsr(Lock &lock)
+    {
+        portENTER_CRITICAL_ISR(&lock);
+    }
+
+    static inline void IRAM_ATTR unlockFromIsr(Lock &lock)
+    {
+        portEXIT_CRITICAL_ISR(&lock);
+    }
+
+    static inline void IRAM_ATTR setPin(uint8_t pin)
+    {
+        if (pin < 32)
+            REG_WRITE(GPIO_OUT_W1TS_REG, 1UL << pin);
+        else
+            REG_WRITE(GPIO_OUT1_W1TS_REG, 1UL << (pin - 32));
+    }
+
+    static inline void IRAM_ATTR clearPin(uint8_t pin)
+    {
+        if (pin < 32)
+            REG_WRITE(GPIO_OUT_W1TC_REG, 1UL << pin);
+        else
+            REG_WRITE(GPIO_OUT1_W1TC_REG, 1UL << (pin - 32));
+    }
+};
+
+// On/off drive straight from the GPIO set/clear registers: any non-zero duty is full power.
+// For driver boards with logic-level direction inputs, and as the cheapest write to compare against.
+struct GpioMotorHal : LedcMotorHal
+{
+    static inline void configureOutput(uint8_t pin)
+    {
+        pinMode(pin, OUTPUT);
+        clearPin(pin);
+    }
+
+    // Set, then check for a disconnect() that raced with us on the other core
+    static inline void writeDuty(uint8_t pin, uint8_t duty)
+    {
+        if (duty == 0)
+        {
+            clearPin(pin);
+            return;
+        }
+
+        setPin(pin);
+        __asm__ __volatile__("memw" ::: "memory");
+        if (isBlocked(pin))
+            clearPin(pin);
+    }
+
+    static inline void IRAM_ATTR disconnect(uint8_t pin, uint32_t &saved)
+    {
+        saved = 0;
+        __atomic_fetch_or(&blockedPins()[pin >> 5], 1UL << (pin & 31), __ATOMIC_SEQ_CST);
+        clearPin(pin);
+    }
+
+    static inline void reconnect(uint8_t pin, uint32_t /* saved */)
+    {
+        __atomic_fetch_and(&blockedPins()[pin >> 5], ~(1UL << (pin & 31)), __ATOMIC_SEQ_CST);
+    }
+
+    static inline bool IRAM_ATTR isBlocked(uint8_t pin)
+    {
+        return (__atomic_load_n(&blockedPins()[pin >> 5], __ATOMIC_SEQ_CST) >> (pin & 31)) & 1;
+    }
+
+    static inline uint32_t *IRAM_ATTR blockedPins()
+    {
+        static uint32_t blocked[2] = {};
+        return blocked;
+    }
+};
+#else
+// Host stand-in that records every write, for tests and benchmarks on Linux
+struct MockMotorHal
+{
+    typedef int Lock;
+
+    static const uint8_t PIN_COUNT = 40;
+
+    struct State
+    {
+        uint8_t duty[PIN_COUNT];
+        bool output[PIN_COUNT];
+        bool disconnected[PIN_COUNT];
+        uint8_t reconnectDuty[PIN_COUNT]; // Duty the pin held when it was last reconnected
+        uint32_t writes;
+        uint32_t reconnects;
+    };
+
+    static inline State &state()
+    {
+        static State pins = {};
+        return pins;
+    }
+
+    static inline void reset()
+    {
+        memset(&state(), 0, sizeof(State));
+    }
+
+    // What the motor driver sees on a pin
+    static inline uint8_t pinLevel(uint8_t pin)
+    {
+        return state().disconnected[pin] ? 0 : state().duty[pin];
+    }
+
+    static inline void configureOutput(uint8_t pin)
+    {
+        state().output[pin] = true;
+    }
+
+    static inline void writeDuty(uint8_t pin, uint8_t duty)
+    {
+        state().duty[pin] = duty;
+        state().writes++;
+    }
+
+    static inline void disconnect(uint8_t pin, uint32_t &saved)
+    {
+        saved = 0;
+        state().disconnected[pin] = true;
+    }
+
+    static inline void reconnect(uint8_t pin, uint32_t /* saved */)
+    {
+        state().disconnected[pin] = false;
+        state().reconnectDuty[pin] = state().duty[pin];
+        state().reconnects++;
+    }
+
+    // One thread on the host, nothing to lock
+    static inline void initLock(Lock &) {}
+    static inline void lock(Lock &) {}
+    static inline void unlock(Lock &) {}
+    static inline void lockFromIsr(Lock &) {}
+    static inline void unlockFromIsr(Lock &) {}
+};
+#endif
+
+#endif // MOTOR_HAL_H
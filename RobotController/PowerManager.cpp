@@ -0,0 +1,133 @@
+#include "PowerManager.h"
+#include "Logger.h"
+#include "SerialMux.h"
+#include <esp_sleep.h>
+
+static const char *const POWER_STATE_NAMES[] = {"ACTIVE", "IDLE", "SLEEP"};
+static const uint16_t POWER_STATE_CURRENT[] = {POWER_ACTIVE_CURRENT_DMA, POWER_IDLE_CURRENT_DMA, POWER_SLEEP_CURRENT_DMA};
+
+PowerManager powerManager;
+
+PowerManager::PowerManager()
+{
+    _state = POWER_ACTIVE;
+    _stateStartTime = 0;
+    _lastActivityTime = 0;
+
+    for (uint8_t i = 0; i < 3; i++)
+        _stateTime[i] = 0;
+
+    _lastWakeLatency = 0;
+    _maxWakeLatency = 0;
+}
+
+void PowerManager::begin()
+{
+    setCpuFrequencyMhz(POWER_ACTIVE_CPU_MHZ);
+    _stateStartTime = millis();
+    _lastActivityTime = _stateStartTime;
+}
+
+void PowerManager::update(bool controllerConnected, bool activity)
+{
+    if (activity)
+    {
+        noteActivity();
+        return;
+    }
+
+    unsigned long now = millis();
+    unsigned long idleTime = now - _lastActivityTime;
+
+    if (POWER_LIGHT_SLEEP_ENABLED && !controllerConnected && idleTime > POWER_SLEEP_TIMEOUT_MS)
+    {
+        if (_state != POWER_SLEEP)
+            enterState(POWER_SLEEP, now);
+        takeNap();
+    }
+    else if (idleTime > POWER_IDLE_TIMEOUT_MS)
+    {
+        if (_state != POWER_IDLE)
+            enterState(POWER_IDLE, now);
+        delay(POWER_IDLE_POLL_MS);
+    }
+}
+
+void PowerManager::noteActivity()
+{
+    unsigned long now = millis();
+    _lastActivityTime = now;
+
+    if (_state != POWER_ACTIVE)
+        enterState(POWER_ACTIVE, now);
+}
+
+PowerState PowerManager::getState() const
+{
+    return _state;
+}
+
+void PowerManager::printReport() const
+{
+    unsigned long now = millis();
+    unsigned long stateTime[3];
+    unsigned long totalTime = 0;
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        stateTime[i] = _stateTime[i];
+        if (i == _state)
+            stateTime[i] += now - _stateStartTime;
+        totalTime += stateTime[i];
+    }
+
+    // Time-weighted average of the per-state current estimates
+    uint64_t chargeDmaMs = 0;
+    for (uint8_t i = 0; i < 3; i++)
+        chargeDmaMs += (uint64_t)stateTime[i] * POWER_STATE_CURRENT[i];
+
+    unsigned long averageDma = totalTime > 0 ? chargeDmaMs / totalTime : 0;
+    unsigned long chargeUah = chargeDmaMs / 36000; // 0.1 mA * ms -> uAh
+
+    Print &out = serialMux.console();
+    out.printf("Power: state=%s cpu=%luMHz\n", POWER_STATE_NAMES[_state], (unsigned long)getCpuFrequencyMhz());
+    out.printf("  time active=%lus idle=%lus sleep=%lus\n",
+               stateTime[POWER_ACTIVE] / 1000, stateTime[POWER_IDLE] / 1000, stateTime[POWER_SLEEP] / 1000);
+    out.printf("  est. current avg=%lu.%lumA used=%lu.%03lumAh\n",
+               averageDma / 10, averageDma % 10, chargeUah / 1000, chargeUah % 1000);
+    out.printf("  wake latency last=%luus max=%luus\n", _lastWakeLatency, _maxWakeLatency);
+}
+
+void PowerManager::enterState(PowerState state, unsigned long now)
+{
+    _stateTime[_state] += now - _stateStartTime;
+    _stateStartTime = now;
+    _state = state;
+
+    // Waking up is timed from here until the core runs at full clock again
+    unsigned long switchStart = micros();
+    setCpuFrequencyMhz(state == POWER_ACTIVE ? POWER_ACTIVE_CPU_MHZ : POWER_IDLE_CPU_MHZ);
+    if (state == POWER_ACTIVE)
+        recordWakeLatency(micros() - switchStart);
+
+    LOG_DETAILED("Power state: %s", POWER_STATE_NAMES[state]);
+}
+
+void PowerManager::takeNap()
+{
+    // Sleep on a timer and measure how late we come back
+    unsigned long napStart = micros();
+    esp_sleep_enable_timer_wakeup((uint64_t)POWER_SLEEP_NAP_MS * 1000);
+    esp_light_sleep_start();
+
+    unsigned long napTime = micros() - napStart;
+    unsigned long requested = (unsigned long)POWER_SLEEP_NAP_MS * 1000;
+    recordWakeLatency(napTime > requested ? napTime - requested : 0);
+}
+
+void PowerManager::recordWakeLatency(unsigned long latency)
+{
+    _lastWakeLatency = latency;
+    if (latency > _maxWakeLatency)
+        _maxWakeLatency = latency;
+}
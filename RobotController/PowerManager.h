@@ -0,0 +1,70 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+
+// Power states
+enum PowerState
+{
+    POWER_ACTIVE,
+    POWER_IDLE,
+    POWER_SLEEP
+};
+
+// Default settings
+#define POWER_IDLE_TIMEOUT_MS 30000   // No activity this long -> reduce clock
+#define POWER_SLEEP_TIMEOUT_MS 120000 // No controller this long -> light sleep naps
+#define POWER_ACTIVE_CPU_MHZ 240
+#define POWER_IDLE_CPU_MHZ 80 // Lowest clock the Bluetooth controller supports
+#define POWER_IDLE_POLL_MS 10 // Loop pacing while idle, lets the idle task gate the clock
+#define POWER_SLEEP_NAP_MS 100
+#define POWER_LIGHT_SLEEP_ENABLED false // Needs a BT controller built with modem sleep
+
+// Estimated supply current per state in tenths of mA (ESP32 datasheet, radio on)
+#define POWER_ACTIVE_CURRENT_DMA 950
+#define POWER_IDLE_CURRENT_DMA 450
+#define POWER_SLEEP_CURRENT_DMA 8
+
+class PowerManager
+{
+public:
+    // Constructor
+    PowerManager();
+
+    // Initialize at full clock
+    void begin();
+
+    // Call once per loop pass. Activity is a controller event or a motor command.
+    void update(bool controllerConnected, bool activity);
+
+    // Record activity outside the loop's own check, e.g. a controller report that
+    // leaves the motors alone. Wakes to full clock right away.
+    void noteActivity();
+
+    // Get power state
+    PowerState getState() const;
+
+    // Print time per state, estimated current and wake latency
+    void printReport() const;
+
+private:
+    PowerState _state;
+    unsigned long _stateStartTime;
+    unsigned long _lastActivityTime;
+
+    // Time spent per state (ms), not counting the current one
+    unsigned long _stateTime[3];
+
+    // Wake latency (us) from activity to full clock, or nap overshoot
+    unsigned long _lastWakeLatency;
+    unsigned long _maxWakeLatency;
+
+    // Helper methods
+    void enterState(PowerState state, unsigned long now);
+    void takeNap();
+    void recordWakeLatency(unsigned long latency);
+};
+
+extern PowerManager powerManager;
+
+#endif // POWER_MANAGER_H
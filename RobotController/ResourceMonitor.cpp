@@ -0,0 +1,252 @@
+#include "ResourceMonitor.h"
+#include "Metrics.h"
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#include "SerialMux.h"
+#define RESOURCE_PRINTF serialMux.console().printf
+#else
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define RESOURCE_PRINTF printf
+
+// Host builds have no heap introspection, so count bytes in the global allocator instead.
+// Every replaceable form is covered so nothrow and over-aligned allocations count too.
+static size_t hostHeapInUse = 0;
+static size_t hostHeapPeak = 0;
+static const size_t HOST_HEAP_SIZE = 320 * 1024; // Nominal ESP32 DRAM heap
+
+// The size is kept in the word just before the returned pointer. Over-aligned blocks
+// put a whole alignment unit in front so the pointer keeps its alignment.
+static void *hostAllocate(size_t size, size_t alignment)
+{
+    size_t header = alignment > sizeof(size_t) ? alignment : sizeof(size_t);
+    uint8_t *base;
+    if (alignment > sizeof(size_t))
+        base = (uint8_t *)aligned_alloc(alignment, (size + header + alignment - 1) / alignment * alignment);
+    else
+        base = (uint8_t *)malloc(size + header);
+    if (base == nullptr)
+        return nullptr;
+
+    ((size_t *)(base + header))[-1] = size;
+    hostHeapInUse += size;
+    if (hostHeapInUse > hostHeapPeak)
+        hostHeapPeak = hostHeapInUse;
+    return base + header;
+}
+
+static void hostFree(void *pointer, size_t alignment)
+{
+    if (pointer == nullptr)
+        return;
+
+    size_t header = alignment > sizeof(size_t) ? alignment : sizeof(size_t);
+    hostHeapInUse -= ((size_t *)pointer)[-1];
+    free((uint8_t *)pointer - header);
+}
+
+void *operator new(size_t size)
+{
+    void *pointer = hostAllocate(size, 0);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return hostAllocate(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    void *pointer = hostAllocate(size, (size_t)alignment);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return hostAllocate(size, (size_t)alignment);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    hostFree(pointer, 0);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    hostFree(pointer, 0);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+    hostFree(pointer, 0);
+}
+
+void operator delete(void *pointer, std::align_val_t alignment) noexcept
+{
+    hostFree(pointer, (size_t)alignment);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t alignment) noexcept
+{
+    hostFree(pointer, (size_t)alignment);
+}
+
+void operator delete(void *pointer, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    hostFree(pointer, (size_t)alignment);
+}
+#endif
+
+ResourceMonitor resourceMonitor;
+
+ResourceMonitor::ResourceMonitor()
+{
+    memset(&_snapshot, 0, sizeof(_snapshot));
+    memset(_tasks, 0, sizeof(_tasks));
+    _lastSampleTime = 0;
+    _warned = false;
+}
+
+void ResourceMonitor::update(unsigned long now)
+{
+    if (now - _lastSampleTime < RESOURCE_SAMPLE_PERIOD_MS)
+        return;
+
+    _lastSampleTime = now;
+    sample();
+
+    // Warn once when any task gets close to its stack limit
+    bool low = _snapshot.taskCount > 0 && _snapshot.minStackHighWaterMark < RESOURCE_STACK_WARNING_BYTES;
+    if (low && !_warned)
+    {
+        RESOURCE_PRINTF("WARNING: Task %s has only %u bytes of stack left\n",
+                        _tasks[_snapshot.minStackTask].name, _snapshot.minStackHighWaterMark);
+    }
+    _warned = low;
+}
+
+void ResourceMonitor::sample()
+{
+    sampleHeap();
+    sampleTasks();
+    metrics.set(METRIC_FREE_HEAP, _snapshot.freeHeap);
+}
+
+const ResourceSnapshot &ResourceMonitor::getSnapshot() const
+{
+    return _snapshot;
+}
+
+const TaskStackSample &ResourceMonitor::getTask(uint8_t index) const
+{
+    return _tasks[index];
+}
+
+void ResourceMonitor::printReport() const
+{
+    RESOURCE_PRINTF("Heap: free=%lu min=%lu largest=%lu fragmentation=%u%%\n",
+                    (unsigned long)_snapshot.freeHeap, (unsigned long)_snapshot.minFreeHeap,
+                    (unsigned long)_snapshot.largestFreeBlock, _snapshot.fragmentation);
+
+    for (uint8_t i = 0; i < _snapshot.taskCount; i++)
+    {
+        RESOURCE_PRINTF("  %-16s stack free %lu%s\n", _tasks[i].name, (unsigned long)_tasks[i].stackHighWaterMark,
+                        i == _snapshot.minStackTask ? " (lowest)" : "");
+    }
+    if (_snapshot.taskTotal > _snapshot.taskCount)
+        RESOURCE_PRINTF("  %u more tasks not listed\n", _snapshot.taskTotal - _snapshot.taskCount);
+}
+
+#ifdef ARDUINO
+void ResourceMonitor::sampleHeap()
+{
+    _snapshot.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    _snapshot.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    _snapshot.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    _snapshot.fragmentation = _snapshot.freeHeap > 0 ? 100 - (uint64_t)_snapshot.largestFreeBlock * 100 / _snapshot.freeHeap : 0;
+}
+
+void ResourceMonitor::sampleTasks()
+{
+    // uxTaskGetSystemState() returns nothing at all when the array is too small, so it
+    // is sized from the live task count with some slack for tasks started meanwhile.
+    // Kept across samples and only ever grown, so it doesn't churn the heap or land on
+    // the loop task's stack.
+    static TaskStatus_t *status = nullptr;
+    static UBaseType_t capacity = 0;
+
+    UBaseType_t needed = uxTaskGetNumberOfTasks() + RESOURCE_TASK_SLACK;
+    if (needed > capacity)
+    {
+        TaskStatus_t *grown = (TaskStatus_t *)realloc(status, needed * sizeof(TaskStatus_t));
+        if (grown != nullptr)
+        {
+            status = grown;
+            capacity = needed;
+        }
+    }
+    UBaseType_t count = status != nullptr ? uxTaskGetSystemState(status, capacity, nullptr) : 0;
+
+    _snapshot.taskTotal = min(count > 0 ? count : uxTaskGetNumberOfTasks(), (UBaseType_t)UINT8_MAX);
+    _snapshot.taskCount = min(count, (UBaseType_t)RESOURCE_MAX_TASKS);
+    _snapshot.minStackHighWaterMark = UINT16_MAX;
+    _snapshot.minStackTask = 0;
+    if (count == 0)
+    {
+        RESOURCE_PRINTF("WARNING: Could not list %u tasks, stack report skipped\n", _snapshot.taskTotal);
+        return;
+    }
+
+    // Tasks past the list still count toward the lowest stack
+    UBaseType_t lowest = 0;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        if (status[i].usStackHighWaterMark < status[lowest].usStackHighWaterMark)
+            lowest = i;
+        if (i < RESOURCE_MAX_TASKS)
+            copyTask(i, status[i].pcTaskName, status[i].usStackHighWaterMark);
+    }
+
+    // ...and take the last slot when they have it
+    if (lowest >= RESOURCE_MAX_TASKS)
+    {
+        copyTask(RESOURCE_MAX_TASKS - 1, status[lowest].pcTaskName, status[lowest].usStackHighWaterMark);
+        lowest = RESOURCE_MAX_TASKS - 1;
+    }
+    _snapshot.minStackHighWaterMark = min(_tasks[lowest].stackHighWaterMark, (uint32_t)UINT16_MAX);
+    _snapshot.minStackTask = lowest;
+}
+
+void ResourceMonitor::copyTask(uint8_t index, const char *name, uint32_t stackHighWaterMark)
+{
+    strncpy(_tasks[index].name, name, RESOURCE_TASK_NAME_LENGTH - 1);
+    _tasks[index].name[RESOURCE_TASK_NAME_LENGTH - 1] = '\0';
+
+    // ESP-IDF reports stack high-water marks in bytes
+    _tasks[index].stackHighWaterMark = stackHighWaterMark;
+}
+#else
+void ResourceMonitor::sampleHeap()
+{
+    _snapshot.freeHeap = HOST_HEAP_SIZE - hostHeapInUse;
+    _snapshot.minFreeHeap = HOST_HEAP_SIZE - hostHeapPeak;
+    _snapshot.largestFreeBlock = _snapshot.freeHeap; // No fragmentation model on host
+    _snapshot.fragmentation = 0;
+}
+
+void ResourceMonitor::sampleTasks()
+{
+    _snapshot.taskTotal = 0;
+    _snapshot.taskCount = 0;
+    _snapshot.minStackHighWaterMark = UINT16_MAX;
+    _snapshot.minStackTask = 0;
+}
+#endif
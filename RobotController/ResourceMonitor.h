@@ -0,0 +1,71 @@
+#ifndef RESOURCE_MONITOR_H
+#define RESOURCE_MONITOR_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+// Default settings
+#define RESOURCE_SAMPLE_PERIOD_MS 5000
+#define RESOURCE_MAX_TASKS 24 // Tasks listed, more are still counted and checked
+#define RESOURCE_TASK_SLACK 4 // Status slots over the live count, for tasks started meanwhile
+#define RESOURCE_TASK_NAME_LENGTH 16
+#define RESOURCE_STACK_WARNING_BYTES 512 // Warn when a task gets this close to overflow
+
+// Per-task stack usage
+struct TaskStackSample
+{
+    char name[RESOURCE_TASK_NAME_LENGTH];
+    uint32_t stackHighWaterMark; // Bytes never used since the task started
+};
+
+// Latest memory figures, small enough to send as telemetry
+struct ResourceSnapshot
+{
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestFreeBlock;
+    uint8_t fragmentation; // Percent of free heap outside the largest block
+    uint8_t taskCount; // Tasks listed
+    uint8_t taskTotal; // Tasks running, more than taskCount past RESOURCE_MAX_TASKS
+    uint16_t minStackHighWaterMark;
+    uint8_t minStackTask; // Index into the task list
+};
+
+class ResourceMonitor
+{
+public:
+    // Constructor
+    ResourceMonitor();
+
+    // Call once per loop pass, samples every RESOURCE_SAMPLE_PERIOD_MS
+    void update(unsigned long now);
+
+    // Take a sample right away
+    void sample();
+
+    // Get the latest sample
+    const ResourceSnapshot &getSnapshot() const;
+    const TaskStackSample &getTask(uint8_t index) const;
+
+    // Print heap figures and every task's stack high-water mark
+    void printReport() const;
+
+private:
+    ResourceSnapshot _snapshot;
+    TaskStackSample _tasks[RESOURCE_MAX_TASKS];
+    unsigned long _lastSampleTime;
+    bool _warned;
+
+    // Helper methods
+    void sampleHeap();
+    void sampleTasks();
+    void copyTask(uint8_t index, const char *name, uint32_t stackHighWaterMark);
+};
+
+extern ResourceMonitor resourceMonitor;
+
+#endif // RESOURCE_MONITOR_H
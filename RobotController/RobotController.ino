@@ -1,6 +1,30 @@
 #include <Bluepad32.h>
 #include <Preferences.h>
+#include "TankConfig.h"
 #include "TankMotors.h"
+#include "PowerManager.h"
+#include "SerialCommands.h"
+#include "Watchdog.h"
+#include "HardwareFailsafe.h"
+#include "ResourceMonitor.h"
+#include "Logger.h"
+#include "FirmwareUpdate.h"
+#include "FleetTelemetry.h"
+#include "ClockSync.h"
+#include "ChoreographyPlayer.h"
+#include "LoopProfiler.h"
+#include "GamepadSnapshot.h"
+#include "InputCoalescer.h"
+#include "InputPredictor.h"
+#include "Imu.h"
+#include "YawRateController.h"
+#include "TractionControl.h"
+#include "ImuTask.h"
+#include "SerialMux.h"
+#include "UartTx.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "SamplingProfiler.h"
 
 /**
  * ROBOT CONTROLLER
@@ -14,24 +38,56 @@ Preferences preferences;
 // This will store the single controller that can connect to the system
 ControllerPtr connectedController = nullptr;
 
-// Pin definitions
-#define LEFT_FORWARD_PIN 33
-#define LEFT_BACKWARD_PIN 32
-#define RIGHT_FORWARD_PIN 25
-#define RIGHT_BACKWARD_PIN 26
+// Fleet status broadcast over ESP-NOW; id 0 = off, FLEET_BASE_ID = base node
+uint8_t fleetId = 0;
 
-// Create a global instance of the TankMotors class
-TankMotors motors(LEFT_FORWARD_PIN, LEFT_BACKWARD_PIN, RIGHT_FORWARD_PIN, RIGHT_BACKWARD_PIN);
+// Show mode: scripts played in lockstep against the base node's clock
+uint32_t showStart = 0; // Shared time (ms) of the current show, 0 = none
+uint8_t showScriptId = 0;
 
-// Button debounce settings
-#define DEBOUNCE_DELAY 300
-unsigned long lastButtonPressTime = 0;
+// Wired joystick on the framed serial link (tools/serial_joystick.py). While its reports
+// keep coming they drive the tank and Bluetooth reports are ignored.
+#define SERIAL_GAMEPAD_HOLD_MS 500
+bool serialGamepadActive = false;
+unsigned long serialGamepadTime = 0;
+
+// Optional extrapolation between reports, driven at a fixed control rate
+bool inputPrediction = false;
+
+// Gyro-based steering: the turn command asks for a yaw rate, saved in preferences
+bool imuReady = false;
+bool yawControl = false;
+
+// Cuts a spinning track's power using the same IMU, saved in preferences
+bool tractionControlOn = false;
+int16_t requestedLeftPower = 0; // What the driver or the yaw loop asked for, before the cut
+int16_t requestedRightPower = 0;
+
+// Motor telemetry rate on the framed serial link
+#define MOTOR_TELEMETRY_INTERVAL_MS 20
+
+// How the gamepad drives the tank, saved in preferences
+enum DriveMode
+{
+    DRIVE_MODE_DUAL_STICK, // Each stick's Y axis drives one track
+    DRIVE_MODE_TRIGGERS    // R2 speed, L2 brake, left stick steers
+};
+DriveMode driveMode = DRIVE_MODE_DUAL_STICK;
 
-// Joystick settings
-#define JOYSTICK_DEAD_ZONE 20
+// Last calibration button press, for debouncing
+unsigned long lastButtonPressTime = 0;
 
-// Calibration step size
-#define CALIBRATION_STEP 0.05f
+/**
+ * Stop both motors and drop any command the control loops are still following
+ */
+void stopMotors()
+{
+    yawController.reset();
+    tractionControl.reset();
+    requestedLeftPower = 0;
+    requestedRightPower = 0;
+    motors.stop();
+}
 
 /**
  * This function is called when a new controller connects
@@ -40,16 +96,18 @@ void onConnectedController(ControllerPtr controller)
 {
     if (connectedController != nullptr)
     {
-        Serial.println("New controller ignored - only one controller allowed");
+        LOG_BASIC("New controller ignored - only one controller allowed");
         return;
     }
 
     connectedController = controller;
-    Serial.println("Controller connected!");
+    inputPredictor.reset();
+    metrics.set(METRIC_CONTROLLER_CONNECTED, 1);
+    LOG_BASIC("Controller connected!");
 
     ControllerProperties properties = controller->getProperties();
-    Serial.printf("Controller model: %s, VID=0x%04x, PID=0x%04x\n",
-                  controller->getModelName().c_str(), properties.vendor_id, properties.product_id);
+    LOG_DETAILED("Controller model: %s, VID=0x%04x, PID=0x%04x",
+                 controller->getModelName().c_str(), properties.vendor_id, properties.product_id);
 }
 
 /**
@@ -59,122 +117,1023 @@ void onDisconnectedController(ControllerPtr controller)
 {
     if (connectedController == controller)
     {
-        Serial.println("Controller disconnected");
+        LOG_BASIC("Controller disconnected");
         connectedController = nullptr;
+        metrics.set(METRIC_CONTROLLER_CONNECTED, 0);
 
         // Stop the motors for safety when controller disconnects
-        motors.stop();
+        stopMotors();
     }
 }
 
 /**
- * Handle movement controls (joysticks)
+ * Motor power with the direction as its sign
  */
-void handleMovement(ControllerPtr controller)
+int16_t signedPower(MotorDirection direction, uint8_t power)
 {
-    // Only Dual Stick mode is supported now
+    if (direction == MOTOR_BACKWARD)
+        return -power;
+    return direction == MOTOR_FORWARD ? power : 0;
+}
 
-    // Dual stick mode - each joystick controls one motor
-    int16_t leftJoystickY = controller->axisY();
-    int16_t rightJoystickY = controller->axisRY();
+/**
+ * Apply signed power to both motors as it is (-255..255, negative is backward)
+ */
+void applyMotorPower(int leftPower, int rightPower)
+{
+    if (leftPower > 0)
+        motors.leftForward(leftPower);
+    else if (leftPower < 0)
+        motors.leftBackward(-leftPower);
+    else
+        motors.leftStop();
 
-    // Apply dead zone
-    if (abs(leftJoystickY) < JOYSTICK_DEAD_ZONE)
-        leftJoystickY = 0;
-    if (abs(rightJoystickY) < JOYSTICK_DEAD_ZONE)
-        rightJoystickY = 0;
+    if (rightPower > 0)
+        motors.rightForward(rightPower);
+    else if (rightPower < 0)
+        motors.rightBackward(-rightPower);
+    else
+        motors.rightStop();
+}
 
-    // Constrain joystick values
-    leftJoystickY = constrain(leftJoystickY, -512, 512);
-    rightJoystickY = constrain(rightJoystickY, -512, 512);
+/**
+ * Drive both motors from signed power (-255..255, negative is backward), less whatever
+ * traction control has cut from a spinning track and the tilt guard from a tipping tank
+ */
+void driveMotors(int leftPower, int rightPower)
+{
+    requestedLeftPower = leftPower;
+    requestedRightPower = rightPower;
+    if (tractionControlOn && imuReady)
+    {
+        leftPower = tractionControl.limitLeft(leftPower);
+        rightPower = tractionControl.limitRight(rightPower);
+    }
+    leftPower = tiltGuard.limitPower(leftPower);
+    rightPower = tiltGuard.limitPower(rightPower);
+    applyMotorPower(leftPower, rightPower);
+}
 
-    // Map joystick values to motor power
-    int leftMotorPower = map(abs(leftJoystickY), 0, 512, 0, 255);
-    int rightMotorPower = map(abs(rightJoystickY), 0, 512, 0, 255);
+/**
+ * Dual stick mode: each joystick controls one motor
+ */
+void dualStickPower(const GamepadSnapshot &gamepad, int &leftMotorPower, int &rightMotorPower)
+{
+    int16_t leftJoystickY = gamepad.axisY;
+    int16_t rightJoystickY = gamepad.axisRY;
+    metrics.observe(METRIC_STICK_LEFT_Y, leftJoystickY);
+    metrics.observe(METRIC_STICK_RIGHT_Y, rightJoystickY);
 
-    // Apply motor direction based on joystick position
-    if (leftJoystickY > 0)
-        motors.leftForward(leftMotorPower);
-    else if (leftJoystickY < 0)
-        motors.leftBackward(leftMotorPower);
-    else
-        motors.leftStop();
+    // Readings inside the dead zone or past the end of the range
+    if (leftJoystickY != 0 && abs(leftJoystickY) < TANK_CONFIG.stickDeadZone)
+        metrics.count(METRIC_CONTROLLER_DEAD_ZONE);
+    if (rightJoystickY != 0 && abs(rightJoystickY) < TANK_CONFIG.stickDeadZone)
+        metrics.count(METRIC_CONTROLLER_DEAD_ZONE);
+    if (abs(leftJoystickY) > TANK_CONFIG.stickMax || abs(rightJoystickY) > TANK_CONFIG.stickMax)
+        metrics.count(METRIC_MOTOR_CLAMPS);
+
+    // Dead zone, range and response curve are all in the lookup table
+    leftMotorPower = stickToPower(leftJoystickY);
+    rightMotorPower = stickToPower(rightJoystickY);
+    if (leftJoystickY < 0)
+        leftMotorPower = -leftMotorPower;
+    if (rightJoystickY < 0)
+        rightMotorPower = -rightMotorPower;
+}
+
+/**
+ * Trigger mode: R2 sets the speed and the left stick steers, pulling it back reverses.
+ * Powers have the same sign as in dualStickPower(): Bluepad32 reads a stick pushed up as
+ * negative, which gives its track negative power and drives the tank forward.
+ */
+void triggerPower(const GamepadSnapshot &gamepad, int &leftMotorPower, int &rightMotorPower)
+{
+    int speed = triggerToPower(gamepad.throttle);
+    if (gamepad.axisY > TANK_CONFIG.stickMax / 2)
+        speed = -speed;
+
+    // Left is negative on the stick, so the left track slows down and the right speeds up
+    int turn = stickToPower(gamepad.axisX);
+    if (gamepad.axisX < 0)
+        turn = -turn;
 
-    if (rightJoystickY > 0)
-        motors.rightForward(rightMotorPower);
-    else if (rightJoystickY < 0)
-        motors.rightBackward(rightMotorPower);
+    // Forward speed to power: negative, like both sticks pushed up
+    leftMotorPower = -constrain(speed + turn, -255, 255);
+    rightMotorPower = -constrain(speed - turn, -255, 255);
+    if (abs(speed + turn) > 255 || abs(speed - turn) > 255)
+        metrics.count(METRIC_MOTOR_CLAMPS);
+}
+
+/**
+ * Handle movement controls (joysticks and triggers)
+ */
+void handleMovement(const GamepadSnapshot &gamepad)
+{
+    int leftMotorPower;
+    int rightMotorPower;
+    uint8_t brakeStrength = 0;
+    if (driveMode == DRIVE_MODE_TRIGGERS)
+    {
+        // Any L2 brakes both tracks, whatever R2 and the stick say
+        brakeStrength = triggerToPower(gamepad.brake);
+        triggerPower(gamepad, leftMotorPower, rightMotorPower);
+        if (brakeStrength != 0)
+            leftMotorPower = rightMotorPower = 0;
+    }
     else
-        motors.rightStop();
+    {
+        dualStickPower(gamepad, leftMotorPower, rightMotorPower);
+    }
+
+    // Smoothness: how far either motor jumps from the last setpoint
+    static int lastLeftPower = 0;
+    static int lastRightPower = 0;
+    metrics.observe(METRIC_SETPOINT_STEP, max(abs(leftMotorPower - lastLeftPower), abs(rightMotorPower - lastRightPower)));
+    lastLeftPower = leftMotorPower;
+    lastRightPower = rightMotorPower;
+
+    // Tell the hardware failsafe a fresh setpoint is about to be applied
+    hardwareFailsafe.acceptSetpoint(leftMotorPower != 0 || rightMotorPower != 0);
+
+    if (brakeStrength != 0)
+    {
+        metrics.count(METRIC_MOTOR_BRAKES);
+        yawController.reset();
+        tractionControl.reset();
+        requestedLeftPower = 0;
+        requestedRightPower = 0;
+        motors.brake(brakeStrength);
+        return;
+    }
+
+    // With gyro steering the control tick drives the motors from this command
+    if (yawControl && imuReady)
+    {
+        yawController.setCommand((leftMotorPower + rightMotorPower) / 2, (leftMotorPower - rightMotorPower) / 2);
+        return;
+    }
+
+    // Apply motor direction based on joystick position
+    driveMotors(leftMotorPower, rightMotorPower);
 }
 
 /**
  * Handle calibration buttons
  */
-void handleCalibrationButtons(ControllerPtr controller)
+void handleCalibrationButtons(const GamepadSnapshot &gamepad)
 {
-    if (millis() - lastButtonPressTime <= DEBOUNCE_DELAY)
+    if (millis() - lastButtonPressTime <= TANK_CONFIG.debounceMs)
         return;
 
     bool calibrationChanged = false;
 
     // A button - Decrease right motor calibration
-    if (controller->a())
+    if (gamepad.a())
     {
-        float newCalibration = constrain(motors.getRightCalibration() - CALIBRATION_STEP, 0.0, 1.0);
+        float newCalibration = constrain(motors.getRightCalibration() - TANK_CONFIG.calibrationStep, 0.0, 1.0);
         motors.setRightCalibration(newCalibration);
+        watchdog.startWrite();
         preferences.putFloat("rightCal", newCalibration);
+        watchdog.finishWrite();
         calibrationChanged = true;
     }
 
     // Y button - Increase right motor calibration
-    if (controller->y())
+    if (gamepad.y())
     {
-        float newCalibration = constrain(motors.getRightCalibration() + CALIBRATION_STEP, 0.0, 1.0);
+        float newCalibration = constrain(motors.getRightCalibration() + TANK_CONFIG.calibrationStep, 0.0, 1.0);
         motors.setRightCalibration(newCalibration);
+        watchdog.startWrite();
         preferences.putFloat("rightCal", newCalibration);
+        watchdog.finishWrite();
         calibrationChanged = true;
     }
 
     // D-pad UP - Increase left motor calibration
-    if (controller->dpad() == DPAD_UP)
+    if (gamepad.dpad == GAMEPAD_DPAD_UP)
     {
-        float newCalibration = constrain(motors.getLeftCalibration() + CALIBRATION_STEP, 0.0, 1.0);
+        float newCalibration = constrain(motors.getLeftCalibration() + TANK_CONFIG.calibrationStep, 0.0, 1.0);
         motors.setLeftCalibration(newCalibration);
+        watchdog.startWrite();
         preferences.putFloat("leftCal", newCalibration);
+        watchdog.finishWrite();
         calibrationChanged = true;
     }
 
     // D-pad DOWN - Decrease left motor calibration
-    if (controller->dpad() == DPAD_DOWN)
+    if (gamepad.dpad == GAMEPAD_DPAD_DOWN)
     {
-        float newCalibration = constrain(motors.getLeftCalibration() - CALIBRATION_STEP, 0.0, 1.0);
+        float newCalibration = constrain(motors.getLeftCalibration() - TANK_CONFIG.calibrationStep, 0.0, 1.0);
         motors.setLeftCalibration(newCalibration);
+        watchdog.startWrite();
         preferences.putFloat("leftCal", newCalibration);
+        watchdog.finishWrite();
         calibrationChanged = true;
     }
 
     if (calibrationChanged)
+    {
         lastButtonPressTime = millis();
+        metrics.count(METRIC_CALIBRATION_CHANGES);
+    }
 }
 
 /**
- * This function processes the connected controller
+ * Input stage: copy a new report from the controller into the coalescer
  */
-void processController()
+void pollController()
 {
+    if (serialGamepadActive && millis() - serialGamepadTime < SERIAL_GAMEPAD_HOLD_MS)
+        return;
+
     if (connectedController && connectedController->isConnected() && connectedController->hasData())
     {
         if (connectedController->isGamepad())
         {
-            handleMovement(connectedController);
-            handleCalibrationButtons(connectedController);
+            // Read the controller once, every handler works from the copy
+            GamepadSnapshot gamepad;
+            captureGamepad(connectedController, gamepad);
+            inputCoalescer.publish(gamepad, INPUT_SOURCE_BLUETOOTH, micros());
+        }
+        else
+        {
+            LOG_BASIC("Unsupported controller type");
+        }
+    }
+}
+
+/**
+ * Input stage for the wired joystick: called by the serial mux for each GAMEPAD message.
+ * Runs in the loop task like pollController(), so the coalescer keeps a single producer.
+ */
+void receiveSerialGamepad(const uint8_t *data, size_t length)
+{
+    GamepadSnapshot gamepad;
+    if (length != sizeof(gamepad) || data[offsetof(GamepadSnapshot, reserved)] != 0)
+    {
+        metrics.count(METRIC_SERIAL_GAMEPAD_REJECTED);
+        return;
+    }
+
+    memcpy(&gamepad, data, sizeof(gamepad));
+    metrics.count(METRIC_SERIAL_GAMEPAD_FRAMES);
+    if (!serialGamepadActive)
+        LOG_BASIC("Wired joystick connected");
+    serialGamepadActive = true;
+    serialGamepadTime = millis();
+    inputCoalescer.publish(gamepad, INPUT_SOURCE_SERIAL, micros());
+}
+
+/**
+ * Between reports: move the motors along the extrapolated sticks at the control rate.
+ * Only runs within INPUT_PREDICTOR_HORIZON_US of a real report, so it can't keep the
+ * failsafes fed once reports stop. Past the horizon the motors go back to the last real
+ * report rather than hold the guess. Takes and returns whether the motors follow an
+ * extrapolated report.
+ */
+bool extrapolateController(bool extrapolated)
+{
+    static uint32_t lastTickUs = 0;
+    uint32_t now = micros();
+    if (now - lastTickUs < INPUT_PREDICTOR_PERIOD_US)
+        return extrapolated;
+    lastTickUs = now;
+
+    static GamepadSnapshot lastPredicted = {};
+    GamepadSnapshot predicted;
+    if (!inputPredictor.predict(now, predicted))
+    {
+        // predicted now holds the last real report
+        if (extrapolated)
+        {
+            lastPredicted = predicted;
+            handleMovement(predicted);
+        }
+        return false;
+    }
+    if (predicted == lastPredicted)
+        return extrapolated;
+
+    lastPredicted = predicted;
+    metrics.count(METRIC_INPUT_PREDICTED);
+    handleMovement(predicted);
+    return true;
+}
+
+/**
+ * IMU control tick: one gyro and accelerometer reading shared by yaw-rate steering, which
+ * steers the tracks so the gyro sees the turn rate the driver asked for, and traction
+ * control, which cuts power to a track that spins
+ */
+void processImuControl()
+{
+    static uint32_t lastTickUs = 0;
+    bool traction = tractionControlOn && imuReady;
+    uint32_t now = micros();
+    if ((!yawController.hasCommand() && !traction) || now - lastTickUs < YAW_CONTROL_PERIOD_US)
+        return;
+    lastTickUs = now;
+
+    // The IMU task counts failed reads, here a sample that is too old is just as bad
+    ImuReading reading;
+    if (!imuTask.getLatest(reading) || (int32_t)(now - reading.timeUs) > IMU_TASK_STALE_US)
+    {
+        if (yawController.hasCommand())
+        {
+            // Without the gyro, stop rather than steer blind
+            LOG_BASIC("No IMU samples, stopping motors");
+            stopMotors();
+        }
+        else if (tractionControl.getLeftLimit() < 256 || tractionControl.getRightLimit() < 256)
+        {
+            // Without the accelerometer, give the driver full power back
+            tractionControl.reset();
+            driveMotors(requestedLeftPower, requestedRightPower);
+        }
+        return;
+    }
+
+    int16_t yawRate = TANK_CONFIG.imuYawSign * reading.gyro[IMU_Z];
+    bool limitsChanged = false;
+    if (traction)
+        limitsChanged = tractionControl.update(signedPower(motors.getLeftDirection(), motors.getLeftPower()),
+                                               signedPower(motors.getRightDirection(), motors.getRightPower()),
+                                               reading, yawRate);
+
+    if (yawController.hasCommand())
+    {
+        int16_t leftPower;
+        int16_t rightPower;
+        yawController.update(yawRate, leftPower, rightPower);
+        metrics.observe(METRIC_YAW_ERROR, abs(yawController.getReferenceRate() - yawRate) * 10 / IMU_GYRO_LSB_PER_DPS_X10);
+        driveMotors(leftPower, rightPower);
+    }
+    else if (limitsChanged && (requestedLeftPower != 0 || requestedRightPower != 0))
+        driveMotors(requestedLeftPower, requestedRightPower);
+}
+
+/**
+ * Tilt protection: the IMU task cuts the outputs itself, here the command that was driving
+ * is dropped and the tracks follow the guard's power cap
+ */
+void processTiltGuard()
+{
+    if (!imuReady)
+        return;
+
+    if (tiltGuard.update(micros()))
+    {
+        if (tiltGuard.isTripped())
+            LOG_BASIC("Tilted over or IMU lost (pitch %d, roll %d), motors cut",
+                      (int)tiltGuard.getPitch(), (int)tiltGuard.getRoll());
+        else
+            LOG_BASIC("Tilt guard cleared, motors back (stopped)");
+        stopMotors();
+        return;
+    }
+
+    static uint16_t appliedLimit = 256;
+    uint16_t limit = tiltGuard.getPowerLimit();
+    if (limit != appliedLimit)
+    {
+        appliedLimit = limit;
+        if (requestedLeftPower != 0 || requestedRightPower != 0)
+            driveMotors(requestedLeftPower, requestedRightPower);
+    }
+}
+
+/**
+ * Motor tick: act on the latest controller report, if a new one arrived
+ */
+void processController()
+{
+    // Set when the motors follow an extrapolated report rather than a real one
+    static bool extrapolated = false;
+
+    GamepadSnapshot gamepad;
+    uint32_t arrivalUs;
+    InputSource source;
+    if (!inputCoalescer.take(gamepad, arrivalUs, source))
+    {
+        if (inputPrediction && !choreography.isPlaying())
+            extrapolated = extrapolateController(extrapolated);
+        return;
+    }
+
+    static GamepadSnapshot lastGamepad = {};
+    static uint32_t lastArrivalUs = 0;
+    metrics.count(METRIC_CONTROLLER_REPORTS);
+    metrics.observe(METRIC_INPUT_AGE, micros() - arrivalUs);
+    if (inputCoalescer.getTaken() > 1)
+        metrics.observe(METRIC_CONTROLLER_INTERVAL, (arrivalUs - lastArrivalUs) / 1000);
+    lastArrivalUs = arrivalUs;
+    if (inputPrediction)
+        inputPredictor.addReport(gamepad, arrivalUs);
+
+    // Any change wakes the CPU, button presses and dead-zone sticks too. A controller
+    // that resends the same report while parked doesn't keep it at full clock.
+    if (gamepad != lastGamepad)
+        powerManager.noteActivity();
+
+    // A running show owns the motors. A report that matches the last one
+    // leaves the motors as they are, it only counts as a fresh setpoint.
+    if (!choreography.isPlaying())
+    {
+        if (gamepad != lastGamepad || extrapolated)
+        {
+            extrapolated = false;
+            handleMovement(gamepad);
         }
         else
         {
-            Serial.println("Unsupported controller type");
+            metrics.count(METRIC_CONTROLLER_UNCHANGED);
+            hardwareFailsafe.acceptSetpoint(signedPower(motors.getLeftDirection(), motors.getLeftPower()) != 0 ||
+                                            signedPower(motors.getRightDirection(), motors.getRightPower()) != 0);
         }
     }
+
+    // Held buttons repeat, so these run on every report
+    handleCalibrationButtons(gamepad);
+    lastGamepad = gamepad;
+}
+
+/**
+ * Serial command: print power statistics
+ */
+void commandPower(const char *args)
+{
+    powerManager.printReport();
+}
+
+/**
+ * Serial command: print watchdog state and reset cause
+ */
+void commandWatchdog(const char *args)
+{
+    Print &out = serialMux.console();
+
+    watchdog.printReport();
+    out.printf("Hardware failsafe: %s, trips=%lu\n",
+               hardwareFailsafe.isTripped() ? "TRIPPED" : "ok", (unsigned long)hardwareFailsafe.getTripCount());
+}
+
+/**
+ * Serial command: print heap and stack usage
+ */
+void commandMemory(const char *args)
+{
+    resourceMonitor.sample();
+    resourceMonitor.printReport();
+}
+
+/**
+ * Serial command: dump all metrics (see tools/metrics_prom.py), 'metrics reset' clears min/max
+ */
+void commandMetrics(const char *args)
+{
+    if (strcmp(args, "reset") == 0)
+        metrics.resetMinMax();
+    metrics.dump(millis());
+}
+
+/**
+ * Serial command: show or set the debug level (0 = none ... 3 = verbose)
+ */
+void commandLog(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (*args != '\0')
+        logger.setLevel((LogLevel)constrain(atoi(args), LOG_LEVEL_NONE, LOG_LEVEL_VERBOSE));
+
+    out.printf("Log level: %d (compiled up to %d)\n", logger.getLevel(), LOG_MAX_LEVEL);
+}
+
+/**
+ * Serial command: show or choose the drive mode
+ */
+void commandDrive(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "dual") == 0 || strcmp(args, "triggers") == 0)
+    {
+        driveMode = args[0] == 't' ? DRIVE_MODE_TRIGGERS : DRIVE_MODE_DUAL_STICK;
+        watchdog.startWrite();
+        preferences.putUChar("driveMode", driveMode);
+        watchdog.finishWrite();
+        stopMotors();
+    }
+
+    out.printf("Drive mode: %s\n", driveMode == DRIVE_MODE_TRIGGERS ? "triggers (R2 speed, L2 brake, left stick steers)"
+                                                                     : "dual (each stick drives one track)");
+}
+
+/**
+ * Serial command: turn tilt protection on or off, or show the angles and how fast it cut
+ */
+void commandTilt(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "on") == 0 || strcmp(args, "off") == 0)
+    {
+        tiltGuard.setEnabled(args[1] == 'n');
+        watchdog.startWrite();
+        preferences.putBool("tilt", tiltGuard.isEnabled());
+        watchdog.finishWrite();
+    }
+
+    out.printf("Tilt protection %s, IMU %s, %s\n", tiltGuard.isEnabled() ? "on" : "off",
+               imuReady ? "ready" : "not found", tiltGuard.isTripped() ? "TRIPPED" : "ok");
+#if TANK_SIZE_OPTIMIZED
+    // Keep float formatting out of the size-optimized build: angles in whole tenths
+    int pitch = lroundf(tiltGuard.getPitch() * 10);
+    int roll = lroundf(tiltGuard.getRoll() * 10);
+    out.printf("Pitch %s%d.%d (cut at %d), roll %s%d.%d (cut at %d), power %d%%\n", pitch < 0 ? "-" : "",
+               abs(pitch) / 10, abs(pitch) % 10, TILT_CUT_PITCH_DEG, roll < 0 ? "-" : "", abs(roll) / 10, abs(roll) % 10,
+               TILT_CUT_ROLL_DEG, tiltGuard.getPowerLimit() * 100 / 256);
+#else
+    out.printf("Pitch %.1f (cut at %d), roll %.1f (cut at %d), power %d%%\n", tiltGuard.getPitch(),
+               TILT_CUT_PITCH_DEG, tiltGuard.getRoll(), TILT_CUT_ROLL_DEG, tiltGuard.getPowerLimit() * 100 / 256);
+#endif
+    out.printf("Trips %lu, cut latency last %luus, max %luus (budget %dus, %dus of it in the sensor)\n",
+               (unsigned long)tiltGuard.getTripCount(), (unsigned long)tiltGuard.getLastCutLatencyUs(),
+               (unsigned long)tiltGuard.getMaxCutLatencyUs(), TILT_MAX_CUT_LATENCY_US, IMU_FILTER_DELAY_US);
+    out.printf("IMU samples %lu, errors %lu\n", (unsigned long)imuTask.getSamples(), (unsigned long)imuTask.getErrors());
+}
+
+/**
+ * Serial command: turn traction control on or off, or show how much it has cut
+ */
+void commandTraction(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "on") == 0 || strcmp(args, "off") == 0)
+    {
+        tractionControlOn = args[1] == 'n';
+        watchdog.startWrite();
+        preferences.putBool("traction", tractionControlOn);
+        watchdog.finishWrite();
+        stopMotors();
+    }
+
+    out.printf("Traction control %s, IMU %s\n", tractionControlOn ? "on" : "off", imuReady ? "ready" : "not found");
+    out.printf("Left %d%% power, %lu slips; right %d%% power, %lu slips\n",
+               tractionControl.getLeftLimit() * 100 / 256, (unsigned long)tractionControl.getLeftSlips(),
+               tractionControl.getRightLimit() * 100 / 256, (unsigned long)tractionControl.getRightSlips());
+}
+
+/**
+ * Serial command: turn gyro steering on or off, or show how it is tracking
+ */
+void commandYaw(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "on") == 0 || strcmp(args, "off") == 0)
+    {
+        yawControl = args[1] == 'n';
+        watchdog.startWrite();
+        preferences.putBool("yawControl", yawControl);
+        watchdog.finishWrite();
+        stopMotors();
+    }
+
+    out.printf("Yaw-rate steering %s, IMU %s\n", yawControl ? "on" : "off", imuReady ? "ready" : "not found");
+    out.printf("Target %ddps, expected %ddps, measured %ddps, integral %ld\n",
+               (int)(yawController.getTargetRate() * 10 / IMU_GYRO_LSB_PER_DPS_X10),
+               (int)(yawController.getReferenceRate() * 10 / IMU_GYRO_LSB_PER_DPS_X10),
+               (int)(yawController.getLastRate() * 10 / IMU_GYRO_LSB_PER_DPS_X10), (long)yawController.getIntegral());
+}
+
+/**
+ * Serial command: turn input extrapolation on or off
+ */
+void commandPredict(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "on") == 0 || strcmp(args, "off") == 0)
+    {
+        inputPrediction = args[1] == 'n';
+        inputPredictor.reset();
+        watchdog.startWrite();
+        preferences.putBool("predict", inputPrediction);
+        watchdog.finishWrite();
+    }
+
+    out.printf("Input prediction %s (%dms horizon, %dHz control rate)\n", inputPrediction ? "on" : "off",
+               INPUT_PREDICTOR_HORIZON_US / 1000, 1000000 / INPUT_PREDICTOR_PERIOD_US);
+}
+
+/**
+ * Serial command: fleet table on the base node, or this tank's fleet settings
+ */
+void commandFleet(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strncmp(args, "id ", 3) == 0 || strcmp(args, "base") == 0)
+    {
+        fleetId = args[0] == 'b' ? FLEET_BASE_ID : constrain(atoi(args + 3), 0, FLEET_BASE_ID - 1);
+        watchdog.startWrite();
+        preferences.putUChar("fleetId", fleetId);
+        watchdog.finishWrite();
+        out.println("Fleet id saved, restart to apply");
+        return;
+    }
+
+    if (fleetId != FLEET_BASE_ID)
+    {
+        out.printf("Fleet id %u, frames sent=%lu errors=%lu\n", fleetId,
+                   (unsigned long)fleetTelemetry.getFramesSent(), (unsigned long)fleetTelemetry.getSendErrors());
+        return;
+    }
+
+    unsigned long now = millis();
+    out.println(" id  online  left right  batt   rate  age  heap  rssi  lost");
+    for (uint8_t i = 0; i < fleetAggregator.getTankCount(); i++)
+    {
+        const FleetAggregator::Entry *entry = fleetAggregator.getTank(i);
+        const FleetStatus &status = entry->status;
+        out.printf("%3u  %-6s  %4d  %4d  %4umV %3uHz %3ums %3uk %4d  %4lu\n", status.tankId,
+                   fleetAggregator.isOnline(*entry, now) ? "yes" : "no", status.leftPower, status.rightPower,
+                   status.batteryMv, status.reportRate, status.reportAge, status.freeHeapKb, entry->rssi,
+                   (unsigned long)entry->framesLost);
+    }
+}
+
+/**
+ * Handle a clock beacon: track the base clock and start or stop the show
+ */
+void handleBeacon(const ClockBeacon &beacon, uint64_t receivedAt)
+{
+    clockSync.handleBeacon(beacon.baseTime, receivedAt);
+
+    if (beacon.showStart == showStart)
+        return;
+
+    showStart = beacon.showStart;
+    const ChoreographyScript *script = findChoreographyScript(beacon.scriptId);
+    if (showStart != 0 && script != nullptr)
+    {
+        yawController.reset();
+        choreography.start(script, showStart);
+        LOG_BASIC("Show armed: script %u", beacon.scriptId);
+    }
+    else if (choreography.isPlaying())
+    {
+        choreography.stop();
+        stopMotors();
+        LOG_BASIC("Show stopped");
+    }
+}
+
+/**
+ * Play the armed show against the shared clock
+ */
+void processShow()
+{
+    uint64_t localTime = fleetTransport.now();
+
+    // Without the base clock we can't stay in step, so stop rather than drift
+    if (!clockSync.isSynced(localTime))
+    {
+        choreography.stop();
+        stopMotors();
+        LOG_BASIC("Show stopped: lost the base clock");
+        return;
+    }
+
+    int16_t left, right;
+    uint32_t sharedTime = clockSync.toShared(localTime) / 1000;
+    if (choreography.update(sharedTime, left, right))
+    {
+        hardwareFailsafe.acceptSetpoint(left != 0 || right != 0);
+        driveMotors(left, right);
+    }
+}
+
+/**
+ * Receive fleet frames: status on the base node, clock beacons on the tanks
+ */
+void receiveFleetFrames()
+{
+    uint8_t frame[FLEET_MAX_FRAME];
+    FleetFrameInfo info;
+    size_t length;
+
+    while ((length = fleetTransport.receive(frame, sizeof(frame), info)) > 0)
+    {
+        ClockBeacon beacon;
+        if (fleetId == FLEET_BASE_ID)
+            fleetAggregator.handleFrame(frame, length, info.rssi, millis());
+        else if (unpackClockBeacon(frame, length, beacon))
+            handleBeacon(beacon, info.receivedAt);
+    }
+}
+
+/**
+ * Broadcast this tank's status, or collect everyone's and send clock beacons on the base node
+ */
+void processFleet(bool dataUpdated)
+{
+    unsigned long now = millis();
+
+    receiveFleetFrames();
+
+    if (fleetId == FLEET_BASE_ID)
+    {
+        static unsigned long lastBeaconTime = 0;
+        if (now - lastBeaconTime >= CLOCK_SYNC_BEACON_PERIOD_MS)
+        {
+            ClockBeacon beacon;
+            beacon.baseTime = fleetTransport.now();
+            beacon.showStart = showStart;
+            beacon.scriptId = showScriptId;
+
+            uint8_t frame[CLOCK_SYNC_BEACON_SIZE];
+            fleetTransport.send(frame, packClockBeacon(beacon, frame));
+            lastBeaconTime = now;
+        }
+        return;
+    }
+
+    if (choreography.isPlaying())
+        processShow();
+
+    // Controller report rate over the last second, as a link quality figure
+    static unsigned long rateStartTime = 0;
+    static unsigned long lastReportTime = 0;
+    static uint16_t reportCount = 0;
+    static uint8_t reportRate = 0;
+    if (dataUpdated)
+    {
+        reportCount++;
+        lastReportTime = now;
+    }
+    if (now - rateStartTime >= 1000)
+    {
+        reportRate = min(reportCount, (uint16_t)255);
+        reportCount = 0;
+        rateStartTime = now;
+    }
+
+    FleetStatus status = {};
+    status.leftPower = signedPower(motors.getLeftDirection(), motors.getLeftPower());
+    status.rightPower = signedPower(motors.getRightDirection(), motors.getRightPower());
+    status.flags = (connectedController != nullptr ? FLEET_FLAG_CONTROLLER : 0) |
+                   (watchdog.isTripped() ? FLEET_FLAG_WATCHDOG : 0) |
+                   (hardwareFailsafe.isTripped() ? FLEET_FLAG_FAILSAFE : 0) |
+                   (powerManager.getState() != POWER_ACTIVE ? FLEET_FLAG_IDLE : 0);
+    status.batteryMv = TANK_CONFIG.batterySensePin >= 0
+                           ? analogReadMilliVolts(TANK_CONFIG.batterySensePin) * TANK_CONFIG.batteryDividerRatio
+                           : 0;
+    status.reportRate = reportRate;
+    status.reportAge = min(now - lastReportTime, 65535UL);
+    status.freeHeapKb = min(resourceMonitor.getSnapshot().freeHeap / 1024, (uint32_t)255);
+    fleetTelemetry.update(now, status);
+}
+
+/**
+ * Serial command: start or stop a show on the base node, or show sync state on a tank
+ */
+void commandShow(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (fleetId == FLEET_BASE_ID)
+    {
+        if (strcmp(args, "stop") == 0)
+        {
+            showStart = 0;
+            out.println("Show stopped");
+            return;
+        }
+
+        // Start a few seconds out so every tank hears the beacon in time
+        int scriptId = atoi(args);
+        const char *delayArg = strchr(args, ' ');
+        uint32_t delayMs = delayArg != nullptr ? atoi(delayArg + 1) : 3000;
+        if (findChoreographyScript(scriptId) == nullptr)
+        {
+            out.println("Usage: show <script id> [start delay ms] | show stop");
+            return;
+        }
+
+        showScriptId = scriptId;
+        showStart = fleetTransport.now() / 1000 + delayMs;
+        if (showStart == 0)
+            showStart = 1; // 0 means no show
+        out.printf("Show %d starts in %lums\n", scriptId, (unsigned long)delayMs);
+        return;
+    }
+
+    uint64_t localTime = fleetTransport.now();
+    out.printf("Clock %s, last error=%ldus skew=%dppm resets=%lu, show %s\n",
+               clockSync.isSynced(localTime) ? "synced" : "not synced", (long)clockSync.getLastError(),
+               (int)clockSync.getSkewPpm(), (unsigned long)clockSync.getResets(),
+               choreography.isPlaying() ? "playing" : "idle");
+}
+
+/**
+ * Serial command: print or reset the loop timing histograms
+ */
+void commandJitter(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "reset") == 0)
+    {
+        loopProfiler.reset();
+        out.println("Loop profiler reset");
+        return;
+    }
+
+    loopProfiler.printReport();
+}
+
+#if TANK_TRACING
+/**
+ * Serial command: start, stop or dump the trace buffer (see tools/trace_chrome.py)
+ */
+void commandTrace(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strcmp(args, "on") == 0)
+        tracer.start();
+    else if (strcmp(args, "off") == 0)
+        tracer.stop();
+    else if (strcmp(args, "dump") == 0)
+    {
+        tracer.dump();
+        return;
+    }
+
+    out.printf("Tracing %s, %lu events recorded (last %u kept)\n", tracer.isEnabled() ? "on" : "off",
+               (unsigned long)tracer.getRecorded(), TRACE_BUFFER_EVENTS);
+}
+#endif
+
+#if TANK_SAMPLING_PROFILER
+/**
+ * Serial command: start, stop or dump the sampling profiler (see tools/sample_profile.py)
+ */
+void commandProfile(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strncmp(args, "start", 5) == 0)
+        samplingProfiler.start(args[5] != '\0' ? strtoul(args + 5, nullptr, 10) : SAMPLING_PROFILER_DEFAULT_HZ);
+    else if (strcmp(args, "stop") == 0)
+        samplingProfiler.stop();
+    else if (strcmp(args, "dump") == 0)
+    {
+        samplingProfiler.dump();
+        return;
+    }
+
+    out.printf("Sampling profiler %s, samples=%lu dropped=%lu\n", samplingProfiler.isRunning() ? "running" : "stopped",
+               (unsigned long)samplingProfiler.getSamples(), (unsigned long)samplingProfiler.getDropped());
+}
+#endif
+
+/**
+ * Serial command: switch the link to the binary firmware update protocol
+ */
+void commandUpdate(const char *args)
+{
+    Print &out = serialMux.console();
+
+    // Only update a parked tank
+    if (connectedController != nullptr)
+    {
+        out.println("Disconnect the controller before updating");
+        return;
+    }
+
+    // The update protocol needs the plain serial link
+    if (serialMux.isActive())
+    {
+        out.println("Close the framed link before updating");
+        return;
+    }
+
+    stopMotors();
+    firmwareUpdate.start(millis());
+    LOG_BASIC("Firmware update mode, waiting for image...");
+}
+
+/**
+ * Serial command: switch to framed channels, or show link statistics once framed
+ */
+void commandMux(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (serialMux.isActive())
+    {
+        out.printf("Framed at %lu baud, frames sent=%lu bad=%lu paused=0x%02x\n", serialMux.getBaud(),
+                   (unsigned long)serialMux.getFramesSent(), (unsigned long)serialMux.getBadFrames(),
+                   serialMux.getPausedMask());
+        out.printf("  dropped telemetry=%lu command=%lu log=%lu\n",
+                   (unsigned long)serialMux.channel(SERIAL_CHANNEL_TELEMETRY).getDropped(),
+                   (unsigned long)serialMux.channel(SERIAL_CHANNEL_COMMAND).getDropped(),
+                   (unsigned long)serialMux.channel(SERIAL_CHANNEL_LOG).getDropped());
+        return;
+    }
+
+    unsigned long baud = strtoul(args, nullptr, 10);
+    if (baud != 0 && (baud < SERIAL_MUX_MIN_BAUD || baud > SERIAL_MUX_MAX_BAUD))
+    {
+        out.printf("Baud must be %lu-%lu\n", (unsigned long)SERIAL_MUX_MIN_BAUD, (unsigned long)SERIAL_MUX_MAX_BAUD);
+        return;
+    }
+
+    // The host answers with HELLO at the new rate, or the console comes back as text
+    out.printf("Switching to framed serial at %lu baud\n", baud != 0 ? baud : Serial.baudRate());
+    serialMux.begin(baud, millis());
+}
+
+/**
+ * Serial command: UART transmit statistics, buffer size and benchmark
+ */
+void commandUart(const char *args)
+{
+    Print &out = serialMux.console();
+
+    if (strncmp(args, "bench", 5) == 0 || strncmp(args, "buffer", 6) == 0)
+    {
+        // Both write raw bytes or restart the UART, and the bench blocks the loop
+        if (serialMux.isActive() || connectedController != nullptr)
+        {
+            out.println("Disconnect the controller and close the framed link first");
+            return;
+        }
+
+        if (args[1] == 'u')
+        {
+            uartTx.setBufferSize(strtoul(args + 6, nullptr, 10));
+            out.printf("UART tx buffer %lu\n", (unsigned long)uartTx.getBufferSize());
+            return;
+        }
+
+        size_t bytes = args[5] != '\0' ? strtoul(args + 5, nullptr, 10) : UART_TX_BENCHMARK_BYTES;
+        uartTx.benchmark(constrain(bytes, (size_t)64, (size_t)UART_TX_BENCHMARK_MAX_BYTES), out);
+        return;
+    }
+
+    if (strcmp(args, "reset") == 0)
+        uartTx.resetStats();
+    uartTx.printReport(out);
+}
+
+/**
+ * Send the motor state on the telemetry channel at a fixed rate
+ */
+void sendMotorTelemetry(unsigned long now)
+{
+    static unsigned long lastSent = 0;
+    if (now - lastSent < MOTOR_TELEMETRY_INTERVAL_MS)
+        return;
+    lastSent = now;
+
+    MotorTelemetryRecord record;
+    record.time = now;
+    record.leftPower = signedPower(motors.getLeftDirection(), motors.getLeftPower());
+    record.rightPower = signedPower(motors.getRightDirection(), motors.getRightPower());
+    record.flags = (motors.isForcedOff() ? MOTOR_TELEMETRY_FORCED_OFF : 0) |
+                   (hardwareFailsafe.isTripped() ? MOTOR_TELEMETRY_FAILSAFE : 0) |
+                   (connectedController != nullptr ? MOTOR_TELEMETRY_CONNECTED : 0);
+    serialMux.channel(SERIAL_CHANNEL_TELEMETRY).write((const uint8_t *)&record, sizeof(record));
+}
+
+/**
+ * Feed serial bytes to the firmware update and restart once it is done
+ */
+void processFirmwareUpdate()
+{
+    uint8_t buffer[64];
+    size_t length = 0;
+    while (Serial.available() > 0 && length < sizeof(buffer))
+        buffer[length++] = Serial.read();
+
+    firmwareUpdate.receive(buffer, length, millis());
+    firmwareUpdate.update(millis());
+
+    // A controller connecting ends update mode, the transfer can be resumed later
+    if (connectedController != nullptr)
+        firmwareUpdate.stop();
+
+    if (firmwareUpdate.isComplete())
+    {
+        LOG_BASIC("Firmware update verified, restarting...");
+        Serial.flush();
+        ESP.restart();
+    }
 }
 
 /**
@@ -182,14 +1141,14 @@ void processController()
  */
 void setup()
 {
-    Serial.begin(115200);
+    uartTx.begin(115200, FIRMWARE_UPDATE_RX_BUFFER, UART_TX_BUFFER_SIZE);
     Serial.println("\n\nTank Robot Controller Starting...");
 
     // Print firmware information
-    Serial.printf("Firmware: %s\n", BP32.firmwareVersion());
+    LOG_DETAILED("Firmware: %s", BP32.firmwareVersion());
     const uint8_t *addr = BP32.localBdAddress();
-    Serial.printf("BD Addr: %2X:%2X:%2X:%2X:%2X:%2X\n",
-                  addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+    LOG_DETAILED("BD Addr: %2X:%2X:%2X:%2X:%2X:%2X",
+                 addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
 
     // Set up the Bluepad32 library
     BP32.setup(&onConnectedController, &onDisconnectedController);
@@ -211,8 +1170,65 @@ void setup()
     motors.begin();
     motors.setLeftCalibration(leftCal);
     motors.setRightCalibration(rightCal);
+    inputPrediction = preferences.getBool("predict", false);
+    yawControl = preferences.getBool("yawControl", false);
+    tractionControlOn = preferences.getBool("traction", false);
+    tiltGuard.setEnabled(preferences.getBool("tilt", true));
+    driveMode = preferences.getUChar("driveMode", DRIVE_MODE_DUAL_STICK) == DRIVE_MODE_TRIGGERS ? DRIVE_MODE_TRIGGERS
+                                                                                                : DRIVE_MODE_DUAL_STICK;
+
+    // The gyro bias is measured now, while the tank stands still
+    imuReady = imu.begin();
+    if (imuReady)
+    {
+        // From here on only the IMU task reads the sensor
+        tiltGuard.begin(motors);
+        imuTask.begin(imu, tiltGuard);
+    }
+
+    // Join the fleet link if this tank has an id
+    fleetId = preferences.getUChar("fleetId", 0);
+    if (fleetId == FLEET_BASE_ID)
+        fleetTransport.begin();
+    else if (fleetId != 0)
+        fleetTelemetry.begin(fleetId);
+
+    // Start at full clock, then scale down when idle
+    powerManager.begin();
+    loopProfiler.begin(getCpuFrequencyMhz());
+
+    // Wired joystick reports arrive as GAMEPAD messages once the link is framed
+    serialMux.setGamepadHandler(receiveSerialGamepad);
 
-    Serial.println("Setup complete. Waiting for controller connection...");
+    // Register serial commands
+    serialCommands.add("power", commandPower, "power state, current estimate and wake latency");
+    serialCommands.add("drive", commandDrive, "'drive dual' / 'drive triggers': how the gamepad steers");
+    serialCommands.add("fleet", commandFleet, "fleet table, or 'fleet id <1-254>' / 'fleet base'");
+    serialCommands.add("jitter", commandJitter, "loop period/execution histograms, 'jitter reset' to clear");
+    serialCommands.add("log", commandLog, "show or set debug level 0-3");
+    serialCommands.add("mem", commandMemory, "free heap, fragmentation and task stack high-water marks");
+    serialCommands.add("metrics", commandMetrics, "counters, gauges and histograms for tools/metrics_prom.py; 'metrics reset' clears min/max");
+    serialCommands.add("mux", commandMux, "framed channels, 'mux [baud]' (use tools/serial_mux.py); link stats once framed");
+    serialCommands.add("predict", commandPredict, "'predict on' / 'predict off': extrapolate the sticks between reports");
+#if TANK_SAMPLING_PROFILER
+    serialCommands.add("prof", commandProfile, "'prof start [hz]', 'prof stop', 'prof dump' for tools/sample_profile.py");
+#endif
+    serialCommands.add("show", commandShow, "base: 'show <id> [delay ms]' / 'show stop'; tank: clock sync state");
+#if TANK_TRACING
+    serialCommands.add("trace", commandTrace, "'trace on', 'trace off', 'trace dump' for tools/trace_chrome.py");
+#endif
+    serialCommands.add("tilt", commandTilt, "'tilt on' / 'tilt off': cut the motors before the tank rolls over");
+    serialCommands.add("traction", commandTraction, "'traction on' / 'traction off': cut power to a track that spins");
+    serialCommands.add("uart", commandUart, "tx stats; 'uart bench [bytes]', 'uart buffer <bytes>' (0 = FIFO only), 'uart reset'");
+    serialCommands.add("update", commandUpdate, "receive new firmware (use tools/serial_update.py)");
+    serialCommands.add("watchdog", commandWatchdog, "watchdog and failsafe state, heartbeats and reset cause");
+    serialCommands.add("yaw", commandYaw, "'yaw on' / 'yaw off': gyro holds the turn rate the sticks ask for");
+
+    // Start supervising last, once setup's slow work is done
+    watchdog.begin(motors, preferences);
+    hardwareFailsafe.begin(motors);
+
+    LOG_BASIC("Setup complete. Waiting for controller connection...");
 }
 
 /**
@@ -220,22 +1236,88 @@ void setup()
  */
 void loop()
 {
-    // Update Bluepad32 and process controller
+    loopProfiler.startPass();
+    TRACE_SCOPE(LOOP);
+
+    // Update Bluepad32 and pass a new report on, then act on the latest one
+    TRACE_BEGIN(BP32_UPDATE);
     bool dataUpdated = BP32.update();
     if (dataUpdated)
+        pollController();
+    TRACE_END(BP32_UPDATE);
+    watchdog.heartbeat(WATCHDOG_INPUT);
     {
+        TRACE_SCOPE(PROCESS_CONTROLLER);
         processController();
+        processImuControl();
+        processTiltGuard();
     }
 
     // Safety check - if no controller updates for 3 seconds, stop motors
-    static unsigned long lastUpdateTime = 0;
-    if (dataUpdated)
+    if ((connectedController != nullptr || serialGamepadActive) && inputCoalescer.getAgeUs(micros()) > 3000000)
+    {
+        LOG_BASIC("WARNING: No controller updates for 3 seconds, stopping motors");
+        stopMotors();
+        serialGamepadActive = false;
+    }
+
+    // Closing the framed link unplugs the wired joystick
+    if (serialGamepadActive && !serialMux.isActive())
+    {
+        LOG_BASIC("Wired joystick disconnected");
+        serialGamepadActive = false;
+        stopMotors();
+    }
+    watchdog.heartbeat(WATCHDOG_MOTOR);
+
+    // Handle serial commands and framed channels, or firmware update frames while updating
+    if (firmwareUpdate.isActive())
     {
-        lastUpdateTime = millis();
+        processFirmwareUpdate();
     }
-    else if (connectedController != nullptr && millis() - lastUpdateTime > 3000)
+    else
     {
-        Serial.println("WARNING: No controller updates for 3 seconds, stopping motors");
-        motors.stop();
+        TRACE_SCOPE(SERIAL);
+        if (serialMux.isActive())
+            sendMotorTelemetry(millis());
+        serialMux.update(millis());
+        serialCommands.update(serialMux.commandInput());
     }
+    watchdog.heartbeat(WATCHDOG_LOGGING);
+
+    // Sample memory usage now and then
+    resourceMonitor.update(millis());
+
+    // Fleet status link
+    if (fleetId != 0)
+    {
+        TRACE_SCOPE(FLEET);
+        processFleet(dataUpdated);
+    }
+
+    // Pacing while idle counts toward the period but not the execution time
+    loopProfiler.endPass();
+
+    // Scale power down when parked; connecting a controller, a changed report or driving wakes it up
+    static bool wasConnected = false;
+    bool controllerConnected = connectedController != nullptr;
+    bool motorsRunning = motors.getLeftDirection() != MOTOR_STOPPED || motors.getRightDirection() != MOTOR_STOPPED;
+    TRACE_BEGIN(POWER);
+    powerManager.update(controllerConnected, motorsRunning || controllerConnected != wasConnected);
+    TRACE_END(POWER);
+    wasConnected = controllerConnected;
+
+    // Cycle counts change meaning with the CPU clock
+    static PowerState lastPowerState = POWER_ACTIVE;
+    if (powerManager.getState() != lastPowerState)
+    {
+        lastPowerState = powerManager.getState();
+        loopProfiler.setCpuFrequency(getCpuFrequencyMhz());
+    }
+
+    // Feed the hardware watchdog if every subsystem checked in
+    watchdog.update();
+
+    // A new firmware image is kept only if it runs without tripping the watchdog
+    firmwareUpdate.checkSelfTest(millis(), !watchdog.isTripped());
 }
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "SamplingProfiler.h"
+
+#if TANK_SAMPLING_PROFILER
+
+#include "Logger.h"
+#include "SerialMux.h"
+#include <esp_debug_helpers.h>
+
+// Where ESP-IDF keeps the interrupt frame layout and stack checks moved between versions
+#if __has_include(<xtensa_context.h>)
+#include <xtensa_context.h>
+#else
+#include <freertos/xtensa_context.h>
+#endif
+#if __has_include(<esp_memory_utils.h>)
+#include <esp_memory_utils.h>
+#endif
+
+static const uint8_t TIMER_NUMBERS[] = SAMPLING_PROFILER_TIMER_NUMBERS;
+
+// Interrupt levels entered on each core, kept by the FreeRTOS port
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+extern "C" volatile unsigned port_interruptNesting[portNUM_PROCESSORS];
+#else
+extern "C" unsigned port_interruptNesting[portNUM_PROCESSORS];
+#endif
+
+SamplingProfiler *SamplingProfiler::_instance = nullptr;
+
+SamplingProfiler samplingProfiler;
+
+// Return addresses keep the window increment in their top two bits and point past the call
+static inline uint32_t IRAM_ATTR callerPc(uint32_t returnAddress)
+{
+    if (returnAddress & 0x80000000)
+        returnAddress = (returnAddress & 0x3fffffff) | 0x40000000;
+    return returnAddress - 3;
+}
+
+SamplingProfiler::SamplingProfiler()
+{
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+        _timers[core] = nullptr;
+    _hz = SAMPLING_PROFILER_DEFAULT_HZ;
+    _running = false;
+    clear();
+}
+
+void SamplingProfiler::start(uint32_t hz)
+{
+    stop();
+    clear();
+    _hz = constrain(hz, (uint32_t)1, (uint32_t)SAMPLING_PROFILER_MAX_HZ);
+    _instance = this;
+    _running = true;
+
+    // A timer interrupt fires on the core that attached it, so the other core's timer is
+    // created from a short task pinned there
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        if (_timers[core] != nullptr || core == xPortGetCoreID())
+        {
+            startTimer(core);
+            continue;
+        }
+
+        xTaskCreatePinnedToCore(startTimerTask, "profStart", 2048, (void *)(uintptr_t)core, 1, nullptr, core);
+        unsigned long waitStart = millis();
+        while (_timers[core] == nullptr && millis() - waitStart < 100)
+            delay(1);
+    }
+
+    LOG_DETAILED("Sampling profiler started at %luHz", (unsigned long)_hz);
+}
+
+void SamplingProfiler::stop()
+{
+    _running = false;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        if (_timers[core] != nullptr)
+            timerStop(_timers[core]);
+    }
+}
+
+bool SamplingProfiler::isRunning() const
+{
+    return _running;
+}
+
+uint32_t SamplingProfiler::getSamples() const
+{
+    uint32_t samples = 0;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+        samples += _cores[core].samples;
+    return samples;
+}
+
+uint32_t SamplingProfiler::getDropped() const
+{
+    uint32_t dropped = 0;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+        dropped += _cores[core].dropped;
+    return dropped;
+}
+
+void SamplingProfiler::dump()
+{
+    stop();
+
+    Print &out = serialMux.console();
+    out.printf("profile %d %lu %lu %lu\n", SAMPLING_PROFILER_DUMP_VERSION, (unsigned long)_hz,
+               (unsigned long)getSamples(), (unsigned long)getDropped());
+
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        const CoreTable &table = _cores[core];
+        for (uint8_t i = 0; i < table.taskCount; i++)
+            out.printf("t %u %u %s\n", core, i, table.taskNames[i]);
+
+        for (uint16_t i = 0; i < SAMPLING_PROFILER_STACKS; i++)
+        {
+            const StackEntry &entry = table.stacks[i];
+            if (entry.count == 0)
+                continue;
+
+            out.printf("s %lu %u %u", (unsigned long)entry.count, core, entry.task);
+            for (uint8_t depth = 0; depth < SAMPLING_PROFILER_STACK_DEPTH && entry.pcs[depth] != 0; depth++)
+                out.printf(" %08lx", (unsigned long)entry.pcs[depth]);
+            out.println();
+        }
+    }
+
+    out.println("end");
+}
+
+void SamplingProfiler::clear()
+{
+    memset(_cores, 0, sizeof(_cores));
+}
+
+void SamplingProfiler::startTimer(uint8_t core)
+{
+    uint64_t period = SAMPLING_PROFILER_TIMER_FREQUENCY / _hz;
+
+    if (_timers[core] == nullptr)
+    {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+        _timers[core] = timerBegin(SAMPLING_PROFILER_TIMER_FREQUENCY);
+        timerAttachInterrupt(_timers[core], &SamplingProfiler::onTimer);
+#else
+        _timers[core] = timerBegin(TIMER_NUMBERS[core], 80, true);
+        timerAttachInterrupt(_timers[core], &SamplingProfiler::onTimer, true);
+#endif
+    }
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    timerAlarm(_timers[core], period, true, 0);
+#else
+    timerAlarmWrite(_timers[core], period, true);
+    timerAlarmEnable(_timers[core]);
+#endif
+    timerRestart(_timers[core]);
+    timerStart(_timers[core]);
+}
+
+void SamplingProfiler::startTimerTask(void *parameter)
+{
+    _instance->startTimer((uint8_t)(uintptr_t)parameter);
+    vTaskDelete(nullptr);
+}
+
+void IRAM_ATTR SamplingProfiler::sample()
+{
+    uint8_t core = xPortGetCoreID();
+    CoreTable &table = _cores[core];
+    table.samples++;
+
+    uint32_t pcs[SAMPLING_PROFILER_STACK_DEPTH] = {};
+    uint8_t task = SAMPLING_PROFILER_IN_INTERRUPT;
+
+    // Only an interrupted task leaves its registers where we can find them: interrupt entry
+    // saves them on the task's stack and stores that stack pointer in the task's control
+    // block, whose first field is pxTopOfStack. The port has already counted our own entry,
+    // so a nesting level of exactly one means we came straight from a task.
+    if (((volatile unsigned *)port_interruptNesting)[core] == 1)
+    {
+        void *handle = xTaskGetCurrentTaskHandleForCPU(core);
+        const XtExcFrame *frame = *(XtExcFrame *const *)handle;
+        task = taskIndex(table, handle);
+
+        // Walk the callers the same way the panic handler does
+        esp_backtrace_frame_t stack = {};
+        stack.pc = frame->pc;
+        stack.sp = frame->a1;
+        stack.next_pc = frame->a0;
+        pcs[0] = frame->pc;
+        for (uint8_t depth = 1; depth < SAMPLING_PROFILER_STACK_DEPTH; depth++)
+        {
+            if (!esp_stack_ptr_is_sane(stack.sp) || !esp_backtrace_get_next_frame(&stack))
+                break;
+            pcs[depth] = callerPc(stack.pc);
+        }
+    }
+
+    // Count the stack in an open-addressed table, dropping it if the probe runs out
+    uint32_t hash = task;
+    for (uint8_t depth = 0; depth < SAMPLING_PROFILER_STACK_DEPTH; depth++)
+        hash = (hash ^ pcs[depth]) * 16777619u;
+
+    for (uint8_t probe = 0; probe < SAMPLING_PROFILER_PROBES; probe++)
+    {
+        StackEntry &entry = table.stacks[(hash + probe) & (SAMPLING_PROFILER_STACKS - 1)];
+        if (entry.count == 0)
+        {
+            memcpy(entry.pcs, pcs, sizeof(pcs));
+            entry.task = task;
+            entry.count = 1;
+            return;
+        }
+        if (entry.task == task && memcmp(entry.pcs, pcs, sizeof(pcs)) == 0)
+        {
+            entry.count++;
+            return;
+        }
+    }
+    table.dropped++;
+}
+
+uint8_t IRAM_ATTR SamplingProfiler::taskIndex(CoreTable &table, void *task)
+{
+    for (uint8_t i = 0; i < table.taskCount; i++)
+    {
+        if (table.taskHandles[i] == task)
+            return i;
+    }
+
+    if (table.taskCount == SAMPLING_PROFILER_MAX_TASKS)
+        return SAMPLING_PROFILER_UNKNOWN_TASK;
+
+    // Copy the name now, the task may be gone by the time we dump
+    uint8_t index = table.taskCount++;
+    table.taskHandles[index] = task;
+    const char *name = pcTaskGetName((TaskHandle_t)task);
+    for (uint8_t i = 0; i < SAMPLING_PROFILER_TASK_NAME_LENGTH - 1 && name[i] != '\0'; i++)
+        table.taskNames[index][i] = name[i];
+    return index;
+}
+
+void IRAM_ATTR SamplingProfiler::onTimer()
+{
+    if (_instance != nullptr && _instance->_running)
+        _instance->sample();
+}
+
+#endif // TANK_SAMPLING_PROFILER
@@ -0,0 +1,91 @@
+#ifndef SAMPLING_PROFILER_H
+#define SAMPLING_PROFILER_H
+
+#include <Arduino.h>
+
+// Statistical profiler, built only with -DTANK_SAMPLING_PROFILER=1 (tools/build.sh profile).
+// It costs a timer interrupt per core and about 13KB of RAM while compiled in.
+#ifndef TANK_SAMPLING_PROFILER
+#define TANK_SAMPLING_PROFILER 0
+#endif
+
+// Default settings
+#define SAMPLING_PROFILER_TIMER_NUMBERS {2, 3} // Hardware timers per core, only used by Arduino core 2.x
+#define SAMPLING_PROFILER_TIMER_FREQUENCY 1000000
+#define SAMPLING_PROFILER_DEFAULT_HZ 997 // Prime, so sampling doesn't lock onto 1kHz periodic work
+#define SAMPLING_PROFILER_MAX_HZ 10000
+#define SAMPLING_PROFILER_STACK_DEPTH 4 // Interrupted PC plus this many minus one callers
+#define SAMPLING_PROFILER_STACKS 256 // Distinct stacks kept per core, power of two
+#define SAMPLING_PROFILER_PROBES 8
+#define SAMPLING_PROFILER_MAX_TASKS 16 // Distinct tasks kept per core
+#define SAMPLING_PROFILER_TASK_NAME_LENGTH 16
+#define SAMPLING_PROFILER_IN_INTERRUPT 0xff // Task index of samples that hit another interrupt
+#define SAMPLING_PROFILER_UNKNOWN_TASK 0xfe // Task index once the task table is full
+#define SAMPLING_PROFILER_DUMP_VERSION 1
+
+/*
+ * Samples the interrupted program counter, a few callers and the running task on both
+ * cores at a fixed rate. Identical stacks are counted in a per-core hash table inside the
+ * interrupt, so a session can run for minutes; tools/sample_profile.py symbolizes the
+ * dump against the ELF and prints a flat profile or collapsed stacks for a flame graph.
+ */
+class SamplingProfiler
+{
+public:
+    // Constructor
+    SamplingProfiler();
+
+    // Clear the tables and sample at the given rate until stop()
+    void start(uint32_t hz);
+    void stop();
+
+    bool isRunning() const;
+    uint32_t getSamples() const;
+    uint32_t getDropped() const;
+
+    // Stop and print every stack with its count:
+    //   profile <version> <hz> <samples> <dropped>
+    //   t <core> <task index> <name>
+    //   s <count> <core> <task index> <pc> [caller pcs] (hex)
+    //   end
+    void dump();
+
+private:
+    struct StackEntry
+    {
+        uint32_t pcs[SAMPLING_PROFILER_STACK_DEPTH];
+        uint32_t count;
+        uint8_t task;
+    };
+
+    struct CoreTable
+    {
+        StackEntry stacks[SAMPLING_PROFILER_STACKS];
+        void *taskHandles[SAMPLING_PROFILER_MAX_TASKS];
+        char taskNames[SAMPLING_PROFILER_MAX_TASKS][SAMPLING_PROFILER_TASK_NAME_LENGTH];
+        uint8_t taskCount;
+        uint32_t samples;
+        uint32_t dropped;
+    };
+
+    CoreTable _cores[portNUM_PROCESSORS];
+    hw_timer_t *_timers[portNUM_PROCESSORS];
+    uint32_t _hz;
+    volatile bool _running;
+
+    static SamplingProfiler *_instance;
+
+    // Helper methods
+    void clear();
+    void startTimer(uint8_t core);
+    void IRAM_ATTR sample();
+    uint8_t IRAM_ATTR taskIndex(CoreTable &table, void *task);
+    static void IRAM_ATTR onTimer();
+    static void startTimerTask(void *parameter);
+};
+
+#if TANK_SAMPLING_PROFILER
+extern SamplingProfiler samplingProfiler;
+#endif
+
+#endif // SAMPLING_PROFILER_H
@@ -0,0 +1,92 @@
+#include "SerialCommands.h"
+#include "Logger.h"
+
+SerialCommands serialCommands;
+
+SerialCommands::SerialCommands()
+{
+    _commandCount = 0;
+    _lineLength = 0;
+}
+
+bool SerialCommands::add(const char *name, SerialCommandHandler handler, const char *help)
+{
+    // Callers don't check, so a command that doesn't fit must not vanish quietly
+    if (_commandCount >= SERIAL_COMMAND_MAX)
+    {
+        LOG_BASIC("Command table full (SERIAL_COMMAND_MAX %d), '%s' not registered", SERIAL_COMMAND_MAX, name);
+        return false;
+    }
+
+    _commands[_commandCount].name = name;
+    _commands[_commandCount].help = help;
+    _commands[_commandCount].handler = handler;
+    _commandCount++;
+    return true;
+}
+
+void SerialCommands::update(Stream &stream)
+{
+    while (stream.available() > 0)
+    {
+        char c = stream.read();
+
+        if (c == '\r' || c == '\n')
+        {
+            if (_lineLength > 0)
+            {
+                _line[_lineLength] = '\0';
+                dispatch(stream);
+                _lineLength = 0;
+            }
+        }
+        else if (_lineLength < SERIAL_COMMAND_LINE_LENGTH - 1)
+        {
+            _line[_lineLength++] = c;
+        }
+    }
+}
+
+void SerialCommands::printHelp(Print &out) const
+{
+    out.println("Commands:");
+    out.println("  help - list commands");
+    for (uint8_t i = 0; i < _commandCount; i++)
+    {
+        out.printf("  %s - %s\n", _commands[i].name, _commands[i].help);
+    }
+}
+
+void SerialCommands::dispatch(Print &out)
+{
+    // Split the line into the command name and its arguments
+    char *args = strchr(_line, ' ');
+    if (args != nullptr)
+    {
+        *args = '\0';
+        args++;
+        while (*args == ' ')
+            args++;
+    }
+    else
+    {
+        args = _line + _lineLength;
+    }
+
+    if (strcmp(_line, "help") == 0)
+    {
+        printHelp(out);
+        return;
+    }
+
+    for (uint8_t i = 0; i < _commandCount; i++)
+    {
+        if (strcmp(_line, _commands[i].name) == 0)
+        {
+            _commands[i].handler(args);
+            return;
+        }
+    }
+
+    out.printf("Unknown command: %s (type 'help')\n", _line);
+}
@@ -0,0 +1,50 @@
+#ifndef SERIAL_COMMANDS_H
+#define SERIAL_COMMANDS_H
+
+#include <Arduino.h>
+
+// Command table settings
+#define SERIAL_COMMAND_MAX 24 // headroom over every optional build feature
+#define SERIAL_COMMAND_LINE_LENGTH 64
+
+// Handler for a serial command, receives everything after the command name
+typedef void (*SerialCommandHandler)(const char *args);
+
+class SerialCommands
+{
+public:
+    // Constructor
+    SerialCommands();
+
+    // Register a command, returns false (and logs it) when the table is full
+    bool add(const char *name, SerialCommandHandler handler, const char *help);
+
+    // Read any pending input and run completed commands (non-blocking). Replies to
+    // 'help' and unknown commands go back to the same stream.
+    void update(Stream &stream);
+
+    // Print the list of registered commands
+    void printHelp(Print &out) const;
+
+private:
+    struct Command
+    {
+        const char *name;
+        const char *help;
+        SerialCommandHandler handler;
+    };
+
+    Command _commands[SERIAL_COMMAND_MAX];
+    uint8_t _commandCount;
+
+    // Current input line
+    char _line[SERIAL_COMMAND_LINE_LENGTH];
+    uint8_t _lineLength;
+
+    // Helper methods
+    void dispatch(Print &out);
+};
+
+extern SerialCommands serialCommands;
+
+#endif // SERIAL_COMMANDS_H
@@ -0,0 +1,473 @@
+#include "SerialMux.h"
+#include "UartTx.h"
+
+SerialMux serialMux;
+
+// CRC-16/CCITT-FALSE, bitwise to keep the table out of RAM
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    while (length--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+SerialChannel::SerialChannel()
+{
+    _mux = nullptr;
+    _id = 0;
+    _blocking = false;
+    _tx = nullptr;
+    _txSize = 0;
+    _rx = nullptr;
+    _rxSize = 0;
+    _dropped = 0;
+    clear();
+}
+
+void SerialChannel::begin(SerialMux *mux, uint8_t id, uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize,
+                          bool blocking)
+{
+    _mux = mux;
+    _id = id;
+    _tx = txBuffer;
+    _txSize = txSize;
+    _rx = rxBuffer;
+    _rxSize = rxSize;
+    _blocking = blocking;
+    clear();
+}
+
+size_t SerialChannel::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t SerialChannel::write(const uint8_t *data, size_t length)
+{
+    if (_blocking)
+    {
+        // Hand the mux the data in pieces, sending frames until each piece fits
+        size_t written = 0;
+        while (written < length)
+        {
+            size_t room = _txSize - _txCount;
+            if (room == 0)
+            {
+                if (!_mux->waitForRoom(_id))
+                    break;
+                continue;
+            }
+
+            size_t count = min(room, length - written);
+            put(data + written, count);
+            written += count;
+        }
+        _dropped += length - written;
+        return written;
+    }
+
+    // All or nothing, so a telemetry record or log line is never cut in half
+    if (length > _txSize - _txCount)
+    {
+        _dropped += length;
+        return 0;
+    }
+    put(data, length);
+    return length;
+}
+
+int SerialChannel::availableForWrite()
+{
+    return _txSize - _txCount;
+}
+
+int SerialChannel::available()
+{
+    return _rxCount;
+}
+
+int SerialChannel::read()
+{
+    if (_rxCount == 0)
+        return -1;
+
+    uint8_t value = _rx[_rxHead];
+    _rxHead = (_rxHead + 1) % _rxSize;
+    _rxCount--;
+    return value;
+}
+
+int SerialChannel::peek()
+{
+    return _rxCount > 0 ? _rx[_rxHead] : -1;
+}
+
+size_t SerialChannel::getPending() const
+{
+    return _txCount;
+}
+
+size_t SerialChannel::take(uint8_t *data, size_t maxLength)
+{
+    // At most two contiguous pieces, before and after the end of the buffer
+    size_t count = min(maxLength, _txCount);
+    size_t first = min(count, _txSize - _txHead);
+    memcpy(data, _tx + _txHead, first);
+    memcpy(data + first, _tx, count - first);
+    _txHead = (_txHead + count) % _txSize;
+    _txCount -= count;
+    return count;
+}
+
+void SerialChannel::put(const uint8_t *data, size_t length)
+{
+    size_t tail = (_txHead + _txCount) % _txSize;
+    size_t first = min(length, _txSize - tail);
+    memcpy(_tx + tail, data, first);
+    memcpy(_tx, data + first, length - first);
+    _txCount += length;
+}
+
+void SerialChannel::receive(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length && _rxCount < _rxSize; i++)
+    {
+        _rx[(_rxHead + _rxCount) % _rxSize] = data[i];
+        _rxCount++;
+    }
+}
+
+void SerialChannel::clear()
+{
+    _txHead = 0;
+    _txCount = 0;
+    _rxHead = 0;
+    _rxCount = 0;
+}
+
+uint32_t SerialChannel::getDropped() const
+{
+    return _dropped;
+}
+
+SerialMux::SerialMux()
+{
+    _active = false;
+    _paused = 0;
+    _baud = 0;
+    _textBaud = 0;
+    _confirmedBaud = 0;
+    _confirmDeadline = 0;
+    _awaitingHello = false;
+    _linkConfirmed = false;
+    _waitedUs = 0;
+    _gamepadHandler = nullptr;
+    _frameLength = 0;
+    _framesSent = 0;
+    _badFrames = 0;
+
+    _channels[SERIAL_CHANNEL_CONTROL].begin(this, SERIAL_CHANNEL_CONTROL, _controlBuffer, sizeof(_controlBuffer),
+                                            nullptr, 0, true);
+    _channels[SERIAL_CHANNEL_TELEMETRY].begin(this, SERIAL_CHANNEL_TELEMETRY, _telemetryBuffer,
+                                              sizeof(_telemetryBuffer), nullptr, 0, false);
+    _channels[SERIAL_CHANNEL_COMMAND].begin(this, SERIAL_CHANNEL_COMMAND, _commandBuffer, sizeof(_commandBuffer),
+                                            _commandRxBuffer, sizeof(_commandRxBuffer), true);
+    _channels[SERIAL_CHANNEL_LOG].begin(this, SERIAL_CHANNEL_LOG, _logBuffer, sizeof(_logBuffer), nullptr, 0, false);
+}
+
+bool SerialMux::begin(unsigned long baud, unsigned long now)
+{
+    if (_active)
+        return false;
+    if (baud != 0 && (baud < SERIAL_MUX_MIN_BAUD || baud > SERIAL_MUX_MAX_BAUD))
+        return false;
+
+    _textBaud = Serial.baudRate();
+    _confirmedBaud = _textBaud;
+    for (uint8_t i = 0; i < SERIAL_CHANNEL_COUNT; i++)
+        _channels[i].clear();
+    _paused = 0;
+    _frameLength = 0;
+    _linkConfirmed = false;
+    _active = true;
+
+    // Stay framed only once the host has answered at the new rate
+    switchBaud(baud != 0 ? baud : _textBaud);
+    _awaitingHello = true;
+    _confirmDeadline = now + SERIAL_MUX_CONFIRM_MS;
+    return true;
+}
+
+void SerialMux::end()
+{
+    if (!_active)
+        return;
+
+    // Let queued output go out framed, then return to text
+    unsigned long start = millis();
+    while (millis() - start < SERIAL_MUX_BLOCK_MS)
+    {
+        bool pending = false;
+        for (uint8_t i = 0; i < SERIAL_CHANNEL_COUNT; i++)
+            pending |= _channels[i].getPending() > 0 && !isHeld(i);
+        if (!pending)
+            break;
+        flushSome();
+    }
+
+    _active = false;
+    switchBaud(_textBaud);
+}
+
+void SerialMux::update(unsigned long now)
+{
+    if (!_active)
+        return;
+
+    // Each pass gets its own SERIAL_MUX_BLOCK_MS of waiting for the UART
+    _waitedUs = 0;
+    receiveBytes();
+
+    if (_awaitingHello && (long)(now - _confirmDeadline) >= 0)
+    {
+        _awaitingHello = false;
+        if (!_linkConfirmed)
+        {
+            // Nobody is listening framed, give the console back without the queued frames
+            for (uint8_t i = 0; i < SERIAL_CHANNEL_COUNT; i++)
+                _channels[i].clear();
+            end();
+            return;
+        }
+        switchBaud(_confirmedBaud);
+    }
+
+    flushSome();
+}
+
+void SerialMux::flushSome()
+{
+    uint8_t frame[SERIAL_MUX_MAX_PAYLOAD + 5];
+
+    while (true)
+    {
+        // Highest priority channel with output that the host hasn't paused. Until the first
+        // HELLO only control replies go out, the host may not be listening framed yet.
+        int id = -1;
+        for (uint8_t i = 0; i < SERIAL_CHANNEL_COUNT && id < 0; i++)
+        {
+            if (_channels[i].getPending() > 0 && !isHeld(i))
+                id = i;
+        }
+        if (id < 0)
+            return;
+
+        int room = uartTx.availableForWrite() - 5;
+        if (room <= 0)
+            return;
+
+        size_t length = _channels[id].take(frame + 3, min((size_t)room, (size_t)SERIAL_MUX_MAX_PAYLOAD));
+        frame[0] = SERIAL_MUX_SYNC;
+        frame[1] = id;
+        frame[2] = length;
+        uint16_t crc = crc16(frame + 1, length + 2);
+        frame[3 + length] = crc & 0xFF;
+        frame[4 + length] = crc >> 8;
+        uartTx.write(frame, length + 5);
+        _framesSent++;
+    }
+}
+
+bool SerialMux::waitForRoom(uint8_t id)
+{
+    // Nothing drains a held channel, so waiting for it would only stall the loop
+    if (isHeld(id) || _waitedUs >= SERIAL_MUX_BLOCK_MS * 1000UL)
+        return false;
+
+    unsigned long start = micros();
+    flushSome();
+    _waitedUs += micros() - start;
+    return true;
+}
+
+bool SerialMux::isActive() const
+{
+    return _active;
+}
+
+unsigned long SerialMux::getBaud() const
+{
+    return _active ? _baud : Serial.baudRate();
+}
+
+Print &SerialMux::output(SerialChannelId id)
+{
+    if (_active)
+        return _channels[id];
+    return Serial;
+}
+
+Print &SerialMux::console()
+{
+    return output(SERIAL_CHANNEL_COMMAND);
+}
+
+Stream &SerialMux::commandInput()
+{
+    if (_active)
+        return _channels[SERIAL_CHANNEL_COMMAND];
+    return Serial;
+}
+
+SerialChannel &SerialMux::channel(SerialChannelId id)
+{
+    return _channels[id];
+}
+
+void SerialMux::setGamepadHandler(SerialGamepadHandler handler)
+{
+    _gamepadHandler = handler;
+}
+
+uint32_t SerialMux::getFramesSent() const
+{
+    return _framesSent;
+}
+
+uint32_t SerialMux::getBadFrames() const
+{
+    return _badFrames;
+}
+
+uint8_t SerialMux::getPausedMask() const
+{
+    return _paused;
+}
+
+bool SerialMux::isHeld(uint8_t id) const
+{
+    return (_paused & (1 << id)) || (!_linkConfirmed && id != SERIAL_CHANNEL_CONTROL);
+}
+
+void SerialMux::receiveBytes()
+{
+    // A CLOSE ends the loop, the rest of the input belongs to the text console
+    while (_active && Serial.available() > 0)
+    {
+        uint8_t value = Serial.read();
+
+        // Skip anything before a sync byte
+        if (_frameLength == 0 && value != SERIAL_MUX_SYNC)
+            continue;
+        _frame[_frameLength++] = value;
+
+        if (_frameLength == 3 && (_frame[1] >= SERIAL_CHANNEL_COUNT || _frame[2] > SERIAL_MUX_MAX_PAYLOAD))
+        {
+            _badFrames++;
+            _frameLength = 0;
+            continue;
+        }
+        if (_frameLength < 3 || _frameLength < (size_t)_frame[2] + 5)
+            continue;
+
+        size_t length = _frame[2];
+        uint16_t crc = _frame[3 + length] | (_frame[4 + length] << 8);
+        if (crc == crc16(_frame + 1, length + 2))
+            handleFrame(_frame[1], _frame + 3, length, millis());
+        else
+            _badFrames++;
+        _frameLength = 0;
+    }
+}
+
+void SerialMux::handleFrame(uint8_t channel, const uint8_t *payload, size_t length, unsigned long now)
+{
+    if (channel == SERIAL_CHANNEL_CONTROL)
+        handleControl(payload, length, now);
+    else
+        _channels[channel].receive(payload, length);
+}
+
+void SerialMux::handleControl(const uint8_t *payload, size_t length, unsigned long now)
+{
+    if (length == 0)
+        return;
+
+    switch (payload[0])
+    {
+    case SERIAL_MUX_HELLO:
+    {
+        _awaitingHello = false;
+        _linkConfirmed = true;
+        _confirmedBaud = _baud;
+        uint8_t reply[6] = {SERIAL_MUX_VERSION, SERIAL_CHANNEL_COUNT};
+        memcpy(reply + 2, &_baud, 4);
+        sendControl(SERIAL_MUX_HELLO, reply, sizeof(reply));
+        break;
+    }
+    case SERIAL_MUX_FLOW:
+        // The control channel can't be paused, or the host could never resume
+        if (length >= 2)
+            _paused = payload[1] & ~(1 << SERIAL_CHANNEL_CONTROL);
+        break;
+    case SERIAL_MUX_BAUD:
+    {
+        uint32_t baud;
+        if (length < 5)
+            break;
+        memcpy(&baud, payload + 1, 4);
+        if (baud < SERIAL_MUX_MIN_BAUD || baud > SERIAL_MUX_MAX_BAUD)
+            baud = _baud;
+
+        // Acknowledge at the old rate, then switch once the reply is out
+        sendControl(SERIAL_MUX_BAUD, (const uint8_t *)&baud, 4);
+        Serial.flush();
+        switchBaud(baud);
+        _awaitingHello = true;
+        _confirmDeadline = now + SERIAL_MUX_CONFIRM_MS;
+        break;
+    }
+    case SERIAL_MUX_CLOSE:
+        end();
+        break;
+    case SERIAL_MUX_STATS:
+    {
+        uint8_t reply[SERIAL_CHANNEL_COUNT * 4];
+        for (uint8_t i = 0; i < SERIAL_CHANNEL_COUNT; i++)
+        {
+            uint32_t dropped = _channels[i].getDropped();
+            memcpy(reply + i * 4, &dropped, 4);
+        }
+        sendControl(SERIAL_MUX_STATS, reply, sizeof(reply));
+        break;
+    }
+    case SERIAL_MUX_GAMEPAD:
+        if (_gamepadHandler != nullptr)
+            _gamepadHandler(payload + 1, length - 1);
+        break;
+    }
+}
+
+void SerialMux::sendControl(uint8_t type, const uint8_t *data, size_t length)
+{
+    uint8_t message[1 + SERIAL_CHANNEL_COUNT * 4];
+    message[0] = type;
+    memcpy(message + 1, data, length);
+    _channels[SERIAL_CHANNEL_CONTROL].write(message, length + 1);
+    flushSome();
+}
+
+void SerialMux::switchBaud(unsigned long baud)
+{
+    if (baud != Serial.baudRate())
+    {
+        Serial.flush();
+        Serial.updateBaudRate(baud);
+    }
+    _baud = baud;
+}
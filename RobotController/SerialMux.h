@@ -0,0 +1,201 @@
+#ifndef SERIAL_MUX_H
+#define SERIAL_MUX_H
+
+#include <Arduino.h>
+
+/*
+ * Framed serial protocol, used after the 'mux' command (see tools/serial_mux.py):
+ *
+ *   frame    = 0xA7, channel, length (u8), payload, crc16 (u16 LE, CCITT over channel, length and payload)
+ *
+ * Channels are sent in priority order, lowest number first, in frames of at most
+ * SERIAL_MUX_MAX_PAYLOAD bytes, so a telemetry record never waits behind a long log dump.
+ * The host sends command lines on the command channel and these on the control channel:
+ *
+ *   HELLO    = (empty) confirm the link, answered with HELLO: version, channel count, baud (u32)
+ *   FLOW     = paused channel mask (u8), bit n pauses channel n until it is cleared again
+ *   BAUD     = baud (u32), answered with BAUD at the old rate, then the tank switches and
+ *              goes back to the old rate unless a HELLO arrives within SERIAL_MUX_CONFIRM_MS
+ *   CLOSE    = (empty) back to plain text at the original baud
+ *   STATS    = (empty) answered with STATS: dropped bytes (u32) for each channel
+ *   GAMEPAD  = GamepadSnapshot (18 bytes), one report from a wired joystick, passed to the
+ *              gamepad handler (see tools/serial_joystick.py)
+ */
+
+// Channels, in priority order
+enum SerialChannelId
+{
+    SERIAL_CHANNEL_CONTROL,
+    SERIAL_CHANNEL_TELEMETRY,
+    SERIAL_CHANNEL_COMMAND,
+    SERIAL_CHANNEL_LOG,
+    SERIAL_CHANNEL_COUNT
+};
+
+// Control messages
+#define SERIAL_MUX_HELLO 0x01
+#define SERIAL_MUX_FLOW 0x02
+#define SERIAL_MUX_BAUD 0x03
+#define SERIAL_MUX_CLOSE 0x04
+#define SERIAL_MUX_STATS 0x05
+#define SERIAL_MUX_GAMEPAD 0x06
+
+// Default settings
+#define SERIAL_MUX_SYNC 0xA7
+#define SERIAL_MUX_VERSION 1
+#define SERIAL_MUX_MAX_PAYLOAD 64
+#define SERIAL_MUX_MIN_BAUD 9600
+#define SERIAL_MUX_MAX_BAUD 2000000
+#define SERIAL_MUX_CONFIRM_MS 2000 // A new baud rate must be confirmed by the host this fast
+#define SERIAL_MUX_BLOCK_MS 100 // Longest blocking channels wait for room in one loop pass
+#define SERIAL_MUX_CONTROL_BUFFER 64
+#define SERIAL_MUX_TELEMETRY_BUFFER 256
+#define SERIAL_MUX_COMMAND_BUFFER 1024
+#define SERIAL_MUX_LOG_BUFFER 1024
+#define SERIAL_MUX_COMMAND_RX_BUFFER 128
+
+// Telemetry channel record, sent every MOTOR_TELEMETRY_INTERVAL_MS
+struct __attribute__((packed)) MotorTelemetryRecord
+{
+    uint32_t time;      // millis()
+    int16_t leftPower;  // -255..255, negative = backward
+    int16_t rightPower;
+    uint8_t flags;      // MOTOR_TELEMETRY_*
+};
+
+#define MOTOR_TELEMETRY_FORCED_OFF 0x01
+#define MOTOR_TELEMETRY_FAILSAFE 0x02
+#define MOTOR_TELEMETRY_CONNECTED 0x04
+
+class SerialMux;
+
+// Receives the payload of a GAMEPAD control message
+typedef void (*SerialGamepadHandler)(const uint8_t *data, size_t length);
+
+// One logical stream inside the mux. Blocking channels wait for room when full, as long as
+// the host can take their output and the loop pass has waiting time left; the others drop
+// whole writes so a record is never cut in half.
+class SerialChannel : public Stream
+{
+public:
+    // Constructor
+    SerialChannel();
+
+    void begin(SerialMux *mux, uint8_t id, uint8_t *txBuffer, size_t txSize, uint8_t *rxBuffer, size_t rxSize, bool blocking);
+
+    // Stream interface for the code producing and consuming the channel
+    size_t write(uint8_t value) override;
+    size_t write(const uint8_t *data, size_t length) override;
+    int availableForWrite() override;
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    // Mux side: queued output and received input
+    size_t getPending() const;
+    size_t take(uint8_t *data, size_t maxLength);
+    void receive(const uint8_t *data, size_t length);
+    void clear();
+
+    uint32_t getDropped() const;
+
+private:
+    SerialMux *_mux;
+    uint8_t _id;
+    bool _blocking;
+
+    uint8_t *_tx;
+    size_t _txSize;
+    size_t _txHead;
+    size_t _txCount;
+
+    uint8_t *_rx;
+    size_t _rxSize;
+    size_t _rxHead;
+    size_t _rxCount;
+
+    uint32_t _dropped;
+
+    // Copy into the free space, which the caller has checked
+    void put(const uint8_t *data, size_t length);
+};
+
+class SerialMux
+{
+public:
+    // Constructor
+    SerialMux();
+
+    // Switch the UART to framed mode at the given baud (0 keeps the current one)
+    bool begin(unsigned long baud, unsigned long now);
+
+    // Back to plain text at the baud used before begin()
+    void end();
+
+    // Parse incoming frames and send queued output, call every loop
+    void update(unsigned long now);
+
+    // Send as much queued output as the UART takes without waiting
+    void flushSome();
+
+    // Send some output so a full blocking channel gets room. False once the host can't take
+    // the channel or this loop pass has waited SERIAL_MUX_BLOCK_MS, the writer drops then.
+    bool waitForRoom(uint8_t id);
+
+    bool isActive() const;
+    unsigned long getBaud() const;
+
+    // Where a kind of output goes: its channel while framed, Serial otherwise
+    Print &output(SerialChannelId id);
+    Print &console();
+
+    // Input for the command channel, Serial while not framed
+    Stream &commandInput();
+
+    SerialChannel &channel(SerialChannelId id);
+
+    // Where GAMEPAD messages go, dropped while none is set
+    void setGamepadHandler(SerialGamepadHandler handler);
+
+    uint32_t getFramesSent() const;
+    uint32_t getBadFrames() const;
+    uint8_t getPausedMask() const;
+
+private:
+    SerialChannel _channels[SERIAL_CHANNEL_COUNT];
+    uint8_t _controlBuffer[SERIAL_MUX_CONTROL_BUFFER];
+    uint8_t _telemetryBuffer[SERIAL_MUX_TELEMETRY_BUFFER];
+    uint8_t _commandBuffer[SERIAL_MUX_COMMAND_BUFFER];
+    uint8_t _logBuffer[SERIAL_MUX_LOG_BUFFER];
+    uint8_t _commandRxBuffer[SERIAL_MUX_COMMAND_RX_BUFFER];
+
+    bool _active;
+    uint8_t _paused;
+    unsigned long _baud;
+    unsigned long _textBaud;
+    unsigned long _confirmedBaud;
+    unsigned long _confirmDeadline;
+    bool _awaitingHello;
+    bool _linkConfirmed;
+    unsigned long _waitedUs; // Spent in waitForRoom() since the last update()
+    SerialGamepadHandler _gamepadHandler;
+
+    // Frame being received
+    uint8_t _frame[SERIAL_MUX_MAX_PAYLOAD + 5];
+    size_t _frameLength;
+
+    uint32_t _framesSent;
+    uint32_t _badFrames;
+
+    // Helper methods
+    bool isHeld(uint8_t id) const;
+    void receiveBytes();
+    void handleFrame(uint8_t channel, const uint8_t *payload, size_t length, unsigned long now);
+    void handleControl(const uint8_t *payload, size_t length, unsigned long now);
+    void sendControl(uint8_t type, const uint8_t *data, size_t length);
+    void switchBaud(unsigned long baud);
+};
+
+extern SerialMux serialMux;
+
+#endif // SERIAL_MUX_H
@@ -0,0 +1,31 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// Portable SHA-256, builds the same on the ESP32 and on a Linux host
+class Sha256
+{
+public:
+    // Constructor
+    Sha256();
+
+    // Hash data in pieces, then read the digest
+    void reset();
+    void update(const uint8_t *data, size_t length);
+    void finish(uint8_t digest[SHA256_DIGEST_SIZE]);
+
+private:
+    uint32_t _state[8];
+    uint64_t _length;
+    uint8_t _block[64];
+    uint8_t _blockLength;
+
+    // Helper methods
+    void transform(const uint8_t *block);
+};
+
+#endif // SHA256_H
@@ -0,0 +1,293 @@
+#ifndef TANK_CONFIG_H
+#define TANK_CONFIG_H
+
+#include <stdint.h>
+
+/*
+ * Wiring and driving settings, checked by the compiler: a pin that can't drive a motor,
+ * a pin used twice or a PWM setup the LEDC peripheral can't produce stops the build
+ * with a message saying which setting is wrong. The stick response curve and the PWM
+ * duty table are generated from these settings at build time and live in flash.
+ */
+
+// Motor outputs, in the order TankMotors keeps them
+enum MotorOutput
+{
+    MOTOR_LEFT_FORWARD,
+    MOTOR_LEFT_BACKWARD,
+    MOTOR_RIGHT_FORWARD,
+    MOTOR_RIGHT_BACKWARD,
+    MOTOR_OUTPUT_COUNT
+};
+
+struct TankConfig
+{
+    // Pins
+    int8_t motorPins[MOTOR_OUTPUT_COUNT];
+    int8_t batterySensePin; // Through a resistor divider, -1 when not fitted
+    uint8_t batteryDividerRatio;
+
+    // IMU on I2C, -1 when not fitted
+    int8_t imuSdaPin;
+    int8_t imuSclPin;
+    int8_t imuYawSign; // -1 with the chip face up (its Z gyro counts counterclockwise), 1 face down
+
+    // PWM through the LEDC peripheral
+    uint8_t ledcChannels[MOTOR_OUTPUT_COUNT];
+    uint32_t pwmFrequency;
+    uint8_t pwmResolutionBits;
+    uint8_t motorMinDutyPercent; // Lowest duty that turns the motor, any power above 0 starts here
+
+    // Joysticks
+    int16_t stickMax;
+    int16_t stickDeadZone;
+    uint8_t stickExpoPercent; // 0 = linear, 100 = cubic (finer control at low speed)
+
+    // Analog triggers, for the trigger drive mode
+    int16_t triggerMax;
+    int16_t triggerDeadZone;
+    uint8_t triggerExpoPercent;
+
+    // Calibration buttons
+    float calibrationStep;
+    uint16_t debounceMs;
+
+    constexpr uint8_t ledcChannelFor(int pin, uint8_t output = 0) const
+    {
+        return output >= MOTOR_OUTPUT_COUNT ? 0xff
+               : motorPins[output] == pin  ? ledcChannels[output]
+                                           : ledcChannelFor(pin, output + 1);
+    }
+};
+
+constexpr TankConfig TANK_CONFIG = {
+    {33, 32, 25, 26}, // Left forward, left backward, right forward, right backward
+    -1,
+    3,
+
+    21,
+    22,
+    -1,
+
+    {0, 1, 2, 3},
+    1000,
+    8,
+    0,
+
+    512,
+    20,
+    0,
+
+    1023,
+    40,
+    50,
+
+    0.05f,
+    300,
+};
+
+// ESP32 pin capabilities
+namespace tank_config
+{
+constexpr bool isOutputPin(int pin)
+{
+    // 6-11 run the flash chip, 1 and 3 are the serial console, 34-39 are inputs only
+    return (pin >= 0 && pin <= 33) && !(pin >= 6 && pin <= 11) && pin != 1 && pin != 3 &&
+           pin != 20 && pin != 24 && !(pin >= 28 && pin <= 31);
+}
+
+constexpr bool isStrappingPin(int pin)
+{
+    // Sampled at reset to pick the boot mode and flash voltage, a motor driver could upset them
+    return pin == 0 || pin == 2 || pin == 5 || pin == 12 || pin == 15;
+}
+
+constexpr bool isAdc1Pin(int pin)
+{
+    // ADC2 can't be read while the radio is on, and the fleet link uses it
+    return pin >= 32 && pin <= 39;
+}
+
+constexpr bool allMotorPins(const TankConfig &config, bool (*check)(int), uint8_t output = 0)
+{
+    return output >= MOTOR_OUTPUT_COUNT || (check(config.motorPins[output]) && allMotorPins(config, check, output + 1));
+}
+
+constexpr bool noStrappingPins(const TankConfig &config, uint8_t output = 0)
+{
+    return output >= MOTOR_OUTPUT_COUNT ||
+           (!isStrappingPin(config.motorPins[output]) && noStrappingPins(config, output + 1));
+}
+
+constexpr bool usedAfter(const TankConfig &config, int pin, uint8_t output)
+{
+    return output < MOTOR_OUTPUT_COUNT && (config.motorPins[output] == pin || usedAfter(config, pin, output + 1));
+}
+
+constexpr bool motorPinsUnique(const TankConfig &config, uint8_t output = 0)
+{
+    return output >= MOTOR_OUTPUT_COUNT ||
+           (!usedAfter(config, config.motorPins[output], output + 1) &&
+            config.motorPins[output] != config.batterySensePin && motorPinsUnique(config, output + 1));
+}
+
+constexpr bool imuPinsValid(const TankConfig &config)
+{
+    return (config.imuSdaPin == -1 && config.imuSclPin == -1) ||
+           (isOutputPin(config.imuSdaPin) && isOutputPin(config.imuSclPin) && config.imuSdaPin != config.imuSclPin &&
+            !usedAfter(config, config.imuSdaPin, 0) && !usedAfter(config, config.imuSclPin, 0));
+}
+
+constexpr bool channelUsedAfter(const TankConfig &config, uint8_t channel, uint8_t output)
+{
+    return output < MOTOR_OUTPUT_COUNT &&
+           (config.ledcChannels[output] == channel || channelUsedAfter(config, channel, output + 1));
+}
+
+constexpr bool ledcChannelsValid(const TankConfig &config, uint8_t output = 0)
+{
+    return output >= MOTOR_OUTPUT_COUNT ||
+           (config.ledcChannels[output] < 16 && !channelUsedAfter(config, config.ledcChannels[output], output + 1) &&
+            ledcChannelsValid(config, output + 1));
+}
+
+// The LEDC counter runs from the 80MHz APB clock, so frequency x steps can't exceed it
+constexpr bool pwmFeasible(const TankConfig &config)
+{
+    return config.pwmResolutionBits >= 1 && config.pwmResolutionBits <= 16 && config.pwmFrequency > 0 &&
+           (uint64_t)config.pwmFrequency << config.pwmResolutionBits <= 80000000ULL;
+}
+
+// Magnitude 0..max to motor power 0..255, blending linear and cubic by expoPercent
+constexpr uint8_t curveResponse(uint32_t magnitude, uint32_t max, uint32_t deadZone, uint32_t expoPercent)
+{
+    return magnitude < deadZone
+               ? 0
+               : (uint8_t)(((100 - expoPercent) * (magnitude * 255 / max) +
+                            expoPercent * ((uint64_t)magnitude * magnitude * magnitude * 255 / ((uint64_t)max * max * max))) /
+                           100);
+}
+
+// Stick magnitude 0..stickMax to motor power 0..255
+constexpr uint8_t stickResponse(const TankConfig &config, uint32_t magnitude)
+{
+    return curveResponse(magnitude, config.stickMax, config.stickDeadZone, config.stickExpoPercent);
+}
+
+// Trigger position in steps of 4 (the table would gain nothing from finer steps) to motor power 0..255
+constexpr uint8_t triggerResponse(const TankConfig &config, uint32_t step)
+{
+    return curveResponse(step * 4, (config.triggerMax >> 2) * 4, config.triggerDeadZone, config.triggerExpoPercent);
+}
+
+// Motor power 0..255 to an LEDC duty at the configured resolution, lifted over the motor's dead band
+constexpr uint32_t motorDuty(const TankConfig &config, uint32_t power)
+{
+    return power == 0 ? 0
+                      : (((1UL << config.pwmResolutionBits) - 1) *
+                             (config.motorMinDutyPercent * 255 + (100 - config.motorMinDutyPercent) * power) +
+                         127 * 100) /
+                            (255 * 100);
+}
+
+// Builds a table of f(0) ... f(N - 1) at compile time (C++11, no loops in constexpr)
+template <uint16_t... I>
+struct Indices
+{
+};
+
+template <uint16_t N, uint16_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <uint16_t... I>
+struct MakeIndices<0, I...>
+{
+    typedef Indices<I...> Type;
+};
+
+template <class IndexList>
+struct StickTable;
+
+template <uint16_t... I>
+struct StickTable<Indices<I...>>
+{
+    static constexpr uint8_t values[] = {stickResponse(TANK_CONFIG, I)...};
+};
+
+template <uint16_t... I>
+constexpr uint8_t StickTable<Indices<I...>>::values[];
+
+template <class IndexList>
+struct TriggerTable;
+
+template <uint16_t... I>
+struct TriggerTable<Indices<I...>>
+{
+    static constexpr uint8_t values[] = {triggerResponse(TANK_CONFIG, I)...};
+};
+
+template <uint16_t... I>
+constexpr uint8_t TriggerTable<Indices<I...>>::values[];
+
+template <class IndexList>
+struct DutyTable;
+
+template <uint16_t... I>
+struct DutyTable<Indices<I...>>
+{
+    static constexpr uint16_t values[] = {(uint16_t)motorDuty(TANK_CONFIG, I)...};
+};
+
+template <uint16_t... I>
+constexpr uint16_t DutyTable<Indices<I...>>::values[];
+} // namespace tank_config
+
+static_assert(tank_config::allMotorPins(TANK_CONFIG, tank_config::isOutputPin),
+              "Motor pins must be output-capable GPIOs (not 1, 3, 6-11 or 34-39)");
+static_assert(tank_config::noStrappingPins(TANK_CONFIG), "Motor pins must not be strapping pins (0, 2, 5, 12, 15)");
+static_assert(tank_config::motorPinsUnique(TANK_CONFIG), "Every motor pin must be different, and not the battery pin");
+static_assert(TANK_CONFIG.batterySensePin == -1 || tank_config::isAdc1Pin(TANK_CONFIG.batterySensePin),
+              "The battery sense pin must be an ADC1 pin (32-39) or -1");
+static_assert(tank_config::imuPinsValid(TANK_CONFIG),
+              "IMU pins must be two different output-capable GPIOs that no motor uses, or both -1");
+static_assert(TANK_CONFIG.imuYawSign == 1 || TANK_CONFIG.imuYawSign == -1, "IMU yaw sign must be 1 or -1");
+static_assert(tank_config::ledcChannelsValid(TANK_CONFIG), "LEDC channels must be 0-15 and not shared");
+static_assert(tank_config::pwmFeasible(TANK_CONFIG), "PWM frequency x 2^resolution must be at most 80MHz");
+static_assert(TANK_CONFIG.motorMinDutyPercent < 100, "Minimum motor duty must be below 100%");
+static_assert(TANK_CONFIG.stickMax > 0 && TANK_CONFIG.stickMax <= 1024, "Stick range must be 1-1024");
+static_assert(TANK_CONFIG.stickDeadZone >= 0 && TANK_CONFIG.stickDeadZone < TANK_CONFIG.stickMax,
+              "The dead zone must be smaller than the stick range");
+static_assert(TANK_CONFIG.stickExpoPercent <= 100, "Stick expo is a percentage");
+static_assert(TANK_CONFIG.triggerMax >= 4 && TANK_CONFIG.triggerMax <= 1023, "Trigger range must be 4-1023");
+static_assert(TANK_CONFIG.triggerDeadZone >= 0 && TANK_CONFIG.triggerDeadZone < TANK_CONFIG.triggerMax,
+              "The trigger dead zone must be smaller than the trigger range");
+static_assert(TANK_CONFIG.triggerExpoPercent <= 100, "Trigger expo is a percentage");
+static_assert(TANK_CONFIG.calibrationStep > 0.0f && TANK_CONFIG.calibrationStep <= 0.5f,
+              "Calibration step must be between 0 and 0.5");
+
+// Lookup tables generated from TANK_CONFIG, in flash
+typedef tank_config::StickTable<tank_config::MakeIndices<TANK_CONFIG.stickMax + 1>::Type> StickResponseTable;
+typedef tank_config::TriggerTable<tank_config::MakeIndices<(TANK_CONFIG.triggerMax >> 2) + 1>::Type> TriggerResponseTable;
+typedef tank_config::DutyTable<tank_config::MakeIndices<256>::Type> MotorDutyTable;
+
+static_assert(StickResponseTable::values[TANK_CONFIG.stickMax] == 255, "Full stick must give full power");
+static_assert(TriggerResponseTable::values[TANK_CONFIG.triggerMax >> 2] == 255, "Full trigger must give full power");
+static_assert(MotorDutyTable::values[255] == (1UL << TANK_CONFIG.pwmResolutionBits) - 1,
+              "Full power must give full duty");
+
+// Stick value (any sign, any range) to motor power 0..255
+inline uint8_t stickToPower(int16_t stick)
+{
+    int32_t magnitude = stick < 0 ? -(int32_t)stick : stick;
+    return StickResponseTable::values[magnitude > TANK_CONFIG.stickMax ? TANK_CONFIG.stickMax : magnitude];
+}
+
+// Trigger value (0..triggerMax) to motor power 0..255
+inline uint8_t triggerToPower(int16_t trigger)
+{
+    return TriggerResponseTable::values[(trigger < 0 ? 0 : trigger > TANK_CONFIG.triggerMax ? TANK_CONFIG.triggerMax : trigger) >> 2];
+}
+
+#endif // TANK_CONFIG_H
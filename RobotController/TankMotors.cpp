@@ -1,7 +1,17 @@
 #include "TankMotors.h"
+#include "Metrics.h"
+#include "Tracer.h"
 
-TankMotors::TankMotors(uint8_t leftForwardPin, uint8_t leftBackwardPin,
-                       uint8_t rightForwardPin, uint8_t rightBackwardPin)
+#ifdef ARDUINO
+#include "Logger.h"
+#else
+#include <stdio.h>
+#define LOG_DETAILED(format, ...) printf(format "\n", ##__VA_ARGS__)
+#endif
+
+template <class Hal>
+BasicTankMotors<Hal>::BasicTankMotors(uint8_t leftForwardPin, uint8_t leftBackwardPin,
+                                      uint8_t rightForwardPin, uint8_t rightBackwardPin)
 {
     // Store pin assignments
     _leftForwardPin = leftForwardPin;
@@ -18,130 +28,274 @@ TankMotors::TankMotors(uint8_t leftForwardPin, uint8_t leftBackwardPin,
     // Set default calibration
     _leftCalibration = DEFAULT_LEFT_CALIBRATION;
     _rightCalibration = DEFAULT_RIGHT_CALIBRATION;
+
+    // Outputs are connected until forceOff()
+    _forceOffReasons = 0;
+    Hal::initLock(_forceOffLock);
 }
 
-void TankMotors::begin()
+template <class Hal>
+void BasicTankMotors<Hal>::begin()
 {
     // Configure pins for output
-    pinMode(_leftForwardPin, OUTPUT);
-    pinMode(_leftBackwardPin, OUTPUT);
-    pinMode(_rightForwardPin, OUTPUT);
-    pinMode(_rightBackwardPin, OUTPUT);
+    Hal::configureOutput(_leftForwardPin);
+    Hal::configureOutput(_leftBackwardPin);
+    Hal::configureOutput(_rightForwardPin);
+    Hal::configureOutput(_rightBackwardPin);
 
     // Stop all motors
     stop();
 
-    Serial.println("TankMotors initialized");
+    LOG_DETAILED("TankMotors initialized");
 }
 
-void TankMotors::leftForward(uint8_t power)
+template <class Hal>
+void BasicTankMotors<Hal>::leftForward(uint8_t power)
 {
-    _leftDirection = MOTOR_FORWARD;
+    setDirection(_leftDirection, MOTOR_FORWARD);
     _leftPower = power;
 
     uint8_t calibratedPower = power * _leftCalibration;
     applyLeftPower(calibratedPower, 0);
 }
 
-void TankMotors::leftBackward(uint8_t power)
+template <class Hal>
+void BasicTankMotors<Hal>::leftBackward(uint8_t power)
 {
-    _leftDirection = MOTOR_BACKWARD;
+    setDirection(_leftDirection, MOTOR_BACKWARD);
     _leftPower = power;
 
     uint8_t calibratedPower = power * _leftCalibration;
     applyLeftPower(0, calibratedPower);
 }
 
-void TankMotors::rightForward(uint8_t power)
+template <class Hal>
+void BasicTankMotors<Hal>::rightForward(uint8_t power)
 {
-    _rightDirection = MOTOR_FORWARD;
+    setDirection(_rightDirection, MOTOR_FORWARD);
     _rightPower = power;
 
     uint8_t calibratedPower = power * _rightCalibration;
     applyRightPower(calibratedPower, 0);
 }
 
-void TankMotors::rightBackward(uint8_t power)
+template <class Hal>
+void BasicTankMotors<Hal>::rightBackward(uint8_t power)
 {
-    _rightDirection = MOTOR_BACKWARD;
+    setDirection(_rightDirection, MOTOR_BACKWARD);
     _rightPower = power;
 
     uint8_t calibratedPower = power * _rightCalibration;
     applyRightPower(0, calibratedPower);
 }
 
-void TankMotors::leftStop()
+template <class Hal>
+void BasicTankMotors<Hal>::leftStop()
 {
-    _leftDirection = MOTOR_STOPPED;
+    setDirection(_leftDirection, MOTOR_STOPPED);
     _leftPower = 0;
 
     applyLeftPower(0, 0);
 }
 
-void TankMotors::rightStop()
+template <class Hal>
+void BasicTankMotors<Hal>::rightStop()
 {
-    _rightDirection = MOTOR_STOPPED;
+    setDirection(_rightDirection, MOTOR_STOPPED);
     _rightPower = 0;
 
     applyRightPower(0, 0);
 }
 
-void TankMotors::stop()
+template <class Hal>
+void BasicTankMotors<Hal>::stop()
 {
     leftStop();
     rightStop();
 }
 
-void TankMotors::setLeftCalibration(float calibration)
+template <class Hal>
+void BasicTankMotors<Hal>::leftBrake(uint8_t strength)
 {
-    _leftCalibration = constrain(calibration, 0.0, 1.0);
-    Serial.printf("Left motor calibration: %.2f\n", _leftCalibration);
+    if (strength == 0)
+    {
+        leftStop();
+        return;
+    }
+
+    setDirection(_leftDirection, MOTOR_BRAKING);
+    _leftPower = strength;
+
+    // Calibration evens out driving speed, braking force doesn't need it
+    applyLeftPower(strength, strength);
+}
+
+template <class Hal>
+void BasicTankMotors<Hal>::rightBrake(uint8_t strength)
+{
+    if (strength == 0)
+    {
+        rightStop();
+        return;
+    }
+
+    setDirection(_rightDirection, MOTOR_BRAKING);
+    _rightPower = strength;
+
+    applyRightPower(strength, strength);
 }
 
-void TankMotors::setRightCalibration(float calibration)
+template <class Hal>
+void BasicTankMotors<Hal>::brake(uint8_t strength)
 {
-    _rightCalibration = constrain(calibration, 0.0, 1.0);
-    Serial.printf("Right motor calibration: %.2f\n", _rightCalibration);
+    leftBrake(strength);
+    rightBrake(strength);
 }
 
-float TankMotors::getLeftCalibration() const
+template <class Hal>
+void BasicTankMotors<Hal>::setLeftCalibration(float calibration)
+{
+    _leftCalibration = clampCalibration(calibration);
+    if (_leftCalibration != calibration)
+        metrics.count(METRIC_MOTOR_CLAMPS);
+    logCalibration("Left", _leftCalibration);
+}
+
+template <class Hal>
+void BasicTankMotors<Hal>::setRightCalibration(float calibration)
+{
+    _rightCalibration = clampCalibration(calibration);
+    if (_rightCalibration != calibration)
+        metrics.count(METRIC_MOTOR_CLAMPS);
+    logCalibration("Right", _rightCalibration);
+}
+
+template <class Hal>
+float BasicTankMotors<Hal>::getLeftCalibration() const
 {
     return _leftCalibration;
 }
 
-float TankMotors::getRightCalibration() const
+template <class Hal>
+float BasicTankMotors<Hal>::getRightCalibration() const
 {
     return _rightCalibration;
 }
 
-MotorDirection TankMotors::getLeftDirection() const
+template <class Hal>
+MotorDirection BasicTankMotors<Hal>::getLeftDirection() const
 {
     return _leftDirection;
 }
 
-MotorDirection TankMotors::getRightDirection() const
+template <class Hal>
+MotorDirection BasicTankMotors<Hal>::getRightDirection() const
 {
     return _rightDirection;
 }
 
-uint8_t TankMotors::getLeftPower() const
+template <class Hal>
+uint8_t BasicTankMotors<Hal>::getLeftPower() const
 {
     return _leftPower;
 }
 
-uint8_t TankMotors::getRightPower() const
+template <class Hal>
+uint8_t BasicTankMotors<Hal>::getRightPower() const
 {
     return _rightPower;
 }
 
-void TankMotors::applyLeftPower(uint8_t forwardPower, uint8_t backwardPower)
+template <class Hal>
+void IRAM_ATTR BasicTankMotors<Hal>::forceOff(uint8_t reason)
 {
-    analogWrite(_leftForwardPin, forwardPower);
-    analogWrite(_leftBackwardPin, backwardPower);
+    Hal::lockFromIsr(_forceOffLock);
+    if (_forceOffReasons == 0)
+    {
+        Hal::disconnect(_leftForwardPin, _savedOutputSignal[0]);
+        Hal::disconnect(_leftBackwardPin, _savedOutputSignal[1]);
+        Hal::disconnect(_rightForwardPin, _savedOutputSignal[2]);
+        Hal::disconnect(_rightBackwardPin, _savedOutputSignal[3]);
+    }
+    _forceOffReasons |= reason;
+    Hal::unlockFromIsr(_forceOffLock);
 }
 
-void TankMotors::applyRightPower(uint8_t forwardPower, uint8_t backwardPower)
+template <class Hal>
+void BasicTankMotors<Hal>::restoreOutputs(uint8_t reason)
 {
-    analogWrite(_rightForwardPin, forwardPower);
-    analogWrite(_rightBackwardPin, backwardPower);
-}
\ No newline at end of file
+    if ((_forceOffReasons & reason) == 0)
+        return;
+
+    // Zero the PWM duty first so the motors don't resume their last power
+    stop();
+
+    Hal::lock(_forceOffLock);
+    _forceOffReasons &= ~reason;
+    if (_forceOffReasons == 0)
+    {
+        Hal::reconnect(_leftForwardPin, _savedOutputSignal[0]);
+        Hal::reconnect(_leftBackwardPin, _savedOutputSignal[1]);
+        Hal::reconnect(_rightForwardPin, _savedOutputSignal[2]);
+        Hal::reconnect(_rightBackwardPin, _savedOutputSignal[3]);
+    }
+    Hal::unlock(_forceOffLock);
+}
+
+template <class Hal>
+bool BasicTankMotors<Hal>::isForcedOff() const
+{
+    return _forceOffReasons != 0;
+}
+
+template <class Hal>
+void BasicTankMotors<Hal>::setDirection(MotorDirection &current, MotorDirection direction)
+{
+    if (current != direction)
+        metrics.count(METRIC_MOTOR_DIRECTION_CHANGES);
+    current = direction;
+}
+
+template <class Hal>
+void BasicTankMotors<Hal>::applyLeftPower(uint8_t forwardPower, uint8_t backwardPower)
+{
+    TRACE_SCOPE(MOTOR_WRITE);
+    Hal::writeDuty(_leftForwardPin, forwardPower);
+    Hal::writeDuty(_leftBackwardPin, backwardPower);
+    metrics.count(METRIC_MOTOR_WRITES, 2);
+}
+
+template <class Hal>
+void BasicTankMotors<Hal>::applyRightPower(uint8_t forwardPower, uint8_t backwardPower)
+{
+    TRACE_SCOPE(MOTOR_WRITE);
+    Hal::writeDuty(_rightForwardPin, forwardPower);
+    Hal::writeDuty(_rightBackwardPin, backwardPower);
+    metrics.count(METRIC_MOTOR_WRITES, 2);
+}
+
+template <class Hal>
+float BasicTankMotors<Hal>::clampCalibration(float calibration)
+{
+    return calibration < 0.0f ? 0.0f : (calibration > 1.0f ? 1.0f : calibration);
+}
+
+template <class Hal>
+void BasicTankMotors<Hal>::logCalibration(const char *side, float calibration)
+{
+#if TANK_SIZE_OPTIMIZED
+    // Keep float formatting out of the size-optimized build
+    LOG_DETAILED("%s motor calibration: %d%%", side, (int)(calibration * 100 + 0.5f));
+#else
+    LOG_DETAILED("%s motor calibration: %.2f", side, calibration);
+#endif
+}
+
+// Only the policy this firmware is built with
+template class BasicTankMotors<TANK_MOTOR_HAL>;
+
+#ifdef ARDUINO
+// Pins and other settings are in TankConfig.h
+TankMotors motors(TANK_CONFIG.motorPins[MOTOR_LEFT_FORWARD], TANK_CONFIG.motorPins[MOTOR_LEFT_BACKWARD],
+                  TANK_CONFIG.motorPins[MOTOR_RIGHT_FORWARD], TANK_CONFIG.motorPins[MOTOR_RIGHT_BACKWARD]);
+#endif
@@ -1,27 +1,45 @@
 #ifndef TANK_MOTORS_H
 #define TANK_MOTORS_H
 
-#include <Arduino.h>
+#include "MotorHal.h"
 
 // Motor direction enum
 enum MotorDirection
 {
     MOTOR_FORWARD,
     MOTOR_BACKWARD,
-    MOTOR_STOPPED
+    MOTOR_STOPPED,
+    MOTOR_BRAKING
 };
 
+// Reasons for cutting the outputs, outputs reconnect once all are cleared
+#define FORCE_OFF_WATCHDOG 0x01
+#define FORCE_OFF_FAILSAFE 0x02
+#define FORCE_OFF_TILT 0x04
+
 // Default settings
 #define DEFAULT_LEFT_CALIBRATION 1.0
 #define DEFAULT_RIGHT_CALIBRATION 1.0
 #define DEFAULT_MOTOR_DEBUG_ENABLED false
 
-class TankMotors
+// Hardware policy the firmware's TankMotors is built with, see MotorHal.h
+#ifndef TANK_MOTOR_HAL
+#ifdef ARDUINO
+#define TANK_MOTOR_HAL LedcMotorHal
+#else
+#define TANK_MOTOR_HAL MockMotorHal
+#endif
+#endif
+
+// Tank drive over four H-bridge inputs. The Hal policy does every hardware access, so the
+// same class drives LEDC PWM, plain GPIO or a host mock with the writes inlined.
+template <class Hal>
+class BasicTankMotors
 {
 public:
     // Constructor
-    TankMotors(uint8_t leftForwardPin, uint8_t leftBackwardPin,
-               uint8_t rightForwardPin, uint8_t rightBackwardPin);
+    BasicTankMotors(uint8_t leftForwardPin, uint8_t leftBackwardPin,
+                    uint8_t rightForwardPin, uint8_t rightBackwardPin);
 
     // Initialize motors
     void begin();
@@ -35,6 +53,12 @@ public:
     void rightStop();
     void stop();
 
+    // Active braking: both bridge inputs driven together short the motor for part of each
+    // PWM period, so strength 0..255 sets how hard it brakes (0 is the same as stopping)
+    void leftBrake(uint8_t strength);
+    void rightBrake(uint8_t strength);
+    void brake(uint8_t strength);
+
     // Calibration
     void setLeftCalibration(float calibration);
     void setRightCalibration(float calibration);
@@ -44,9 +68,16 @@ public:
     // Get motor state
     MotorDirection getLeftDirection() const;
     MotorDirection getRightDirection() const;
-    uint8_t getLeftPower() const;
+    uint8_t getLeftPower() const; // Brake strength while braking
     uint8_t getRightPower() const;
 
+    // Emergency output cut at the register level, safe to call from an interrupt
+    void IRAM_ATTR forceOff(uint8_t reason);
+
+    // Clear a reason and reconnect the PWM outputs when none remain, motors stay stopped
+    void restoreOutputs(uint8_t reason);
+    bool isForcedOff() const;
+
 private:
     // Motor pins
     uint8_t _leftForwardPin;
@@ -64,9 +95,23 @@ private:
     float _leftCalibration;
     float _rightCalibration;
 
+    // Output routing saved by forceOff(), in pin order LF, LB, RF, RB
+    uint32_t _savedOutputSignal[4];
+    volatile uint8_t _forceOffReasons;
+    typename Hal::Lock _forceOffLock;
+
     // Helper methods
+    static void setDirection(MotorDirection &current, MotorDirection direction);
     void applyLeftPower(uint8_t forwardPower, uint8_t backwardPower);
     void applyRightPower(uint8_t forwardPower, uint8_t backwardPower);
+    static float clampCalibration(float calibration);
+    static void logCalibration(const char *side, float calibration);
 };
 
+typedef BasicTankMotors<TANK_MOTOR_HAL> TankMotors;
+
+#ifdef ARDUINO
+extern TankMotors motors;
+#endif
+
 #endif // TANK_MOTORS_H
\ No newline at end of file
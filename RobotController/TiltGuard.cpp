@@ -0,0 +1,230 @@
+#include "TiltGuard.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include <math.h>
+
+#define TILT_RAD_TO_DEG 57.29578f
+
+// When the outputs went off. The host simulation has no clock of its own, so there the
+// cut takes effect at the time of the sample that caused it.
+static inline uint32_t tiltCutTimeUs(const ImuReading &reading)
+{
+#ifdef ARDUINO
+    return micros();
+#else
+    return reading.timeUs;
+#endif
+}
+
+#ifdef ARDUINO
+TiltGuard tiltGuard;
+#endif
+
+TiltGuard::TiltGuard()
+{
+    _motors = nullptr;
+    _enabled = true;
+
+    _pitch = 0.0f;
+    _roll = 0.0f;
+    _settled = false;
+    _lastSampleUs = 0;
+    _uprightSinceUs = 0;
+    _upright = true;
+    _powerLimit = 256;
+
+    _tripped = false;
+    _tripCount = 0;
+    _lastCutLatencyUs = 0;
+    _maxCutLatencyUs = 0;
+    _reportedTripped = false;
+}
+
+void TiltGuard::begin(TankMotors &motors)
+{
+    _motors = &motors;
+}
+
+void TiltGuard::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+    if (!enabled)
+        _powerLimit = 256;
+}
+
+bool TiltGuard::isEnabled() const
+{
+    return _enabled;
+}
+
+void TiltGuard::check(const ImuReading &reading)
+{
+    uint32_t previousSampleUs = _lastSampleUs;
+    followAngles(reading);
+
+    float pitch = fabsf(_pitch);
+    float roll = fabsf(_roll);
+    if (!_enabled)
+        return;
+
+    if ((pitch >= TILT_CUT_PITCH_DEG || roll >= TILT_CUT_ROLL_DEG) && cut())
+    {
+        // The crossing happened after the last sample that was still under the angle
+        uint32_t latency = tiltCutTimeUs(reading) - (previousSampleUs != 0 ? previousSampleUs : reading.timeUs);
+        _lastCutLatencyUs = latency;
+        if (latency > _maxCutLatencyUs)
+            _maxCutLatencyUs = latency;
+        metrics.observe(METRIC_TILT_CUT_LATENCY, latency);
+        if (latency + IMU_FILTER_DELAY_US > TILT_MAX_CUT_LATENCY_US)
+            metrics.count(METRIC_TILT_LATE_CUTS);
+        return;
+    }
+
+    // Past the warn angle the cap falls in a straight line to the floor at the cut angle
+    float pitchShare = (pitch - TILT_WARN_PITCH_DEG) / (TILT_CUT_PITCH_DEG - TILT_WARN_PITCH_DEG);
+    float rollShare = (roll - TILT_WARN_ROLL_DEG) / (TILT_CUT_ROLL_DEG - TILT_WARN_ROLL_DEG);
+    float share = pitchShare > rollShare ? pitchShare : rollShare;
+    if (share <= 0.0f)
+        _powerLimit = 256;
+    else
+        _powerLimit = 256 - (uint16_t)((share < 1.0f ? share : 1.0f) * (256 - TILT_LIMIT_FLOOR));
+}
+
+bool TiltGuard::update(uint32_t nowUs)
+{
+    if (_motors != nullptr)
+    {
+        // Without samples the guard is blind, which is as bad as being over. Signed, as the
+        // IMU task may have stored a sample after nowUs was taken.
+        bool fresh = (int32_t)(nowUs - _lastSampleUs) <= (int32_t)(TILT_STALE_MS * 1000L);
+        if (_enabled && _settled && !fresh)
+            cut();
+
+        // Back on its tracks for a while (or protection turned off): motors return, stopped.
+        // Cleared only after the restore, so a cut racing it can't be undone; it just waits
+        // for the next sample.
+        if (isTripped() && ((_upright && fresh) || !_enabled))
+        {
+            _motors->restoreOutputs(FORCE_OFF_TILT);
+            __atomic_store_n(&_tripped, false, __ATOMIC_RELEASE);
+        }
+    }
+
+    bool tripped = isTripped();
+    bool changed = tripped != _reportedTripped;
+    _reportedTripped = tripped;
+    return changed;
+}
+
+int16_t TiltGuard::limitPower(int16_t power) const
+{
+    return (int32_t)power * _powerLimit / 256;
+}
+
+uint16_t TiltGuard::getPowerLimit() const
+{
+    return _powerLimit;
+}
+
+float TiltGuard::getPitch() const
+{
+    return _pitch;
+}
+
+float TiltGuard::getRoll() const
+{
+    return _roll;
+}
+
+bool TiltGuard::isTripped() const
+{
+    return __atomic_load_n(&_tripped, __ATOMIC_ACQUIRE);
+}
+
+uint32_t TiltGuard::getTripCount() const
+{
+    return _tripCount;
+}
+
+uint32_t TiltGuard::getLastCutLatencyUs() const
+{
+    return _lastCutLatencyUs;
+}
+
+uint32_t TiltGuard::getMaxCutLatencyUs() const
+{
+    return _maxCutLatencyUs;
+}
+
+void TiltGuard::followAngles(const ImuReading &reading)
+{
+    // Gravity as the accelerometer sees it. With X forward and Z up, a raised nose tips
+    // gravity towards +X and a raised left side towards +Y.
+    float ax = reading.accel[IMU_X];
+    float ay = reading.accel[IMU_Y];
+    float az = reading.accel[IMU_Z];
+    float accelPitch = atan2f(ax, sqrtf(ay * ay + az * az)) * TILT_RAD_TO_DEG;
+    float accelRoll = atan2f(ay, az) * TILT_RAD_TO_DEG;
+
+    if (!_settled)
+    {
+        _pitch = accelPitch;
+        _roll = accelRoll;
+        _settled = true;
+        _lastSampleUs = reading.timeUs;
+        _uprightSinceUs = reading.timeUs;
+        return;
+    }
+
+    // A long gap (bus errors) would integrate one stale rate for too long
+    float dt = (reading.timeUs - _lastSampleUs) * 1e-6f;
+    if (dt > TILT_STALE_MS * 1e-3f)
+        dt = TILT_STALE_MS * 1e-3f;
+    _lastSampleUs = reading.timeUs;
+
+    // Right-handed about each axis: nose up is negative Y rotation, left side up is positive X
+    float pitch = _pitch - reading.gyro[IMU_Y] * (10.0f / IMU_GYRO_LSB_PER_DPS_X10) * dt;
+    float roll = _roll + reading.gyro[IMU_X] * (10.0f / IMU_GYRO_LSB_PER_DPS_X10) * dt;
+
+    // Braking, bumps and hard starts add to gravity, then only the gyro is believed
+    float accelSquared = (ax * ax + ay * ay + az * az) / ((float)IMU_ACCEL_LSB_PER_G * IMU_ACCEL_LSB_PER_G);
+    float low = 1.0f - TILT_ACCEL_TRUST_PERCENT / 100.0f;
+    float high = 1.0f + TILT_ACCEL_TRUST_PERCENT / 100.0f;
+    if (accelSquared > low * low && accelSquared < high * high)
+    {
+        float weight = dt * 1000.0f / TILT_FILTER_TAU_MS;
+        float rollGap = accelRoll - roll;
+        if (rollGap > 180.0f)
+            rollGap -= 360.0f;
+        else if (rollGap < -180.0f)
+            rollGap += 360.0f;
+        pitch += (accelPitch - pitch) * weight;
+        roll += rollGap * weight;
+    }
+    if (roll > 180.0f)
+        roll -= 360.0f;
+    else if (roll < -180.0f)
+        roll += 360.0f;
+    _pitch = pitch;
+    _roll = roll;
+
+    if (fabsf(pitch) >= TILT_CLEAR_DEG || fabsf(roll) >= TILT_CLEAR_DEG)
+        _uprightSinceUs = reading.timeUs;
+    _upright = reading.timeUs - _uprightSinceUs >= TILT_CLEAR_MS * 1000UL;
+}
+
+bool TiltGuard::cut()
+{
+    // Both tasks may get here for the same trip, only the first one counts it
+    bool expected = false;
+    if (!__atomic_compare_exchange_n(&_tripped, &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return false;
+
+    _upright = false;
+    if (_motors != nullptr)
+        _motors->forceOff(FORCE_OFF_TILT);
+    _tripCount++;
+    metrics.count(METRIC_TILT_TRIPS);
+    TRACE_INSTANT(TILT_TRIP);
+    return true;
+}
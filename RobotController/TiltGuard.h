@@ -0,0 +1,96 @@
+#ifndef TILT_GUARD_H
+#define TILT_GUARD_H
+
+#include "Imu.h"
+#include "TankMotors.h"
+
+// Default settings
+#define TILT_WARN_PITCH_DEG 20         // Nose up or down: power starts to be limited here
+#define TILT_CUT_PITCH_DEG 35          // ...and cut here
+#define TILT_WARN_ROLL_DEG 15          // Leaning sideways tips over sooner
+#define TILT_CUT_ROLL_DEG 28
+#define TILT_CLEAR_DEG 10              // Both angles back under this before the motors return
+#define TILT_CLEAR_MS 1000             // ...for this long
+#define TILT_LIMIT_FLOOR 64            // Power cap (/256) just before the cut angle
+#define TILT_FILTER_TAU_MS 1000        // Accelerometer pulls the gyro's angles over about this long
+#define TILT_ACCEL_TRUST_PERCENT 10    // Only trust the accelerometer within 10% of 1g
+#define TILT_STALE_MS 50               // No samples for this long cuts the motors too
+#define TILT_MAX_CUT_LATENCY_US 10000  // Budget from crossing the cut angle to outputs off, sensor included
+
+/*
+ * Rollover protection. A complementary filter follows pitch and roll: the gyro gives the
+ * angles without lag, the accelerometer's view of gravity slowly pulls them back so they
+ * can't drift, and it is ignored while the tank shakes or speeds up hard. Between the warn
+ * and cut angles the tracks' power is capped, falling to a quarter, so the driver can't
+ * accelerate the nose further up a ramp. Past the cut angle the outputs are cut at the
+ * register level, like the watchdog does, straight from the IMU task.
+ *
+ * The time from the last sample still under the angle to the outputs going off is
+ * measured on every cut: it covers the crossing itself, which happened somewhere between
+ * the two samples, and the work to act on it. Before that, the sensor's own low-pass
+ * filter held the sample back by IMU_FILTER_DELAY_US, which no clock here can see, so it
+ * is added before the time is held against the budget. The IMU's X axis must point
+ * forward.
+ */
+class TiltGuard
+{
+public:
+    // Constructor
+    TiltGuard();
+
+    // Set up with the motors to cut, the filter runs from the first sample
+    void begin(TankMotors &motors);
+
+    // Protection on or off, the angles are followed either way
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    // IMU task: one sample in, cuts the outputs when it is past the cut angle
+    void check(const ImuReading &reading);
+
+    // Loop task: cut when the samples stop, reconnect once upright for a while. Returns
+    // true when the guard tripped or cleared since the last call.
+    bool update(uint32_t nowUs);
+
+    // Cap a track power while tilted (-255..255)
+    int16_t limitPower(int16_t power) const;
+    uint16_t getPowerLimit() const; // 256 = full power
+
+    float getPitch() const; // Degrees, nose up positive
+    float getRoll() const;  // Degrees, left side up positive
+    bool isTripped() const;
+    uint32_t getTripCount() const;
+    uint32_t getLastCutLatencyUs() const;
+    uint32_t getMaxCutLatencyUs() const;
+
+private:
+    TankMotors *_motors;
+    volatile bool _enabled;
+
+    // Filter state, written by the IMU task only
+    volatile float _pitch;
+    volatile float _roll;
+    volatile bool _settled; // First sample seen, angles started from the accelerometer
+    volatile uint32_t _lastSampleUs;
+    uint32_t _uprightSinceUs;
+    volatile bool _upright; // Under TILT_CLEAR_DEG for TILT_CLEAR_MS
+    volatile uint16_t _powerLimit;
+
+    // Trip state, set by either task, cleared by the loop only. _tripped goes through
+    // __atomic builtins so a trip is only taken once.
+    bool _tripped;
+    volatile uint32_t _tripCount;
+    volatile uint32_t _lastCutLatencyUs;
+    volatile uint32_t _maxCutLatencyUs;
+    bool _reportedTripped;
+
+    // Helper methods
+    void followAngles(const ImuReading &reading);
+    bool cut(); // False when the other task already tripped
+};
+
+#ifdef ARDUINO
+extern TiltGuard tiltGuard;
+#endif
+
+#endif // TILT_GUARD_H
@@ -0,0 +1,73 @@
+#include "Tracer.h"
+
+#if TANK_TRACING
+
+#ifdef ARDUINO
+#include "SerialMux.h"
+#define TRACE_PRINTF serialMux.console().printf
+#else
+#include <stdio.h>
+#define TRACE_PRINTF printf
+#endif
+
+#define TRACE_NAME(id, name) name,
+
+static const char *const TRACE_NAMES[] = {TANK_TRACE_NAMES(TRACE_NAME)};
+static const char TRACE_PHASE_LETTERS[] = {'B', 'E', 'I'};
+
+Tracer tracer;
+
+Tracer::Tracer()
+{
+    _head = 0;
+    _enabled = false;
+}
+
+void Tracer::start()
+{
+    _enabled = false;
+    __atomic_store_n(&_head, 0, __ATOMIC_RELAXED);
+    _enabled = true;
+}
+
+void Tracer::stop()
+{
+    _enabled = false;
+}
+
+bool Tracer::isEnabled() const
+{
+    return _enabled;
+}
+
+uint32_t Tracer::getRecorded() const
+{
+    return __atomic_load_n(&_head, __ATOMIC_RELAXED);
+}
+
+void Tracer::dump()
+{
+    // Printing would trace itself and overwrite what we are printing
+    stop();
+
+    uint32_t head = getRecorded();
+    uint32_t count = head < TRACE_BUFFER_EVENTS ? head : TRACE_BUFFER_EVENTS;
+
+    TRACE_PRINTF("trace %d %lu %lu\n", TRACE_DUMP_VERSION, (unsigned long)count, (unsigned long)(head - count));
+
+    for (uint8_t i = 0; i < TRACE_NAME_COUNT; i++)
+        TRACE_PRINTF("n %u %s\n", i, TRACE_NAMES[i]);
+
+    for (uint32_t i = head - count; i != head; i++)
+    {
+        const TraceEvent &event = _events[i & (TRACE_BUFFER_EVENTS - 1)];
+        if (event.phase > TRACE_PHASE_INSTANT)
+            continue;
+        TRACE_PRINTF("%lu %u %c %u\n", (unsigned long)event.time, event.core, TRACE_PHASE_LETTERS[event.phase],
+                     event.id);
+    }
+
+    TRACE_PRINTF("end\n");
+}
+
+#endif // TANK_TRACING
@@ -0,0 +1,169 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#else
+#include <stdint.h>
+#include <time.h>
+#endif
+
+// Size-optimized build profile, set with -DTANK_SIZE_OPTIMIZED=1 (see tools/build.sh)
+#ifndef TANK_SIZE_OPTIMIZED
+#define TANK_SIZE_OPTIMIZED 0
+#endif
+
+// Trace event capture, compiled out of size-optimized (release) builds. The TRACE_* macros
+// then expand to nothing, so instrumented code carries no cost at all.
+#ifndef TANK_TRACING
+#if TANK_SIZE_OPTIMIZED
+#define TANK_TRACING 0
+#else
+#define TANK_TRACING 1
+#endif
+#endif
+
+/*
+ * Every traced span or instant is declared here; tools/trace_chrome.py gets the names from
+ * the dump, so adding one needs no change on the host.
+ */
+#define TANK_TRACE_NAMES(X) \
+    X(LOOP, "loop") \
+    X(BP32_UPDATE, "BP32.update") \
+    X(PROCESS_CONTROLLER, "processController") \
+    X(MOTOR_WRITE, "motor PWM write") \
+    X(SERIAL, "serial") \
+    X(FLEET, "fleet") \
+    X(POWER, "power") \
+    X(FAILSAFE_TRIP, "failsafe trip") \
+    X(WATCHDOG_TRIP, "watchdog trip") \
+    X(TILT_TRIP, "tilt trip")
+
+#define TRACE_ID(id, name) TRACE_##id,
+
+enum TraceId
+{
+    TANK_TRACE_NAMES(TRACE_ID) TRACE_NAME_COUNT
+};
+
+// Event phases, as in the Chrome trace format
+enum TracePhase
+{
+    TRACE_PHASE_BEGIN,
+    TRACE_PHASE_END,
+    TRACE_PHASE_INSTANT
+};
+
+// Default settings
+#define TRACE_BUFFER_EVENTS 1024 // Power of two, older events are overwritten
+#define TRACE_DUMP_VERSION 1
+
+// Shared microsecond clock, the same on both cores (the cycle counters are not)
+static inline uint32_t traceMicros()
+{
+#ifdef ARDUINO
+    return (uint32_t)esp_timer_get_time();
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint32_t)(time.tv_sec * 1000000ULL + time.tv_nsec / 1000);
+#endif
+}
+
+static inline uint8_t traceCore()
+{
+#ifdef ARDUINO
+    return xPortGetCoreID();
+#else
+    return 0;
+#endif
+}
+
+struct TraceEvent
+{
+    uint32_t time; // traceMicros()
+    uint8_t id;    // TraceId
+    uint8_t phase; // TracePhase
+    uint8_t core;
+};
+
+// Flight recorder for the last TRACE_BUFFER_EVENTS events, switched on at runtime
+class Tracer
+{
+public:
+    // Constructor
+    Tracer();
+
+    // Lock-free, safe from interrupts and either core
+    __attribute__((always_inline)) inline void record(TraceId id, TracePhase phase)
+    {
+        if (!_enabled)
+            return;
+
+        uint32_t index = __atomic_fetch_add(&_head, 1, __ATOMIC_RELAXED);
+        TraceEvent &event = _events[index & (TRACE_BUFFER_EVENTS - 1)];
+        event.time = traceMicros();
+        event.id = id;
+        event.phase = phase;
+        event.core = traceCore();
+    }
+
+    // Start with an empty buffer, or stop and keep what was captured
+    void start();
+    void stop();
+
+    bool isEnabled() const;
+    uint32_t getRecorded() const;
+
+    // Stop and print the buffer, converted by tools/trace_chrome.py:
+    //   trace <version> <events> <overwritten>
+    //   n <id> <name>
+    //   <time us> <core> <phase B/E/I> <id>
+    //   end
+    void dump();
+
+private:
+    TraceEvent _events[TRACE_BUFFER_EVENTS];
+    uint32_t _head; // Events recorded since start()
+    volatile bool _enabled;
+};
+
+// Ends a span when it goes out of scope
+class TraceScope
+{
+public:
+    // Constructor
+    TraceScope(Tracer &tracer, TraceId id) : _tracer(tracer), _id(id)
+    {
+        _tracer.record(_id, TRACE_PHASE_BEGIN);
+    }
+
+    ~TraceScope()
+    {
+        _tracer.record(_id, TRACE_PHASE_END);
+    }
+
+private:
+    Tracer &_tracer;
+    TraceId _id;
+};
+
+#if TANK_TRACING
+extern Tracer tracer;
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_BEGIN(id) tracer.record(TRACE_##id, TRACE_PHASE_BEGIN)
+#define TRACE_END(id) tracer.record(TRACE_##id, TRACE_PHASE_END)
+#define TRACE_INSTANT(id) tracer.record(TRACE_##id, TRACE_PHASE_INSTANT)
+#define TRACE_SCOPE(id) TraceScope TRACE_CONCAT(traceScope, __LINE__)(tracer, TRACE_##id)
+#else
+#define TRACE_BEGIN(id) do {} while (0)
+#define TRACE_END(id) do {} while (0)
+#define TRACE_INSTANT(id) do {} while (0)
+#define TRACE_SCOPE(id) do {} while (0)
+#endif
+
+#endif // TRACER_H
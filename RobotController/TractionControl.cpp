@@ -0,0 +1,150 @@
+#include "TractionControl.h"
+#include "Metrics.h"
+
+// Forward speed gained per tick by one accelerometer LSB, mm/s << 16
+#define TRACTION_ACCEL_GAIN_Q16 ((9807LL * TRACTION_PERIOD_US << 16) / (IMU_ACCEL_LSB_PER_G * 1000000LL))
+
+// Gravity tipped onto X per tick by one gyro LSB of pitch rate, accelerometer LSB << 16.
+// Small angles: a few percent short at the tilt guard's warn angle.
+#define TRACTION_PITCH_GAIN_Q16                                                                                        \
+    (((int64_t)IMU_ACCEL_LSB_PER_G * 31416 * 10 * TRACTION_PERIOD_US << 16) /                                          \
+     (180LL * 10000 * IMU_GYRO_LSB_PER_DPS_X10 * 1000000))
+
+#ifdef ARDUINO
+TractionControl tractionControl;
+#endif
+
+TractionControl::TractionControl()
+{
+    _accelBias = 0;
+    _slips[LEFT] = 0;
+    _slips[RIGHT] = 0;
+    reset();
+}
+
+bool TractionControl::update(int16_t leftPower, int16_t rightPower, const ImuReading &reading, int16_t yawRate)
+{
+    int16_t powers[TRACKS] = {leftPower, rightPower};
+    for (uint8_t track = 0; track < TRACKS; track++)
+        _model[track] += (((int32_t)powers[track] * TRACTION_FULL_SPEED_MMS << 8) / 255 - _model[track]) >> TRACTION_MOTOR_LAG_SHIFT;
+
+    // Parked and settled: whatever the accelerometer reads now is its zero
+    int32_t accel = (int32_t)reading.accel[IMU_X] << 8;
+    if (leftPower == 0 && rightPower == 0 && _model[LEFT] >> 8 == 0 && _model[RIGHT] >> 8 == 0)
+    {
+        _accelBias += (accel - _accelBias) >> TRACTION_BIAS_SHIFT;
+        _gravity = 0;
+        _bodySpeed = 0;
+        _driftRate = 0;
+        return false;
+    }
+
+    // Nose up is negative about Y and tips gravity towards +X. The slope moves over into the
+    // drift estimate a little every tick, so the gyro's own drift can't add up.
+    bool gripping = !_slipping[LEFT] && !_slipping[RIGHT];
+    if (gripping)
+    {
+        _gravity -= reading.gyro[IMU_Y] * (int32_t)TRACTION_PITCH_GAIN_Q16;
+        int32_t handover = _gravity >> TRACTION_TILT_SHIFT;
+        _gravity -= handover;
+        _driftRate -= (int32_t)(handover * TRACTION_ACCEL_GAIN_Q16 >> 16);
+    }
+    int32_t forward = accel - _accelBias - (_gravity >> 8);
+
+    // The tank's speed from the accelerometer, held near the model so drift can't build up,
+    // except while a track slips and the model runs ahead of the ground
+    _bodySpeed += (int32_t)(forward * TRACTION_ACCEL_GAIN_Q16 >> 16) + (_driftRate >> 8);
+    if (gripping)
+    {
+        int32_t error = (_model[LEFT] + _model[RIGHT]) / 2 - _bodySpeed;
+        _bodySpeed += error >> TRACTION_DRIFT_SHIFT;
+        _driftRate += error >> (TRACTION_SLOPE_SHIFT - 8);
+    }
+    else
+        _bodySpeed -= _bodySpeed >> TRACTION_STUCK_SHIFT;
+
+    // How much faster the left side moves than the middle when turning clockwise
+    int32_t sideSpeed = (int32_t)((int64_t)yawRate * 10 * 31416 * TRACTION_TRACK_WIDTH_MM /
+                                  ((int64_t)IMU_GYRO_LSB_PER_DPS_X10 * 180 * 10000 * 2));
+
+    bool leftChanged = judgeTrack(LEFT, (_bodySpeed >> 8) + sideSpeed);
+    bool rightChanged = judgeTrack(RIGHT, (_bodySpeed >> 8) - sideSpeed);
+    return leftChanged || rightChanged;
+}
+
+bool TractionControl::judgeTrack(uint8_t track, int32_t groundSpeed)
+{
+    if (_holdTicks[track] > 0)
+        _holdTicks[track]--;
+
+    // Only running ahead of the ground in the direction the track turns counts
+    int32_t trackSpeed = _model[track] >> 8;
+    int32_t direction = trackSpeed < 0 ? -1 : 1;
+    int32_t slip = (trackSpeed - groundSpeed) * direction;
+    bool slipping = slip > TRACTION_MIN_SLIP_MMS && slip * 100 > trackSpeed * direction * TRACTION_SLIP_PERCENT;
+    _slipping[track] = slipping;
+
+    if (!slipping)
+    {
+        if (_limit[track] == 256)
+            return false;
+        _limit[track] += TRACTION_RECOVERY_STEP;
+        if (_limit[track] > 256)
+            _limit[track] = 256;
+        return true;
+    }
+
+    if (_holdTicks[track] > 0 || _limit[track] == TRACTION_LIMIT_FLOOR)
+        return false;
+    _limit[track] = _limit[track] * 3 / 4;
+    if (_limit[track] < TRACTION_LIMIT_FLOOR)
+        _limit[track] = TRACTION_LIMIT_FLOOR;
+    _holdTicks[track] = TRACTION_HOLD_TICKS;
+    _slips[track]++;
+    metrics.count(METRIC_TRACTION_SLIPS);
+    return true;
+}
+
+int16_t TractionControl::limitLeft(int16_t power) const
+{
+    return (int32_t)power * _limit[LEFT] / 256;
+}
+
+int16_t TractionControl::limitRight(int16_t power) const
+{
+    return (int32_t)power * _limit[RIGHT] / 256;
+}
+
+void TractionControl::reset()
+{
+    for (uint8_t track = 0; track < TRACKS; track++)
+    {
+        _model[track] = 0;
+        _holdTicks[track] = 0;
+        _limit[track] = 256;
+        _slipping[track] = false;
+    }
+    _gravity = 0;
+    _bodySpeed = 0;
+    _driftRate = 0;
+}
+
+uint16_t TractionControl::getLeftLimit() const
+{
+    return _limit[LEFT];
+}
+
+uint16_t TractionControl::getRightLimit() const
+{
+    return _limit[RIGHT];
+}
+
+uint32_t TractionControl::getLeftSlips() const
+{
+    return _slips[LEFT];
+}
+
+uint32_t TractionControl::getRightSlips() const
+{
+    return _slips[RIGHT];
+}
@@ -0,0 +1,92 @@
+#ifndef TRACTION_CONTROL_H
+#define TRACTION_CONTROL_H
+
+#include "Imu.h"
+
+// Default settings
+#define TRACTION_PERIOD_US 5000      // Same tick as the yaw controller
+#define TRACTION_FULL_SPEED_MMS 600  // Track speed at full power with good grip
+#define TRACTION_TRACK_WIDTH_MM 140  // Centre to centre
+#define TRACTION_MOTOR_LAG_SHIFT 5   // Tracks take about 2^5 ticks (160ms) to reach a new speed
+#define TRACTION_DRIFT_SHIFT 6       // Integrated speed is pulled back to the model over 2^6 ticks (320ms)
+#define TRACTION_SLOPE_SHIFT 14      // Steady drift (accelerometer zero, model error) learned over a second or two
+#define TRACTION_TILT_SHIFT 10       // Slope from the gyro handed over to the drift estimate over 2^10 ticks (5s)
+#define TRACTION_STUCK_SHIFT 8       // While slipping, integrated speed sinks to standstill over 2^8 ticks (1.3s)
+#define TRACTION_MIN_SLIP_MMS 80     // Smaller differences are too close to the noise to judge
+#define TRACTION_SLIP_PERCENT 30     // Slipping when the track runs this much faster than the ground
+#define TRACTION_HOLD_TICKS 20       // Give a cut 100ms to show before cutting again
+#define TRACTION_LIMIT_FLOOR 96      // Never cut a track below 96/256 of what was asked
+#define TRACTION_RECOVERY_STEP 1     // Limit regained per tick (1/256), about 1s back to full
+#define TRACTION_BIAS_SHIFT 5        // Accelerometer zero learned while parked
+
+/*
+ * Traction control without wheel encoders. A simple lag model of the applied power says
+ * how fast each track runs. The IMU says how fast the ground under it goes: forward
+ * acceleration integrated into the tank's speed, plus or minus the yaw rate times half the
+ * track width for each side. A track running well ahead of its side of the tank is
+ * spinning, and its power is cut to a fraction of what the driver asks, then given back a
+ * little every tick while it grips.
+ *
+ * The accelerometer also feels the slope, so the gyro's pitch rate follows how much of
+ * gravity tips onto the X axis when the tank drives onto a ramp. Integrated acceleration
+ * still drifts, so while both tracks grip the tank's speed is pulled back towards the
+ * model, and the steady part of the drift, a long slope included, is learned slowly and
+ * taken off every tick. While a track slips the model is no use: the pull stops, the
+ * slope is held, and the speed comes from the accelerometer alone while slowly sinking
+ * towards standstill, so drift can't make it up. A track that spins while the tank stays
+ * put keeps looking like it spins, and stays cut until the tank really moves or the
+ * driver lets go. That holds while the accelerometer's zero stays within about 0.005g of
+ * where it was when the tank last stood still.
+ *
+ * Every step is a fixed number of integer operations. The IMU's X axis must point forward.
+ */
+class TractionControl
+{
+public:
+    // Constructor
+    TractionControl();
+
+    // One control step with the track powers in effect (-255..255), the reading and the
+    // clockwise yaw rate in gyro units. Returns true when a limit changed.
+    bool update(int16_t leftPower, int16_t rightPower, const ImuReading &reading, int16_t yawRate);
+
+    // Scale a requested track power by that track's limit
+    int16_t limitLeft(int16_t power) const;
+    int16_t limitRight(int16_t power) const;
+
+    // Forget the model and give both tracks full power back, slip counts stay
+    void reset();
+
+    uint16_t getLeftLimit() const; // 256 = full power
+    uint16_t getRightLimit() const;
+    uint32_t getLeftSlips() const;
+    uint32_t getRightSlips() const;
+
+private:
+    enum
+    {
+        LEFT,
+        RIGHT,
+        TRACKS
+    };
+
+    int32_t _model[TRACKS]; // Expected track speed, mm/s << 8
+    int32_t _bodySpeed;     // Integrated from the accelerometer, mm/s << 8
+    int32_t _accelBias;     // Forward accelerometer reading at rest, << 8
+    int32_t _gravity;       // Gravity tipped onto X since parked, accelerometer LSB << 16
+    int32_t _driftRate;     // Correction for drift per tick, mm/s << 16
+    bool _slipping[TRACKS];
+    uint8_t _holdTicks[TRACKS];
+
+    uint16_t _limit[TRACKS];
+    uint32_t _slips[TRACKS];
+
+    // Helper methods
+    bool judgeTrack(uint8_t track, int32_t groundSpeed);
+};
+
+#ifdef ARDUINO
+extern TractionControl tractionControl;
+#endif
+
+#endif // TRACTION_CONTROL_H
@@ -0,0 +1,110 @@
+#include "UartTx.h"
+
+UartTx uartTx;
+
+UartTx::UartTx()
+{
+    _rxBufferSize = 0;
+    _txBufferSize = 0;
+    resetStats();
+}
+
+void UartTx::begin(unsigned long baud, size_t rxBufferSize, size_t txBufferSize)
+{
+    // Both sizes only take effect when the driver is installed by begin(). The core
+    // rejects transmit buffers no larger than the FIFO, which leaves the FIFO-only path.
+    _rxBufferSize = rxBufferSize;
+    Serial.setRxBufferSize(rxBufferSize);
+    _txBufferSize = Serial.setTxBufferSize(txBufferSize);
+    Serial.begin(baud);
+}
+
+void UartTx::setBufferSize(size_t txBufferSize)
+{
+    unsigned long baud = Serial.baudRate();
+    Serial.flush();
+    Serial.end();
+    begin(baud, _rxBufferSize, txBufferSize);
+    resetStats();
+}
+
+size_t UartTx::getBufferSize() const
+{
+    return _txBufferSize;
+}
+
+size_t UartTx::write(const uint8_t *data, size_t length)
+{
+    uint32_t start = ESP.getCycleCount();
+    size_t written = Serial.write(data, length);
+    uint32_t cycles = ESP.getCycleCount() - start;
+
+    _writes++;
+    _bytes += written;
+    _cycles += cycles;
+    if (cycles > _maxCycles)
+        _maxCycles = cycles;
+    return written;
+}
+
+int UartTx::availableForWrite()
+{
+    return Serial.availableForWrite();
+}
+
+void UartTx::benchmark(size_t bytes, Print &out)
+{
+    // Printable lines, so the run reads as text in a serial monitor
+    char line[64];
+    memset(line, '.', sizeof(line));
+    memcpy(line, "uart bench ", 11);
+    line[sizeof(line) - 1] = '\n';
+
+    // 10 bits per byte on the wire; 2 KB at 115200 baud would hold the loop for 178ms
+    size_t maxBytes = Serial.baudRate() / 10 * UART_TX_BENCHMARK_MAX_MS / 1000;
+    if (bytes > maxBytes)
+    {
+        out.printf("UART bench: capped at %lu bytes (%dms at %lu baud)\n", (unsigned long)maxBytes,
+                   UART_TX_BENCHMARK_MAX_MS, Serial.baudRate());
+        bytes = maxBytes;
+    }
+
+    Serial.flush();
+    resetStats();
+    unsigned long start = micros();
+    for (size_t sent = 0; sent < bytes; sent += sizeof(line))
+        write((const uint8_t *)line, min(sizeof(line), bytes - sent));
+    unsigned long queued = micros() - start;
+    Serial.flush();
+    unsigned long total = micros() - start;
+    if (_bytes == 0 || total == 0)
+        return;
+
+    uint32_t mhz = getCpuFrequencyMhz();
+    unsigned long cpuUs = _cycles / mhz;
+    unsigned long baud = Serial.baudRate();
+    out.printf("UART bench: %lu bytes at %lu baud, tx buffer %lu\n", (unsigned long)_bytes, baud,
+               (unsigned long)_txBufferSize);
+    out.printf("  CPU in write %luus (%lu.%03luus/byte), longest write %luus, queued after %luus\n", cpuUs,
+               cpuUs / _bytes, cpuUs * 1000 / _bytes % 1000, (unsigned long)(_maxCycles / mhz), queued);
+    out.printf("  sent after %luus: %lu bytes/s (line rate %lu bytes/s)\n", total,
+               (unsigned long)((uint64_t)_bytes * 1000000 / total), baud / 10);
+}
+
+void UartTx::resetStats()
+{
+    _writes = 0;
+    _bytes = 0;
+    _cycles = 0;
+    _maxCycles = 0;
+}
+
+void UartTx::printReport(Print &out) const
+{
+    uint32_t mhz = getCpuFrequencyMhz();
+    unsigned long cpuUs = _cycles / mhz;
+    out.printf("UART tx: %lu baud, tx buffer %lu, free %d\n", Serial.baudRate(), (unsigned long)_txBufferSize,
+               Serial.availableForWrite());
+    out.printf("  writes=%lu bytes=%lu CPU=%luus longest=%luus\n", (unsigned long)_writes, (unsigned long)_bytes,
+               cpuUs, (unsigned long)(_maxCycles / mhz));
+}
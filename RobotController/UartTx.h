@@ -0,0 +1,51 @@
+#ifndef UART_TX_H
+#define UART_TX_H
+
+#include <Arduino.h>
+
+// Default settings
+#define UART_TX_BUFFER_SIZE 2048 // UART driver ring buffer, drained into the FIFO by the UART interrupt
+#define UART_TX_BENCHMARK_BYTES 1024
+#define UART_TX_BENCHMARK_MAX_BYTES 2048
+#define UART_TX_BENCHMARK_MAX_MS 50 // Line time the bench may block the loop for, a quarter of the watchdog deadline
+
+// Transmit side of the console UART. With a driver ring buffer a write is a memcpy and
+// the UART interrupt refills the hardware FIFO; without one the caller waits on the FIFO.
+class UartTx
+{
+public:
+    // Constructor
+    UartTx();
+
+    // Set the driver buffer sizes and start the console UART
+    void begin(unsigned long baud, size_t rxBufferSize, size_t txBufferSize);
+
+    // Restart the UART with a different transmit ring buffer, 0 = write straight into the FIFO
+    void setBufferSize(size_t txBufferSize);
+    size_t getBufferSize() const;
+
+    // Queue bytes for the UART, counting the CPU time spent doing it
+    size_t write(const uint8_t *data, size_t length);
+    int availableForWrite();
+
+    // Push text lines through write() and report CPU time and throughput. The bench waits
+    // until every byte is on the wire, so it sends no more than UART_TX_BENCHMARK_MAX_MS
+    // worth at the current baud rate.
+    void benchmark(size_t bytes, Print &out);
+
+    void resetStats();
+    void printReport(Print &out) const;
+
+private:
+    size_t _rxBufferSize;
+    size_t _txBufferSize;
+
+    uint32_t _writes;
+    uint32_t _bytes;
+    uint64_t _cycles;
+    uint32_t _maxCycles;
+};
+
+extern UartTx uartTx;
+
+#endif // UART_TX_H
@@ -0,0 +1,269 @@
+#include "UpdatePartition.h"
+
+bool UpdatePartition::eraseUpTo(uint32_t end)
+{
+    while (_erasedEnd < end)
+    {
+        if (!eraseSector(_erasedEnd))
+            return false;
+        _erasedEnd += UPDATE_PARTITION_SECTOR_SIZE;
+    }
+    return true;
+}
+
+#ifdef ARDUINO
+// Keep a freshly updated image on probation until its self test passes,
+// instead of the Arduino core confirming it at boot
+extern "C" bool verifyRollbackLater()
+{
+    return true;
+}
+
+OtaUpdatePartition updatePartition;
+
+OtaUpdatePartition::OtaUpdatePartition()
+{
+    _partition = nullptr;
+    _handle = 0;
+}
+
+bool OtaUpdatePartition::begin(uint32_t imageSize)
+{
+    abort();
+
+    _partition = esp_ota_get_next_update_partition(nullptr);
+    if (_partition == nullptr || imageSize > _partition->size)
+        return false;
+
+    // Sequential mode erases nothing up front, and esp_ota_write_with_offset() doesn't
+    // erase either, so write() erases each sector itself
+    _erasedEnd = 0;
+    if (esp_ota_begin(_partition, OTA_WITH_SEQUENTIAL_WRITES, &_handle) != ESP_OK)
+    {
+        _handle = 0;
+        return false;
+    }
+    return true;
+}
+
+bool OtaUpdatePartition::write(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+    return _handle != 0 && eraseUpTo(offset + length) &&
+           esp_ota_write_with_offset(_handle, data, length, offset) == ESP_OK;
+}
+
+bool OtaUpdatePartition::eraseSector(uint32_t offset)
+{
+    return esp_partition_erase_range(_partition, offset, UPDATE_PARTITION_SECTOR_SIZE) == ESP_OK;
+}
+
+bool OtaUpdatePartition::read(uint32_t offset, uint8_t *data, uint32_t length)
+{
+    return _partition != nullptr && esp_partition_read(_partition, offset, data, length) == ESP_OK;
+}
+
+bool OtaUpdatePartition::activate()
+{
+    if (_handle == 0)
+        return false;
+
+    // esp_ota_end also checks the image header and segments
+    esp_err_t result = esp_ota_end(_handle);
+    _handle = 0;
+    return result == ESP_OK && esp_ota_set_boot_partition(_partition) == ESP_OK;
+}
+
+void OtaUpdatePartition::abort()
+{
+    if (_handle != 0)
+        esp_ota_abort(_handle);
+    _handle = 0;
+}
+
+bool OtaUpdatePartition::isPendingVerify()
+{
+    esp_ota_img_states_t state;
+    return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+           state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+void OtaUpdatePartition::markValid()
+{
+    esp_ota_mark_app_valid_cancel_rollback();
+}
+
+void OtaUpdatePartition::rollback()
+{
+    // Does not return: reboots into the previous image
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+#else
+#include <string.h>
+
+FileUpdatePartition::FileUpdatePartition(const char *basePath)
+{
+    strncpy(_basePath, basePath, sizeof(_basePath) - 1);
+    _basePath[sizeof(_basePath) - 1] = '\0';
+    _file = nullptr;
+}
+
+FileUpdatePartition::~FileUpdatePartition()
+{
+    abort();
+}
+
+bool FileUpdatePartition::begin(uint32_t imageSize)
+{
+    abort();
+
+    if (imageSize > FILE_UPDATE_PARTITION_SIZE)
+        return false;
+
+    char bootSlot;
+    bool pending;
+    loadState(bootSlot, pending);
+
+    // Write to the slot we are not booting from, over whatever image it held
+    char path[220];
+    slotPath(bootSlot == 'a' ? 'b' : 'a', path, sizeof(path));
+    _file = fopen(path, "r+b");
+    if (_file == nullptr)
+        _file = fopen(path, "w+b");
+    _erasedEnd = 0;
+    return _file != nullptr;
+}
+
+bool FileUpdatePartition::write(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+    if (_file == nullptr || !eraseUpTo(offset + length))
+        return false;
+
+    // Programming flash only clears bits
+    uint8_t cells[256];
+    for (uint32_t done = 0; done < length; done += sizeof(cells))
+    {
+        uint32_t size = length - done < sizeof(cells) ? length - done : sizeof(cells);
+        memset(cells, 0, size);
+        if (fseek(_file, offset + done, SEEK_SET) != 0)
+            return false;
+        fread(cells, 1, size, _file);
+
+        for (uint32_t i = 0; i < size; i++)
+            cells[i] &= data[done + i];
+        if (fseek(_file, offset + done, SEEK_SET) != 0 || fwrite(cells, 1, size, _file) != size)
+            return false;
+    }
+    return true;
+}
+
+bool FileUpdatePartition::eraseSector(uint32_t offset)
+{
+    uint8_t erased[UPDATE_PARTITION_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    return fseek(_file, offset, SEEK_SET) == 0 && fwrite(erased, 1, sizeof(erased), _file) == sizeof(erased);
+}
+
+bool FileUpdatePartition::read(uint32_t offset, uint8_t *data, uint32_t length)
+{
+    if (_file == nullptr || fflush(_file) != 0 || fseek(_file, offset, SEEK_SET) != 0)
+        return false;
+    return fread(data, 1, length, _file) == length;
+}
+
+bool FileUpdatePartition::activate()
+{
+    if (_file == nullptr)
+        return false;
+
+    fclose(_file);
+    _file = nullptr;
+
+    char bootSlot;
+    bool pending;
+    loadState(bootSlot, pending);
+    return saveState(bootSlot == 'a' ? 'b' : 'a', true);
+}
+
+void FileUpdatePartition::abort()
+{
+    if (_file != nullptr)
+        fclose(_file);
+    _file = nullptr;
+}
+
+bool FileUpdatePartition::isPendingVerify()
+{
+    char bootSlot;
+    bool pending;
+    loadState(bootSlot, pending);
+    return pending;
+}
+
+void FileUpdatePartition::markValid()
+{
+    char bootSlot;
+    bool pending;
+    loadState(bootSlot, pending);
+    saveState(bootSlot, false);
+}
+
+void FileUpdatePartition::rollback()
+{
+    char bootSlot;
+    bool pending;
+    loadState(bootSlot, pending);
+    saveState(bootSlot == 'a' ? 'b' : 'a', false);
+}
+
+char FileUpdatePartition::getBootSlot()
+{
+    char bootSlot;
+    bool pending;
+    loadState(bootSlot, pending);
+    return bootSlot;
+}
+
+bool FileUpdatePartition::loadState(char &bootSlot, bool &pending)
+{
+    // State file holds the boot slot and a pending flag, e.g. "b1"
+    char path[220];
+    snprintf(path, sizeof(path), "%s.boot", _basePath);
+
+    bootSlot = 'a';
+    pending = false;
+
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    char state[2];
+    bool ok = fread(state, 1, 2, file) == 2 && (state[0] == 'a' || state[0] == 'b');
+    fclose(file);
+
+    if (ok)
+    {
+        bootSlot = state[0];
+        pending = state[1] == '1';
+    }
+    return ok;
+}
+
+bool FileUpdatePartition::saveState(char bootSlot, bool pending)
+{
+    char path[220];
+    snprintf(path, sizeof(path), "%s.boot", _basePath);
+
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    char state[2] = {bootSlot, pending ? '1' : '0'};
+    bool ok = fwrite(state, 1, 2, file) == 2;
+    return fclose(file) == 0 && ok;
+}
+
+void FileUpdatePartition::slotPath(char slot, char *path, size_t size)
+{
+    snprintf(path, size, "%s.%c", _basePath, slot);
+}
+#endif
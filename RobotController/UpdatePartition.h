@@ -0,0 +1,120 @@
+#ifndef UPDATE_PARTITION_H
+#define UPDATE_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <esp_ota_ops.h>
+#else
+#include <stdio.h>
+
+// Same size as an app slot in the default ESP32 partition table
+#define FILE_UPDATE_PARTITION_SIZE 0x140000
+#endif
+
+// Flash erase unit
+#define UPDATE_PARTITION_SECTOR_SIZE 4096
+
+// Storage for a new firmware image in the inactive A/B slot
+class UpdatePartition
+{
+public:
+    UpdatePartition() : _erasedEnd(0) {}
+    virtual ~UpdatePartition() {}
+
+    // Prepare the inactive slot for an image of the given size
+    virtual bool begin(uint32_t imageSize) = 0;
+
+    // Write and read back image bytes. Writes go in order from 0, each sector is erased
+    // the first time a write reaches it.
+    virtual bool write(uint32_t offset, const uint8_t *data, uint32_t length) = 0;
+    virtual bool read(uint32_t offset, uint8_t *data, uint32_t length) = 0;
+
+    // Boot the new slot next time, pending its self test
+    virtual bool activate() = 0;
+
+    // Drop a partly written image
+    virtual void abort() = 0;
+
+    // Self test of the running image: is it still on probation, keep it, or roll back
+    virtual bool isPendingVerify() = 0;
+    virtual void markValid() = 0;
+    virtual void rollback() = 0;
+
+protected:
+    // Erase every sector up to end that no write reached yet. Sector by sector so the loop
+    // never stalls on a whole-partition erase, and only once so a resumed transfer
+    // doesn't wipe what it already wrote.
+    bool eraseUpTo(uint32_t end);
+    virtual bool eraseSector(uint32_t offset) = 0;
+
+    // End of the erased part of the slot, reset by begin()
+    uint32_t _erasedEnd;
+};
+
+#ifdef ARDUINO
+// ESP-IDF OTA partitions (app0/app1)
+class OtaUpdatePartition : public UpdatePartition
+{
+public:
+    OtaUpdatePartition();
+
+    bool begin(uint32_t imageSize) override;
+    bool write(uint32_t offset, const uint8_t *data, uint32_t length) override;
+    bool read(uint32_t offset, uint8_t *data, uint32_t length) override;
+    bool activate() override;
+    void abort() override;
+    bool isPendingVerify() override;
+    void markValid() override;
+    void rollback() override;
+
+protected:
+    bool eraseSector(uint32_t offset) override;
+
+private:
+    const esp_partition_t *_partition;
+    esp_ota_handle_t _handle;
+};
+
+// The slot this firmware updates
+extern OtaUpdatePartition updatePartition;
+#else
+// Host stand-in: each slot is a file, plus a small state file for the boot slot. The
+// files behave like NOR flash: a slot keeps its old image, bytes past the end of the file
+// read as 0, and a write can only clear bits, so anything written to a sector that wasn't
+// erased comes out corrupted.
+class FileUpdatePartition : public UpdatePartition
+{
+public:
+    // Slots are <basePath>.a and <basePath>.b, boot state is <basePath>.boot
+    explicit FileUpdatePartition(const char *basePath);
+    ~FileUpdatePartition();
+
+    bool begin(uint32_t imageSize) override;
+    bool write(uint32_t offset, const uint8_t *data, uint32_t length) override;
+    bool read(uint32_t offset, uint8_t *data, uint32_t length) override;
+    bool activate() override;
+    void abort() override;
+    bool isPendingVerify() override;
+    void markValid() override;
+    void rollback() override;
+
+    // Slot that boots next, 'a' or 'b'
+    char getBootSlot();
+
+protected:
+    bool eraseSector(uint32_t offset) override;
+
+private:
+    char _basePath[200];
+    FILE *_file;
+
+    // Helper methods
+    bool loadState(char &bootSlot, bool &pending);
+    bool saveState(char bootSlot, bool pending);
+    void slotPath(char slot, char *path, size_t size);
+};
+#endif
+
+#endif // UPDATE_PARTITION_H
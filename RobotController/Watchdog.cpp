@@ -0,0 +1,207 @@
+#include "Watchdog.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "SerialMux.h"
+#include "Tracer.h"
+#include <esp_intr_alloc.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+
+static const char *const SUBSYSTEM_NAMES[] = {"input", "motor", "logging", "persistence"};
+
+// Read by the timer interrupt, so kept in RAM where it can be read while flash is busy
+static const DRAM_ATTR uint32_t SUBSYSTEM_DEADLINE_TICKS[] = {
+    WATCHDOG_INPUT_DEADLINE_MS / WATCHDOG_CHECK_PERIOD_MS,
+    WATCHDOG_MOTOR_DEADLINE_MS / WATCHDOG_CHECK_PERIOD_MS,
+    WATCHDOG_LOGGING_DEADLINE_MS / WATCHDOG_CHECK_PERIOD_MS,
+    WATCHDOG_PERSISTENCE_DEADLINE_MS / WATCHDOG_CHECK_PERIOD_MS};
+
+// Marker for the stalled subsystem kept in RTC memory across a watchdog reset
+#define WATCHDOG_RTC_MAGIC 0x57444f47
+#define WATCHDOG_NO_SUBSYSTEM 0xff
+static RTC_NOINIT_ATTR uint32_t rtcMagic;
+static RTC_NOINIT_ATTR uint32_t rtcMissedSubsystem;
+
+Watchdog *Watchdog::_instance = nullptr;
+
+Watchdog watchdog;
+
+Watchdog::Watchdog()
+{
+    _motors = nullptr;
+    _timer = nullptr;
+
+    _ticks = 0;
+    for (uint8_t i = 0; i < WATCHDOG_SUBSYSTEM_COUNT; i++)
+        _lastHeartbeat[i] = 0;
+    _writing = false;
+
+    _tripped = false;
+    _missedSubsystem = WATCHDOG_NO_SUBSYSTEM;
+    _tripCount = 0;
+
+    _resetReason = ESP_RST_UNKNOWN;
+    _resetSubsystem = WATCHDOG_NO_SUBSYSTEM;
+    _watchdogResets = 0;
+}
+
+void Watchdog::begin(TankMotors &motors, Preferences &preferences)
+{
+    _motors = &motors;
+    _instance = this;
+
+    // Work out why we reset and which subsystem stalled, if it was a watchdog
+    _resetReason = esp_reset_reason();
+    if (rtcMagic == WATCHDOG_RTC_MAGIC && rtcMissedSubsystem < WATCHDOG_SUBSYSTEM_COUNT)
+        _resetSubsystem = rtcMissedSubsystem;
+    rtcMagic = WATCHDOG_RTC_MAGIC;
+    rtcMissedSubsystem = WATCHDOG_NO_SUBSYSTEM;
+
+    _watchdogResets = preferences.getUInt("wdtResets", 0);
+    if (_resetReason == ESP_RST_TASK_WDT || _resetReason == ESP_RST_INT_WDT || _resetReason == ESP_RST_WDT)
+    {
+        _watchdogResets++;
+        preferences.putUInt("wdtResets", _watchdogResets);
+        LOG_BASIC("WARNING: Reset by watchdog (stalled: %s)",
+                  _resetSubsystem < WATCHDOG_SUBSYSTEM_COUNT ? SUBSYSTEM_NAMES[_resetSubsystem] : "unknown");
+    }
+    preferences.putUChar("resetReason", _resetReason);
+
+    // Every subsystem starts out healthy
+    for (uint8_t i = 0; i < WATCHDOG_SUBSYSTEM_COUNT; i++)
+        _lastHeartbeat[i] = 0;
+
+    // The loop task now has to keep feeding the hardware task watchdog
+    esp_task_wdt_add(xTaskGetCurrentTaskHandle());
+
+    // Deadline checks run in a timer interrupt, independent of the loop task. It is allocated
+    // in IRAM so the persistence deadline is checked while the flash cache is off for the
+    // write itself. Core 3.x goes through the gptimer driver, which only does that when the
+    // IDF was built with CONFIG_GPTIMER_ISR_IRAM_SAFE.
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    _timer = timerBegin(WATCHDOG_TIMER_FREQUENCY);
+    timerAttachInterrupt(_timer, &Watchdog::onTimer);
+    timerAlarm(_timer, WATCHDOG_CHECK_PERIOD_MS * (WATCHDOG_TIMER_FREQUENCY / 1000), true, 0);
+#else
+    _timer = timerBegin(WATCHDOG_TIMER_NUMBER, 80, true);
+    timerAttachInterruptFlag(_timer, &Watchdog::onTimer, true, ESP_INTR_FLAG_IRAM);
+    timerAlarmWrite(_timer, WATCHDOG_CHECK_PERIOD_MS * (WATCHDOG_TIMER_FREQUENCY / 1000), true);
+    timerAlarmEnable(_timer);
+#endif
+
+    LOG_DETAILED("Watchdog started");
+}
+
+void Watchdog::heartbeat(WatchdogSubsystem subsystem)
+{
+    _lastHeartbeat[subsystem] = _ticks;
+}
+
+void Watchdog::startWrite()
+{
+    _lastHeartbeat[WATCHDOG_PERSISTENCE] = _ticks;
+    _writing = true;
+}
+
+void Watchdog::finishWrite()
+{
+    // The loop was stuck in the write, not in its own work
+    uint32_t elapsed = _ticks - _lastHeartbeat[WATCHDOG_PERSISTENCE];
+    for (uint8_t i = 0; i < WATCHDOG_SUBSYSTEM_COUNT; i++)
+    {
+        if (i != WATCHDOG_PERSISTENCE)
+            _lastHeartbeat[i] += elapsed;
+    }
+    _writing = false;
+}
+
+void Watchdog::update()
+{
+    if (!allHealthy())
+        return;
+
+    esp_task_wdt_reset();
+
+    // Every subsystem is back, reconnect the motor outputs (stopped)
+    if (_tripped)
+    {
+        _motors->restoreOutputs(FORCE_OFF_WATCHDOG);
+        _tripped = false;
+        rtcMissedSubsystem = WATCHDOG_NO_SUBSYSTEM;
+        LOG_BASIC("Watchdog recovered (%s was stalled)", SUBSYSTEM_NAMES[_missedSubsystem]);
+    }
+}
+
+bool Watchdog::isTripped() const
+{
+    return _tripped;
+}
+
+void Watchdog::printReport() const
+{
+    Print &out = serialMux.console();
+    out.printf("Watchdog: %s, trips=%lu, watchdog resets=%lu\n",
+               _tripped ? "TRIPPED" : "ok", (unsigned long)_tripCount, (unsigned long)_watchdogResets);
+    out.printf("  last reset reason=%u stalled=%s\n", _resetReason,
+               _resetSubsystem < WATCHDOG_SUBSYSTEM_COUNT ? SUBSYSTEM_NAMES[_resetSubsystem] : "none");
+
+    uint32_t ticks = _ticks;
+    for (uint8_t i = 0; i < WATCHDOG_SUBSYSTEM_COUNT; i++)
+    {
+        if (!isWatched(i))
+        {
+            out.printf("  %s: idle (deadline %lums)\n", SUBSYSTEM_NAMES[i],
+                       (unsigned long)SUBSYSTEM_DEADLINE_TICKS[i] * WATCHDOG_CHECK_PERIOD_MS);
+            continue;
+        }
+        out.printf("  %s: last heartbeat %lums ago (deadline %lums)\n", SUBSYSTEM_NAMES[i],
+                   (unsigned long)(ticks - _lastHeartbeat[i]) * WATCHDOG_CHECK_PERIOD_MS,
+                   (unsigned long)SUBSYSTEM_DEADLINE_TICKS[i] * WATCHDOG_CHECK_PERIOD_MS);
+    }
+}
+
+bool IRAM_ATTR Watchdog::isWatched(uint8_t subsystem) const
+{
+    return _writing ? subsystem == WATCHDOG_PERSISTENCE : subsystem != WATCHDOG_PERSISTENCE;
+}
+
+bool Watchdog::allHealthy() const
+{
+    uint32_t ticks = _ticks;
+    for (uint8_t i = 0; i < WATCHDOG_SUBSYSTEM_COUNT; i++)
+    {
+        if (isWatched(i) && ticks - _lastHeartbeat[i] > SUBSYSTEM_DEADLINE_TICKS[i])
+            return false;
+    }
+    return true;
+}
+
+void IRAM_ATTR Watchdog::check()
+{
+    uint32_t ticks = ++_ticks;
+
+    if (_tripped)
+        return;
+
+    for (uint8_t i = 0; i < WATCHDOG_SUBSYSTEM_COUNT; i++)
+    {
+        if (isWatched(i) && ticks - _lastHeartbeat[i] > SUBSYSTEM_DEADLINE_TICKS[i])
+        {
+            // Cut the motors without waiting for the (stuck) loop task
+            _motors->forceOff(FORCE_OFF_WATCHDOG);
+            _tripped = true;
+            _missedSubsystem = i;
+            _tripCount++;
+            metrics.count(METRIC_WATCHDOG_TRIPS);
+            TRACE_INSTANT(WATCHDOG_TRIP);
+            rtcMissedSubsystem = i;
+            return;
+        }
+    }
+}
+
+void IRAM_ATTR Watchdog::onTimer()
+{
+    if (_instance != nullptr)
+        _instance->check();
+}
@@ -0,0 +1,84 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "TankMotors.h"
+
+// Subsystems that post heartbeats
+enum WatchdogSubsystem
+{
+    WATCHDOG_INPUT,
+    WATCHDOG_MOTOR,
+    WATCHDOG_LOGGING,
+    WATCHDOG_PERSISTENCE, // Only while a flash write runs, see startWrite()
+    WATCHDOG_SUBSYSTEM_COUNT
+};
+
+// Default settings
+#define WATCHDOG_TIMER_NUMBER 0 // Hardware timer, only used by Arduino core 2.x
+#define WATCHDOG_TIMER_FREQUENCY 1000000
+#define WATCHDOG_CHECK_PERIOD_MS 10
+#define WATCHDOG_INPUT_DEADLINE_MS 200
+#define WATCHDOG_MOTOR_DEADLINE_MS 200
+#define WATCHDOG_LOGGING_DEADLINE_MS 500
+#define WATCHDOG_PERSISTENCE_DEADLINE_MS 1000 // One flash write, sector erase included
+
+class Watchdog
+{
+public:
+    // Constructor
+    Watchdog();
+
+    // Record the last reset cause, start the check timer and the task watchdog
+    void begin(TankMotors &motors, Preferences &preferences);
+
+    // Report that a subsystem made progress
+    void heartbeat(WatchdogSubsystem subsystem);
+
+    // Call around each Preferences write. The loop's own heartbeats can't move while it
+    // waits for flash, so meanwhile only the write's deadline is checked, and the time it
+    // took is credited to the others when it finishes.
+    void startWrite();
+    void finishWrite();
+
+    // Call once per loop pass. Feeds the task watchdog only while every subsystem is healthy.
+    void update();
+
+    // Get watchdog state
+    bool isTripped() const;
+
+    // Print reset cause, trip count and heartbeat ages
+    void printReport() const;
+
+private:
+    TankMotors *_motors;
+    hw_timer_t *_timer;
+
+    // Timer ticks and the tick of each subsystem's last heartbeat
+    volatile uint32_t _ticks;
+    volatile uint32_t _lastHeartbeat[WATCHDOG_SUBSYSTEM_COUNT];
+    volatile bool _writing;
+
+    // Trip state, written by the timer interrupt
+    volatile bool _tripped;
+    volatile uint8_t _missedSubsystem;
+    uint32_t _tripCount;
+
+    // Cause of the last reset
+    uint8_t _resetReason;
+    uint8_t _resetSubsystem;
+    uint32_t _watchdogResets;
+
+    static Watchdog *_instance;
+
+    // Helper methods
+    bool IRAM_ATTR isWatched(uint8_t subsystem) const;
+    bool allHealthy() const;
+    void IRAM_ATTR check();
+    static void IRAM_ATTR onTimer();
+};
+
+extern Watchdog watchdog;
+
+#endif // WATCHDOG_H
@@ -0,0 +1,97 @@
+#include "YawRateController.h"
+
+#ifdef ARDUINO
+YawRateController yawController;
+#endif
+
+YawRateController::YawRateController()
+{
+    reset();
+}
+
+void YawRateController::setCommand(int16_t forward, int16_t turn)
+{
+    _forward = forward;
+    _targetRate = (int32_t)turn * YAW_MAX_RATE_DPS * IMU_GYRO_LSB_PER_DPS_X10 / (10 * 255);
+    _hasCommand = true;
+}
+
+bool YawRateController::hasCommand() const
+{
+    return _hasCommand;
+}
+
+void YawRateController::update(int16_t yawRate, int16_t &leftPower, int16_t &rightPower)
+{
+    _lastRate = yawRate;
+
+    // Parked: nothing to hold, and gyro noise mustn't creep the tracks
+    if (!_hasCommand || (_forward == 0 && _targetRate == 0))
+    {
+        _integral = 0;
+        _referenceRate = yawRate;
+        leftPower = 0;
+        rightPower = 0;
+        return;
+    }
+
+    // Round the step away from zero, so the reference lands on the target from either
+    // side (a plain shift of a negative gap rounds the other way)
+    int32_t gap = _targetRate - _referenceRate;
+    int32_t round = (1 << YAW_REFERENCE_SHIFT) - 1;
+    _referenceRate += gap >= 0 ? (gap + round) >> YAW_REFERENCE_SHIFT : -((-gap + round) >> YAW_REFERENCE_SHIFT);
+    int32_t error = _referenceRate - yawRate;
+    int32_t turn = (int32_t)(((int64_t)_targetRate * YAW_KFF_Q16 + (int64_t)error * YAW_KP_Q16 + _integral) >> 16);
+
+    // Only integrate while the output can still act on it, so the integral doesn't wind
+    // up against a stalled track
+    bool saturated = (turn >= 255 && error > 0) || (turn <= -255 && error < 0);
+    if (!saturated)
+    {
+        _integral += error * YAW_KI_Q16;
+        if (_integral > ((int32_t)YAW_INTEGRAL_LIMIT << 16))
+            _integral = (int32_t)YAW_INTEGRAL_LIMIT << 16;
+        if (_integral < -((int32_t)YAW_INTEGRAL_LIMIT << 16))
+            _integral = -((int32_t)YAW_INTEGRAL_LIMIT << 16);
+    }
+    turn = turn > 255 ? 255 : turn < -255 ? -255 : turn;
+
+    // Steering wins over speed: past full power, take the excess off the forward part
+    int32_t forward = _forward;
+    int32_t excess = (forward < 0 ? -forward : forward) + (turn < 0 ? -turn : turn) - 255;
+    if (excess > 0)
+        forward += forward > 0 ? -excess : excess;
+
+    leftPower = forward + turn;
+    rightPower = forward - turn;
+}
+
+void YawRateController::reset()
+{
+    _forward = 0;
+    _targetRate = 0;
+    _referenceRate = 0;
+    _hasCommand = false;
+    _integral = 0;
+    _lastRate = 0;
+}
+
+int32_t YawRateController::getTargetRate() const
+{
+    return _targetRate;
+}
+
+int32_t YawRateController::getReferenceRate() const
+{
+    return _referenceRate;
+}
+
+int32_t YawRateController::getLastRate() const
+{
+    return _lastRate;
+}
+
+int32_t YawRateController::getIntegral() const
+{
+    return _integral >> 16;
+}
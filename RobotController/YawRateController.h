@@ -0,0 +1,62 @@
+#ifndef YAW_RATE_CONTROLLER_H
+#define YAW_RATE_CONTROLLER_H
+
+#include "Imu.h"
+
+// Default settings
+#define YAW_CONTROL_PERIOD_US 5000 // 200Hz
+#define YAW_MAX_RATE_DPS 180       // Turn rate asked for by a full stick differential
+#define YAW_INTEGRAL_LIMIT 192     // Most power the integral may add to the turn
+#define YAW_REFERENCE_SHIFT 5      // Tracks take about 2^5 control periods (160ms) to reach a new rate
+
+// Feedforward turns the target rate straight into power assuming an ideal surface, the
+// PI terms make up the difference the ground and battery make. They compare against the
+// rate an ideal tank would have reached by now rather than the target itself, so the
+// tracks' own lag isn't mistaken for error. Q16 power per gyro LSB.
+#define YAW_KFF_Q16 ((255L << 16) * 10 / ((long)YAW_MAX_RATE_DPS * IMU_GYRO_LSB_PER_DPS_X10))
+#define YAW_KP_Q16 (YAW_KFF_Q16 / 2)
+#define YAW_KI_Q16 (YAW_KFF_Q16 / 8) // Per control period, about 40ms to close a gap
+
+/*
+ * Closed-loop steering: the driver's turn command asks for a yaw rate instead of a power
+ * difference, and the gyro measures what the tank actually does. The controller works
+ * in whole gyro units and Q16 gains, so a step is a handful of integer multiplies.
+ * Rates are clockwise positive (turning right seen from above).
+ */
+class YawRateController
+{
+public:
+    // Constructor
+    YawRateController();
+
+    // Driver's command: forward and turn power (-255..255), as the tracks would get
+    // open loop as forward + turn and forward - turn
+    void setCommand(int16_t forward, int16_t turn);
+    bool hasCommand() const;
+
+    // One control step with the measured yaw rate (gyro units), gives the track powers
+    void update(int16_t yawRate, int16_t &leftPower, int16_t &rightPower);
+
+    // Drop the command and the integral, e.g. when the motors are stopped
+    void reset();
+
+    int32_t getTargetRate() const;
+    int32_t getReferenceRate() const;
+    int32_t getLastRate() const;
+    int32_t getIntegral() const; // Power
+
+private:
+    int16_t _forward;
+    int32_t _targetRate;
+    int32_t _referenceRate; // Where an ideal tank's rate would be on its way to the target
+    bool _hasCommand;
+
+    int32_t _integral; // Q16 power
+    int32_t _lastRate;
+};
+
+#ifdef ARDUINO
+extern YawRateController yawController;
+#endif
+
+#endif // YAW_RATE_CONTROLLER_H
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Build the firmware with arduino-cli and check the per-module footprint budget.
+#
+# Usage: tools/build.sh [default|size|tokenized|profile]
+#   default    normal build
+#   size       size-optimized build: verbose logging, tracing and the sketch's float formats
+#              compiled out (newlib keeps float printf, the core links it anyway)
+#   tokenized  log messages sent as token frames, decode them with tools/log_decode.py
+#   profile    with the sampling profiler ('prof' command), read it with tools/sample_profile.py
+#
+# Set FQBN to override the board (defaults to the Bluepad32 ESP32 board package).
+set -e
+
+PROFILE=${1:-default}
+FQBN=${FQBN:-esp32-bluepad32:esp32:esp32}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD="$ROOT/build/$PROFILE"
+
+case "$PROFILE" in
+default)
+    EXTRA_FLAGS=""
+    ;;
+size)
+    EXTRA_FLAGS="-DTANK_SIZE_OPTIMIZED=1"
+    ;;
+tokenized)
+    EXTRA_FLAGS="-DLOG_TOKENIZED=1"
+    ;;
+profile)
+    EXTRA_FLAGS="-DTANK_SAMPLING_PROFILER=1"
+    ;;
+*)
+    echo "Unknown profile: $PROFILE" >&2
+    exit 2
+    ;;
+esac
+
+# The previous build of this profile is the baseline for the footprint deltas
+if [ -f "$BUILD/footprint.json" ]; then
+    mv "$BUILD/footprint.json" "$BUILD/footprint.prev.json"
+fi
+
+arduino-cli compile --fqbn "$FQBN" --build-path "$BUILD" \
+    --build-property "build.defines=$EXTRA_FLAGS" \
+    "$ROOT/RobotController"
+
+# Keep the string table that matches this build for tools/log_decode.py --tokens
+if [ "$PROFILE" = tokenized ]; then
+    python3 "$ROOT/tools/log_decode.py" --dump-tokens "$BUILD/log_tokens.json"
+fi
+
+python3 "$ROOT/tools/footprint.py" "$BUILD/RobotController.ino.map" --budget "$ROOT/tools/footprint_budget.json" \
+    --save "$BUILD/footprint.json" --baseline "$BUILD/footprint.prev.json"
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Per-module flash/RAM report and budget check for the tank firmware.
+
+Reads the linker map file that the ESP32 Arduino core writes next to the ELF
+(<build>/RobotController.ino.map) and adds up every input section by the
+object file it came from. Sketch objects are grouped into modules using the
+budget file; everything else is grouped by library or archive.
+
+Usage:
+    footprint.py <map file> [--budget footprint_budget.json]
+                 [--save footprint.json] [--baseline footprint.json]
+
+--save writes the per-module figures of this build, --baseline prints how far each
+module moved from a saved build. A budget only goes up together with the delta that
+--baseline measured for the change needing it, quoted in that change's commit message.
+
+Also says whether newlib's floating point printf/scanf support was linked. The ESP32
+Arduino core links it for its own use in every profile, so this is only a report.
+
+Exits with status 1 when a module is over its budget.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+# Output sections and the memory they occupy
+FLASH_SECTIONS = ('.flash.text', '.flash.rodata', '.flash.appdesc', '.flash.rodata_noload')
+IRAM_SECTIONS = ('.iram0.text', '.iram0.vectors')
+DRAM_SECTIONS = ('.dram0.data', '.dram0.bss', '.noinit', '.rtc.data', '.rtc.bss', '.rtc_noinit')
+
+OUTPUT_SECTION = re.compile(r'^(\.\S+)(?:\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+)?\s*$')
+INPUT_SECTION = re.compile(r'^ (\.\S+|COMMON)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*))?\s*$')
+CONTINUATION = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+
+# Symbols that only come with floating point formatting and scanning in newlib
+FLOAT_STDIO_SYMBOLS = ('_dtoa_r', '__ssvfscanf_r')
+
+
+def memory_kind(output_section):
+    if output_section.startswith(FLASH_SECTIONS):
+        return 'flash'
+    if output_section.startswith(IRAM_SECTIONS):
+        return 'iram'
+    if output_section.startswith(DRAM_SECTIONS):
+        return 'dram'
+    return None
+
+
+def parse_map(path):
+    """Return {object path: {'flash': n, 'iram': n, 'dram': n}}."""
+    usage = {}
+    with open(path, errors='replace') as map_file:
+        lines = map_file.read().splitlines()
+
+    # Only the memory map part lists the sections that made it into the image
+    try:
+        start = lines.index('Linker script and memory map')
+    except ValueError:
+        start = 0
+
+    kind = None
+    pending = None
+    for line in lines[start:]:
+        match = OUTPUT_SECTION.match(line)
+        if match:
+            kind = memory_kind(match.group(1))
+            pending = None
+            continue
+
+        match = INPUT_SECTION.match(line)
+        if match:
+            if match.group(2) is None:
+                # Long section name, address and size follow on the next line
+                pending = match.group(1)
+                continue
+            address, size, source = match.group(2), match.group(3), match.group(4)
+        elif pending is not None:
+            match = CONTINUATION.match(line)
+            pending = None
+            if not match:
+                continue
+            address, size, source = match.groups()
+        else:
+            continue
+
+        size = int(size, 16)
+        if kind is None or size == 0 or int(address, 16) == 0:
+            continue
+        entry = usage.setdefault(source.strip(), {'flash': 0, 'iram': 0, 'dram': 0})
+        entry[kind] += size
+
+    return usage
+
+
+def linked_symbols(path, names):
+    """Return the subset of names that are defined in the image."""
+    found = set()
+    pattern = re.compile(r'^\s+0x[0-9a-fA-F]+\s+(%s)\s*$' % '|'.join(re.escape(name) for name in names))
+    with open(path, errors='replace') as map_file:
+        for line in map_file:
+            match = pattern.match(line)
+            if match and int(line.split()[0], 16) != 0:
+                found.add(match.group(1))
+    return found
+
+
+def group_name(source, module_objects):
+    """Map an object path from the map file to a module or library name."""
+    base = os.path.basename(source)
+    if base in module_objects:
+        return module_objects[base]
+
+    normalized = source.replace('\\', '/')
+    match = re.search(r'/libraries/([^/]+)/', normalized)
+    if match:
+        return 'lib:' + match.group(1)
+
+    # Archive members look like /path/libfoo.a(bar.o)
+    match = re.match(r'(.*?)\(([^)]*)\)$', normalized)
+    archive = os.path.basename(match.group(1)) if match else base
+    if archive == 'core.a':
+        return 'arduino-core'
+    if archive.startswith('lib') and archive.endswith('.a'):
+        return 'sdk:' + archive[3:-2]
+    if '/sketch/' in normalized:
+        return 'sketch:other'
+    return 'other'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('map', help='linker map file')
+    parser.add_argument('--budget', help='JSON file with per-module allowances')
+    parser.add_argument('--top', type=int, default=12, help='library groups to list')
+    parser.add_argument('--save', help='write this build\'s per-module figures to a JSON file')
+    parser.add_argument('--baseline', help='JSON file from --save to print deltas against')
+    args = parser.parse_args()
+
+    modules = {}
+    if args.budget:
+        with open(args.budget) as budget_file:
+            modules = json.load(budget_file)['modules']
+
+    module_objects = {}
+    for name, module in modules.items():
+        for obj in module['objects']:
+            module_objects[obj] = name
+
+    groups = {}
+    for source, entry in parse_map(args.map).items():
+        total = groups.setdefault(group_name(source, module_objects), {'flash': 0, 'iram': 0, 'dram': 0})
+        for kind in total:
+            total[kind] += entry[kind]
+
+    baseline = None
+    if args.baseline and os.path.exists(args.baseline):
+        with open(args.baseline) as baseline_file:
+            baseline = json.load(baseline_file)
+
+    empty = {'flash': 0, 'iram': 0, 'dram': 0}
+    failed = False
+    print(('%-16s %8s %8s %8s   %-16s%s' % ('module', 'flash', 'iram', 'dram', 'budget flash/ram',
+                                           ' delta flash/ram' if baseline else '')).rstrip())
+    for name, module in modules.items():
+        used = groups.get(name, empty)
+        ram = used['iram'] + used['dram']
+        over = used['flash'] > module['flash'] or ram > module['ram']
+        failed = failed or over
+        delta = ''
+        if baseline is not None:
+            before = baseline.get(name, empty)
+            delta = ' %+6d/%+d' % (used['flash'] - before['flash'],
+                                   ram - before['iram'] - before['dram'])
+        print(('%-16s %8d %8d %8d   %-16s%s%s' % (name, used['flash'], used['iram'], used['dram'],
+                                                '%d/%d' % (module['flash'], module['ram']), delta,
+                                                '  OVER BUDGET' if over else '')).rstrip())
+
+    others = sorted((item for item in groups.items() if item[0] not in modules),
+                    key=lambda item: -(item[1]['flash'] + item[1]['iram'] + item[1]['dram']))
+    print()
+    for name, used in others[:args.top]:
+        print('%-16s %8d %8d %8d' % (name[:16], used['flash'], used['iram'], used['dram']))
+
+    totals = {kind: sum(used[kind] for used in groups.values()) for kind in empty}
+    print('%-16s %8d %8d %8d' % ('total', totals['flash'], totals['iram'], totals['dram']))
+
+    linked = linked_symbols(args.map, FLOAT_STDIO_SYMBOLS)
+    print('\nfloat printf/scanf: %s' % (', '.join(sorted(linked)) + ' linked' if linked else 'not linked'))
+
+    if args.save:
+        with open(args.save, 'w') as save_file:
+            json.dump(groups, save_file, indent=1, sort_keys=True)
+
+    if failed:
+        print('\nFootprint budget exceeded', file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
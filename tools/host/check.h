@@ -0,0 +1,32 @@
+// Pass/fail bookkeeping shared by the host simulations, see tools/host_sim.sh.
+
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+// Print and count a failed check, the run goes on
+static inline void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Print the outcome, for main() to return: 1 when a check failed
+static inline int checkResult()
+{
+    if (failures > 0)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
+
+#endif // HOST_CHECK_H
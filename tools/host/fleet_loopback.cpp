@@ -0,0 +1,164 @@
+// Host run of fleet telemetry over UdpLoopbackTransport, see tools/host_sim.sh.
+//
+// Checks the status frame layout field by field, including the clamped fields, then
+// runs a fleet of tanks and a base node in one process, each on its own loopback socket,
+// the way separate boards share ESP-NOW broadcast. The tanks are driven with the power
+// changing every millisecond, then parked. Prints the frames per tank per second while
+// driven and parked and what the base saw, and exits non-zero when a check fails.
+//
+// Usage: fleet_loopback [tanks] [seconds driven]
+
+#include "FleetTelemetry.h"
+#include "FleetTransport.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define SIM_PARKED_MS 2000
+
+static void checkFrameLayout()
+{
+    FleetStatus status = {};
+    status.tankId = 7;
+    status.sequence = 0xBEEF;
+    status.uptime = 0x12345678;
+    status.leftPower = -255;
+    status.rightPower = 200;
+    status.flags = FLEET_FLAG_CONTROLLER | FLEET_FLAG_IDLE;
+    status.batteryMv = 7400;
+    status.reportRate = 125;
+    status.reportAge = 120;
+    status.freeHeapKb = 180;
+
+    uint8_t frame[FLEET_STATUS_FRAME_SIZE];
+    check(packFleetStatus(status, frame) == FLEET_STATUS_FRAME_SIZE, "frame size");
+    check(frame[0] == FLEET_MAGIC && frame[1] == FLEET_VERSION && frame[2] == FLEET_FRAME_STATUS, "frame header");
+    check(frame[4] == 0xEF && frame[5] == 0xBE && frame[6] == 0x78 && frame[9] == 0x12, "little-endian fields");
+
+    FleetStatus decoded;
+    check(unpackFleetStatus(frame, sizeof(frame), decoded), "frame unpacks");
+    check(decoded.tankId == 7 && decoded.sequence == 0xBEEF && decoded.uptime == 0x12345678, "ids and uptime");
+    check(decoded.leftPower == -255 && decoded.rightPower == 200, "signed power");
+    check(decoded.flags == status.flags && decoded.batteryMv == 7400 && decoded.reportRate == 125, "flags and battery");
+    check(decoded.reportAge == 120 && decoded.freeHeapKb == 180, "report age and heap");
+
+    // Out of range values saturate instead of wrapping
+    status.batteryMv = 16800;
+    status.reportAge = 9000;
+    packFleetStatus(status, frame);
+    unpackFleetStatus(frame, sizeof(frame), decoded);
+    check(decoded.batteryMv == 12750, "battery clamps at 12.75 V");
+    check(decoded.reportAge == 2550, "report age clamps at 2.55 s");
+
+    frame[1] = FLEET_VERSION + 1;
+    check(!unpackFleetStatus(frame, sizeof(frame), decoded), "other versions refused");
+    check(!unpackFleetStatus(frame, FLEET_STATUS_FRAME_SIZE - 1, decoded), "short frames refused");
+}
+
+struct Tank
+{
+    UdpLoopbackTransport transport;
+    FleetTelemetry telemetry;
+    FleetStatus status;
+
+    Tank() : telemetry(transport), status() {}
+};
+
+// Frames each tank hears are its own and the others', only the base keeps them
+static void drain(std::vector<Tank *> &tanks, UdpLoopbackTransport &base, FleetAggregator &aggregator,
+                  unsigned long now)
+{
+    uint8_t frame[FLEET_MAX_FRAME];
+    FleetFrameInfo info;
+    for (Tank *tank : tanks)
+    {
+        while (tank->transport.receive(frame, sizeof(frame), info) > 0)
+        {
+        }
+    }
+
+    size_t length;
+    while ((length = base.receive(frame, sizeof(frame), info)) > 0)
+        aggregator.handleFrame(frame, length, info.rssi, now);
+}
+
+int main(int argc, char **argv)
+{
+    int tankCount = argc > 1 ? atoi(argv[1]) : 12;
+    int drivenMs = argc > 2 ? atoi(argv[2]) * 1000 : 3000;
+    if (tankCount < 1 || tankCount > FLEET_MAX_TANKS)
+        tankCount = 12;
+
+    checkFrameLayout();
+
+    UdpLoopbackTransport base;
+    FleetAggregator aggregator;
+    std::vector<Tank *> tanks;
+    for (int i = 0; i < tankCount; i++)
+        tanks.push_back(new Tank());
+
+    if (!base.begin())
+    {
+        printf("Could not open the loopback multicast group\n");
+        return 1;
+    }
+    for (int i = 0; i < tankCount; i++)
+        check(tanks[i]->telemetry.begin(i + 1), "tank transport starts");
+
+    // Driven: a 1ms loop with the power changing on every pass
+    unsigned long now = 1;
+    for (; now <= (unsigned long)drivenMs; now++)
+    {
+        for (int i = 0; i < tankCount; i++)
+        {
+            FleetStatus &status = tanks[i]->status;
+            status.leftPower = (int16_t)((now * 7 + i * 31) % 511) - 255;
+            status.rightPower = (int16_t)((now * 5 + i * 17) % 511) - 255;
+            status.flags = FLEET_FLAG_CONTROLLER;
+            status.batteryMv = 7000 + i * 100;
+            tanks[i]->telemetry.update(now, status);
+        }
+        drain(tanks, base, aggregator, now);
+    }
+    uint32_t drivenFrames = tanks[0]->telemetry.getFramesSent();
+
+    // Parked: nothing changes, only the heartbeat goes out
+    for (; now <= (unsigned long)(drivenMs + SIM_PARKED_MS); now++)
+    {
+        for (int i = 0; i < tankCount; i++)
+            tanks[i]->telemetry.update(now, tanks[i]->status);
+        drain(tanks, base, aggregator, now);
+    }
+    uint32_t parkedFrames = tanks[0]->telemetry.getFramesSent() - drivenFrames;
+
+    double drivenRate = drivenFrames * 1000.0 / drivenMs;
+    double parkedRate = parkedFrames * 1000.0 / SIM_PARKED_MS;
+    printf("%d tanks, frames per tank per second: driven %.1f, parked %.1f\n", tankCount, drivenRate, parkedRate);
+    check(drivenRate <= 1000.0 / FLEET_STATUS_MIN_INTERVAL_MS + 1, "changes held to the minimum interval");
+    check(parkedRate <= 1000.0 / FLEET_STATUS_PERIOD_MS + 1 && parkedRate >= 1000.0 / FLEET_STATUS_PERIOD_MS - 1,
+          "heartbeat period while parked");
+
+    uint32_t received = 0;
+    uint32_t lost = 0;
+    check(aggregator.getTankCount() == tankCount, "base sees every tank");
+    for (uint8_t i = 0; i < aggregator.getTankCount(); i++)
+    {
+        const FleetAggregator::Entry *entry = aggregator.getTank(i);
+        Tank *tank = tanks[entry->status.tankId - 1];
+        received += entry->framesReceived;
+        lost += entry->framesLost;
+        check(entry->framesReceived == tank->telemetry.getFramesSent(), "base got every frame");
+        check(entry->status.leftPower == tank->status.leftPower && entry->status.rightPower == tank->status.rightPower,
+              "base holds the last power");
+        check(entry->status.batteryMv / 50 == tank->status.batteryMv / 50, "base holds the battery voltage");
+        check(aggregator.isOnline(*entry, now), "tank online");
+    }
+    printf("base: %u frames received, %u lost, %.0f frames per second on the channel while driven\n", received, lost,
+           drivenRate * tankCount);
+
+    for (Tank *tank : tanks)
+        delete tank;
+
+    return checkResult();
+}
@@ -0,0 +1,175 @@
+// Host test and benchmark of TankMotors on MockMotorHal, see tools/host_sim.sh.
+//
+// The mock records the duty written to every pin and whether the pin is cut off, so the
+// checks see exactly what the motor driver would:
+// - the duty on each of the four pins for forward, backward, stop and brake, with and
+//   without calibration
+// - forceOff() holding every pin low whatever is written meanwhile, until the last
+//   reason is cleared
+// - restoreOutputs() zeroing the duty before it reconnects, so the motors don't pick up
+//   the power written while cut off
+// Then times the motor calls that write duty, to compare the policy's overhead against
+// the plain writes. Exits non-zero when a check fails.
+//
+// Usage: motor_hal_test [benchmark calls]
+
+#include "Metrics.h"
+#include "TankMotors.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LF 33
+#define LB 32
+#define RF 25
+#define RB 26
+
+// What the driver sees on the four pins
+static bool pinsAre(uint8_t lf, uint8_t lb, uint8_t rf, uint8_t rb)
+{
+    return MockMotorHal::pinLevel(LF) == lf && MockMotorHal::pinLevel(LB) == lb && MockMotorHal::pinLevel(RF) == rf &&
+           MockMotorHal::pinLevel(RB) == rb;
+}
+
+static void checkDuty(TankMotors &motors)
+{
+    const MockMotorHal::State &state = MockMotorHal::state();
+    check(state.output[LF] && state.output[LB] && state.output[RF] && state.output[RB], "begin() configures all pins");
+    check(pinsAre(0, 0, 0, 0), "begin() stops both motors");
+
+    motors.leftForward(200);
+    motors.rightForward(150);
+    check(pinsAre(200, 0, 150, 0), "forward drives the forward pins only");
+    check(motors.getLeftDirection() == MOTOR_FORWARD && motors.getRightPower() == 150, "forward state");
+
+    motors.leftBackward(90);
+    motors.rightBackward(255);
+    check(pinsAre(0, 90, 0, 255), "backward drives the backward pins only");
+
+    motors.leftStop();
+    check(pinsAre(0, 0, 0, 255), "leftStop() leaves the right motor alone");
+    motors.stop();
+    check(pinsAre(0, 0, 0, 0) && motors.getLeftDirection() == MOTOR_STOPPED, "stop() zeroes every pin");
+
+    motors.brake(180);
+    check(pinsAre(180, 180, 180, 180), "brake drives both inputs of each bridge");
+    check(motors.getLeftDirection() == MOTOR_BRAKING && motors.getLeftPower() == 180, "brake state");
+    motors.rightBrake(0);
+    check(pinsAre(180, 180, 0, 0) && motors.getRightDirection() == MOTOR_STOPPED, "brake strength 0 stops");
+
+    // Calibration scales driving power but not braking
+    motors.setLeftCalibration(0.5f);
+    motors.setRightCalibration(1.5f); // Clamped to 1
+    motors.leftForward(200);
+    motors.rightBackward(200);
+    check(pinsAre(100, 0, 0, 200), "calibration scales the duty");
+    check(motors.getLeftPower() == 200, "power reads back uncalibrated");
+    motors.brake(100);
+    check(pinsAre(100, 100, 100, 100), "braking ignores calibration");
+    motors.setLeftCalibration(1.0f);
+    motors.stop();
+}
+
+static void checkForceOff(TankMotors &motors)
+{
+    const MockMotorHal::State &state = MockMotorHal::state();
+
+    motors.leftForward(220);
+    motors.rightBackward(130);
+    motors.forceOff(FORCE_OFF_FAILSAFE);
+    check(motors.isForcedOff() && pinsAre(0, 0, 0, 0), "forceOff() cuts every pin");
+
+    // Writes still land in the duty registers but never reach the pins
+    motors.leftForward(255);
+    motors.rightForward(255);
+    motors.brake(255);
+    check(pinsAre(0, 0, 0, 0), "forceOff() blocks later writes");
+    check(state.duty[LF] == 255 && state.duty[RB] == 255, "blocked writes still set the duty");
+
+    // A second reason keeps the outputs cut until both are cleared
+    motors.forceOff(FORCE_OFF_TILT);
+    uint32_t reconnects = state.reconnects;
+    motors.restoreOutputs(FORCE_OFF_FAILSAFE);
+    check(motors.isForcedOff() && pinsAre(0, 0, 0, 0) && state.reconnects == reconnects,
+          "outputs stay cut while a reason remains");
+
+    // Clearing a reason that isn't set changes nothing
+    motors.restoreOutputs(FORCE_OFF_WATCHDOG);
+    check(motors.isForcedOff() && state.reconnects == reconnects, "clearing an unset reason is ignored");
+
+    motors.restoreOutputs(FORCE_OFF_TILT);
+    check(!motors.isForcedOff() && state.reconnects == reconnects + 4, "last reason reconnects all four pins");
+    check(state.reconnectDuty[LF] == 0 && state.reconnectDuty[LB] == 0 && state.reconnectDuty[RF] == 0 &&
+              state.reconnectDuty[RB] == 0,
+          "duty is zero before the pins reconnect");
+    check(pinsAre(0, 0, 0, 0) && motors.getLeftDirection() == MOTOR_STOPPED, "motors come back stopped");
+
+    motors.leftForward(60);
+    check(pinsAre(60, 0, 0, 0), "writes reach the pins again");
+    motors.stop();
+}
+
+static double nowNs()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static void benchmark(TankMotors &motors, uint32_t calls)
+{
+    const MockMotorHal::State &state = MockMotorHal::state();
+    uint32_t writes = state.writes;
+
+    // Alternate directions and powers so nothing folds into a constant
+    double start = nowNs();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        uint8_t power = i;
+        if (i & 1)
+            motors.leftForward(power);
+        else
+            motors.rightBackward(power);
+    }
+    double elapsed = nowNs() - start;
+    check(state.writes - writes == calls * 2, "every call writes two pins");
+
+    // The same duty writes straight into the mock, without TankMotors around them
+    volatile uint8_t sink = 0;
+    start = nowNs();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        uint8_t power = i + sink;
+        if (i & 1)
+        {
+            MockMotorHal::writeDuty(LF, power);
+            MockMotorHal::writeDuty(LB, 0);
+        }
+        else
+        {
+            MockMotorHal::writeDuty(RF, 0);
+            MockMotorHal::writeDuty(RB, power);
+        }
+    }
+    double direct = nowNs() - start;
+
+    printf("%u motor calls: %.1f ns per call, direct duty writes %.1f ns per pair\n", calls, elapsed / calls,
+           direct / calls);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t calls = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+
+    MockMotorHal::reset();
+    TankMotors motors(LF, LB, RF, RB);
+    motors.begin();
+
+    checkDuty(motors);
+    checkForceOff(motors);
+    benchmark(motors, calls);
+    check(metrics.getCounter(METRIC_MOTOR_WRITES) > 0, "motor writes are counted");
+
+    return checkResult();
+}
@@ -0,0 +1,164 @@
+// Host replay of InputPredictor against bursty Bluetooth delivery, see tools/host_sim.sh.
+//
+// A stick follows a known path (sweeps with pauses), the pad samples it every 4ms and the
+// reports arrive in bursts 10-50ms apart. The motor tick runs every millisecond and sets
+// the stick it acts on the way the sketch does: the newest report, or with prediction on,
+// the extrapolated report every INPUT_PREDICTOR_PERIOD_US until the horizon, then the last
+// real report again. Prints the lag that best lines the commanded stick up with the real
+// one, the mean error and step size, and the worst gap to the last real report once the
+// horizon has passed (must be 0).
+//
+// Usage: predict_replay [seconds] [seed]
+
+#include "InputPredictor.h"
+#include "Metrics.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define PAD_SAMPLE_MS 4
+#define BURST_MIN_MS 10
+#define BURST_MAX_MS 50
+#define MAX_LAG_MS 80
+
+// Sweeps of different speeds with holds in between, so the prediction has to stop too
+static double stickAt(double ms)
+{
+    double phase = fmod(ms, 2400.0);
+    if (phase < 900.0)
+        return 400.0 * sin(phase / 300.0);
+    if (phase < 1200.0)
+        return 400.0 * sin(3.0);
+    if (phase < 1700.0)
+        return 400.0 * sin(3.0) - (phase - 1200.0) * 0.9;
+    if (phase < 2000.0)
+        return 400.0 * sin(3.0) - 450.0;
+    return (400.0 * sin(3.0) - 450.0) * (2400.0 - phase) / 400.0;
+}
+
+struct Result
+{
+    int lagMs;
+    double meanError;
+    double meanStep;
+    int maxStep;
+    int maxHoldGap;
+};
+
+static Result replay(const std::vector<uint32_t> &bursts, int durationMs, bool predict)
+{
+    InputPredictor predictor;
+    std::vector<int16_t> commanded(durationMs, 0);
+    size_t next = 0;
+    int16_t command = 0;
+    int16_t lastReport = 0;
+    uint32_t lastArrivalMs = 0;
+    uint32_t lastTickUs = 0;
+    bool extrapolated = false;
+    bool started = false;
+    Result result = {};
+
+    for (int ms = 0; ms < durationMs; ms++)
+    {
+        uint32_t nowUs = ms * 1000;
+        bool fresh = false;
+        while (next < bursts.size() && bursts[next] <= (uint32_t)ms)
+        {
+            // Only the newest sample of a burst survives the coalescer
+            GamepadSnapshot report = {};
+            report.axisY = (int16_t)lround(stickAt(bursts[next] / PAD_SAMPLE_MS * PAD_SAMPLE_MS));
+            predictor.addReport(report, nowUs);
+            lastReport = report.axisY;
+            lastArrivalMs = ms;
+            next++;
+            fresh = true;
+            started = true;
+        }
+
+        if (fresh)
+        {
+            command = lastReport;
+            extrapolated = false;
+        }
+        else if (predict && nowUs - lastTickUs >= INPUT_PREDICTOR_PERIOD_US)
+        {
+            lastTickUs = nowUs;
+            GamepadSnapshot predicted;
+            if (predictor.predict(nowUs, predicted))
+            {
+                command = predicted.axisY;
+                extrapolated = true;
+            }
+            else if (extrapolated)
+            {
+                command = predicted.axisY;
+                extrapolated = false;
+            }
+        }
+        commanded[ms] = command;
+
+        if (started && (uint32_t)ms - lastArrivalMs > INPUT_PREDICTOR_HORIZON_US / 1000 + INPUT_PREDICTOR_PERIOD_US / 1000)
+        {
+            int gap = abs(command - lastReport);
+            if (gap > result.maxHoldGap)
+                result.maxHoldGap = gap;
+        }
+    }
+
+    // Lag: the shift that lines the commanded stick up best with the real one
+    double best = 1e18;
+    for (int lag = 0; lag < MAX_LAG_MS; lag++)
+    {
+        double sum = 0;
+        for (int ms = 1000; ms < durationMs; ms++)
+            sum += fabs(commanded[ms] - stickAt(ms - lag));
+        if (sum < best)
+        {
+            best = sum;
+            result.lagMs = lag;
+        }
+    }
+
+    double error = 0;
+    double steps = 0;
+    for (int ms = 1000; ms < durationMs; ms++)
+    {
+        error += fabs(commanded[ms] - stickAt(ms));
+        int step = abs(commanded[ms] - commanded[ms - 1]);
+        steps += step;
+        if (step > result.maxStep)
+            result.maxStep = step;
+    }
+    result.meanError = error / (durationMs - 1000);
+    result.meanStep = steps / (durationMs - 1000);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int durationMs = (argc > 1 ? atoi(argv[1]) : 20) * 1000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    std::vector<uint32_t> bursts;
+    for (uint32_t ms = 0; ms < (uint32_t)durationMs;)
+    {
+        ms += BURST_MIN_MS + rand() % (BURST_MAX_MS - BURST_MIN_MS + 1);
+        bursts.push_back(ms);
+    }
+
+    printf("%d s, %u bursts\n", durationMs / 1000, (unsigned)bursts.size());
+    for (int predict = 0; predict < 2; predict++)
+    {
+        Result result = replay(bursts, durationMs, predict);
+        printf("%-8s lag %2d ms, mean |error| %5.1f, mean step %.2f/ms, max step %3d, held gap %d\n",
+               predict ? "predict" : "hold", result.lagMs, result.meanError, result.meanStep, result.maxStep,
+               result.maxHoldGap);
+        if (predict && result.maxHoldGap != 0)
+        {
+            printf("FAIL: prediction still applied past the horizon\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,290 @@
+// Host simulation of a synchronized show across several tanks, see tools/host_sim.sh.
+//
+// The base node's clock is the true time. Each tank's crystal runs off by up to 80ppm
+// from a different starting point, beacons go out every CLOCK_SYNC_BEACON_PERIOD_MS as
+// packed frames, take the link delay plus up to 1.5ms of jitter and are sometimes lost.
+// Every tank runs a 1ms loop on its own clock and handles beacons and plays the armed
+// script the way the sketch does. The base starts a show every 15s, alternating the
+// built-in scripts. Prints each tank's skew estimate against its real drift, the worst
+// clock error once synced and once the skew fit has settled and, for every step of
+// every show, how far apart the tanks changed their setpoints.
+//
+// Usage: show_sync_sim [tanks] [minutes] [beacon loss %] [seed]
+
+#include "ChoreographyPlayer.h"
+#include "ClockSync.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define SIM_TICK_US 100
+#define SIM_LOOP_US 1000
+#define SIM_MAX_DRIFT_PPM 80
+#define SIM_JITTER_US 1500
+#define SIM_WARMUP_US 5000000ULL  // Clock errors count from here
+#define SIM_SETTLED_US 60000000ULL // The skew fit spans a full window from here
+#define SIM_MAX_SKEW_ERROR_PPM 5.0
+#define SIM_MAX_SETTLED_ERROR_US 750
+#define SIM_SHOW_PERIOD_US 15000000ULL
+#define SIM_SHOW_DELAY_MS 3000    // Same default as the 'show' command
+#define SIM_MAX_SPREAD_US 5000    // "Within a few ms"
+
+struct Tank
+{
+    double drift;   // Local us per true us, minus 1
+    double offset;  // Local time at true time 0 (us)
+    uint64_t nextLoop;
+    ClockSync clockSync;
+    ChoreographyPlayer choreography;
+    uint32_t showStart;
+    int16_t left;
+    int16_t right;
+    std::vector<uint64_t> changes; // True time of each setpoint change in the current show
+    bool dropped;                  // Lost the base clock during the current show
+
+    // Frames in flight: arrival true time and the frame
+    std::vector<uint64_t> arrivals;
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<uint64_t> receivedAt;
+    std::vector<std::vector<uint8_t>> received;
+
+    uint64_t local(uint64_t trueUs) const
+    {
+        return (uint64_t)(trueUs * (1.0 + drift) + offset);
+    }
+};
+
+// As the sketch's handleBeacon()
+static void handleBeacon(Tank &tank, const ClockBeacon &beacon, uint64_t receivedAt)
+{
+    tank.clockSync.handleBeacon(beacon.baseTime, receivedAt);
+    if (beacon.showStart == tank.showStart)
+        return;
+
+    tank.showStart = beacon.showStart;
+    const ChoreographyScript *script = findChoreographyScript(beacon.scriptId);
+    if (tank.showStart != 0 && script != nullptr)
+        tank.choreography.start(script, tank.showStart);
+    else if (tank.choreography.isPlaying())
+    {
+        tank.choreography.stop();
+        tank.left = 0; // stopMotors()
+        tank.right = 0;
+    }
+}
+
+// As the sketch's processShow(), setpoint changes are noted at the true time
+static void processShow(Tank &tank, uint64_t trueUs)
+{
+    uint64_t localTime = tank.local(trueUs);
+    if (!tank.clockSync.isSynced(localTime))
+    {
+        tank.choreography.stop();
+        tank.left = 0; // stopMotors()
+        tank.right = 0;
+        tank.dropped = true;
+        return;
+    }
+
+    int16_t left, right;
+    uint32_t sharedTime = tank.clockSync.toShared(localTime) / 1000;
+    if (tank.choreography.update(sharedTime, left, right) && (left != tank.left || right != tank.right))
+    {
+        tank.left = left;
+        tank.right = right;
+        tank.changes.push_back(trueUs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int tankCount = argc > 1 ? atoi(argv[1]) : 4;
+    uint64_t durationUs = (argc > 2 ? atoi(argv[2]) : 10) * 60000000ULL;
+    int lossPercent = argc > 3 ? atoi(argv[3]) : 10;
+    srand(argc > 4 ? atoi(argv[4]) : 1);
+    if (tankCount < 2)
+    {
+        printf("Need at least 2 tanks\n");
+        return 2;
+    }
+
+    std::vector<Tank> tanks(tankCount);
+    for (Tank &tank : tanks)
+    {
+        tank.drift = (rand() % (2 * SIM_MAX_DRIFT_PPM + 1) - SIM_MAX_DRIFT_PPM) * 1e-6;
+        tank.offset = 1000000.0 + rand() % 60000000; // Powered up at different times
+        tank.nextLoop = tank.local(rand() % SIM_LOOP_US);
+        tank.showStart = 0;
+        tank.left = 0;
+        tank.right = 0;
+        tank.dropped = false;
+    }
+
+    uint32_t showStart = 0;
+    uint8_t scriptId = 0;
+    uint32_t shows = 0;
+    uint32_t beacons = 0;
+    uint32_t lost = 0;
+    double maxClockError = 0;
+    double maxSettledError = 0;
+    double maxSpread = 0;
+    double spreadSum = 0;
+    uint32_t steps = 0;
+    uint32_t shortShows = 0;
+    uint32_t dropouts = 0;
+
+    for (uint64_t trueUs = 0; trueUs < durationUs; trueUs += SIM_TICK_US)
+    {
+        // Base node: arm a show now and then, like the 'show' command, and send beacons
+        if (trueUs % SIM_SHOW_PERIOD_US == SIM_SHOW_PERIOD_US / 2)
+        {
+            // Score the last show: the tanks that kept the base clock must change setpoints
+            // together. Losing it stops the show on that tank, as it should.
+            if (showStart != 0)
+            {
+                size_t count = 0;
+                for (const Tank &tank : tanks)
+                {
+                    if (tank.dropped)
+                        dropouts++;
+                    else if (tank.changes.size() > count)
+                        count = tank.changes.size();
+                }
+                for (const Tank &tank : tanks)
+                    if (!tank.dropped && tank.changes.size() != count)
+                        shortShows++;
+                for (size_t i = 0; i < count; i++)
+                {
+                    uint64_t first = UINT64_MAX;
+                    uint64_t last = 0;
+                    for (const Tank &tank : tanks)
+                    {
+                        if (tank.dropped || i >= tank.changes.size())
+                            continue;
+                        if (tank.changes[i] < first)
+                            first = tank.changes[i];
+                        if (tank.changes[i] > last)
+                            last = tank.changes[i];
+                    }
+                    if (first > last)
+                        continue;
+                    double spread = (double)(last - first);
+                    spreadSum += spread;
+                    steps++;
+                    if (spread > maxSpread)
+                        maxSpread = spread;
+                }
+            }
+            for (Tank &tank : tanks)
+            {
+                tank.changes.clear();
+                tank.dropped = false;
+            }
+
+            scriptId = scriptId % 2 + 1;
+            showStart = trueUs / 1000 + SIM_SHOW_DELAY_MS;
+            shows++;
+        }
+        if (trueUs % (CLOCK_SYNC_BEACON_PERIOD_MS * 1000) == 0)
+        {
+            ClockBeacon beacon;
+            beacon.baseTime = trueUs;
+            beacon.showStart = showStart;
+            beacon.scriptId = scriptId;
+            std::vector<uint8_t> frame(CLOCK_SYNC_BEACON_SIZE);
+            packClockBeacon(beacon, frame.data());
+            for (Tank &tank : tanks)
+            {
+                beacons++;
+                if (rand() % 100 < lossPercent)
+                {
+                    lost++;
+                    continue;
+                }
+                tank.arrivals.push_back(trueUs + CLOCK_SYNC_LINK_DELAY_US + rand() % SIM_JITTER_US);
+                tank.frames.push_back(frame);
+            }
+        }
+
+        for (Tank &tank : tanks)
+        {
+            // Radio: frames are stamped with the local time they arrive at
+            for (size_t i = 0; i < tank.arrivals.size();)
+            {
+                if (tank.arrivals[i] > trueUs)
+                {
+                    i++;
+                    continue;
+                }
+                tank.receivedAt.push_back(tank.local(trueUs));
+                tank.received.push_back(tank.frames[i]);
+                tank.arrivals.erase(tank.arrivals.begin() + i);
+                tank.frames.erase(tank.frames.begin() + i);
+            }
+
+            // Loop pass on the tank's own clock
+            uint64_t localTime = tank.local(trueUs);
+            if (localTime < tank.nextLoop)
+                continue;
+            tank.nextLoop += SIM_LOOP_US;
+
+            for (size_t i = 0; i < tank.received.size(); i++)
+            {
+                ClockBeacon beacon;
+                if (unpackClockBeacon(tank.received[i].data(), tank.received[i].size(), beacon))
+                    handleBeacon(tank, beacon, tank.receivedAt[i]);
+            }
+            tank.received.clear();
+            tank.receivedAt.clear();
+
+            if (tank.choreography.isPlaying())
+                processShow(tank, trueUs);
+
+            if (trueUs >= SIM_WARMUP_US)
+            {
+                double error = fabs((double)(int64_t)(tank.clockSync.toShared(localTime) - trueUs));
+                if (error > maxClockError)
+                    maxClockError = error;
+                if (trueUs >= SIM_SETTLED_US && error > maxSettledError)
+                    maxSettledError = error;
+            }
+        }
+    }
+
+    printf("%d tanks, %llu min, %u beacons (%u lost), %u shows\n", tankCount,
+           (unsigned long long)(durationUs / 60000000ULL), beacons, lost, shows);
+    // Shared time runs 1 / (1 + drift) as fast as the tank's clock
+    double maxSkewError = 0;
+    for (size_t i = 0; i < tanks.size(); i++)
+    {
+        double expected = (1.0 / (1.0 + tanks[i].drift) - 1.0) * 1e6;
+        double skewError = fabs(tanks[i].clockSync.getSkewPpm() - expected);
+        if (skewError > maxSkewError)
+            maxSkewError = skewError;
+        printf("tank %u: drift %+4.0f ppm, skew %+6.1f ppm (expected %+6.1f), resets %u\n", (unsigned)i,
+               tanks[i].drift * 1e6, tanks[i].clockSync.getSkewPpm(), expected, tanks[i].clockSync.getResets());
+    }
+    printf("clock error max %.0f us, %.0f us once settled\n", maxClockError, maxSettledError);
+    printf("show dropouts (lost the base clock): %u\n", dropouts);
+    printf("step spread over %u steps: mean %.0f us, max %.0f us\n", steps, steps ? spreadSum / steps : 0.0,
+           maxSpread);
+
+    int failed = 0;
+    if (maxSkewError > SIM_MAX_SKEW_ERROR_PPM)
+    {
+        printf("FAIL: skew off the real drift by %.1f ppm, limit %.0f ppm\n", maxSkewError, SIM_MAX_SKEW_ERROR_PPM);
+        failed = 1;
+    }
+    if (durationUs > SIM_SETTLED_US && maxSettledError > SIM_MAX_SETTLED_ERROR_US)
+    {
+        printf("FAIL: settled clock error %.0f us, limit %d us\n", maxSettledError, SIM_MAX_SETTLED_ERROR_US);
+        failed = 1;
+    }
+    if (shortShows != 0 || steps == 0 || maxSpread > SIM_MAX_SPREAD_US)
+    {
+        printf("FAIL: %u tanks missed steps, limit %d us\n", shortShows, SIM_MAX_SPREAD_US);
+        failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,283 @@
+// Host simulation of the tilt guard, see tools/host_sim.sh.
+//
+// ImuTask samples SimulatedImu every IMU_TASK_PERIOD_MS and hands each sample to TiltGuard,
+// which cuts TankMotors on MockMotorHal; the loop's update() runs every millisecond. The
+// sensor returns the motion IMU_FILTER_DELAY_US late, like the MPU-6050's low-pass filter
+// at the setting Imu.cpp uses, so the cut latency is measured from the moment the tank
+// really crossed the cut angle. Checks:
+// - hard launches and braking on the flat never limit the power
+// - standing on a ramp between the warn and cut angles caps the power part of the way
+// - tipping over nose up, nose down or sideways cuts the outputs within
+//   TILT_MAX_CUT_LATENCY_US of the crossing, whatever the sampling phase; tipping slowly,
+//   within half a degree of the angle
+// - the motors come back, stopped, once the tank is level for TILT_CLEAR_MS
+// - samples that stop coming cut the outputs after TILT_STALE_MS
+// Exits non-zero when a check fails.
+//
+// Usage: tilt_sim [phases per tip] [seed]
+
+#include "ImuTask.h"
+#include "Metrics.h"
+#include "TankMotors.h"
+#include "TiltGuard.h"
+#include "check.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIM_STEP_US 100
+#define SIM_LOOP_US 1000
+#define SIM_TIP_AT_US 3000000      // After the first sample's noise has settled
+#define SIM_TIP_PEAK_DEG 45
+#define SIM_NOISE_G 0.03
+#define SIM_NOISE_DPS 1.0
+#define SIM_CLEAR_SLACK_US 20000   // Restore within this of TILT_CLEAR_MS after level
+#define SIM_SLOW_CUT_DEG 0.5       // Slow tips cut within this of the angle
+
+// The tank's motion at one moment: degrees, degrees per second and g
+struct Motion
+{
+    double pitch; // Nose up
+    double roll;  // Left side up
+    double pitchRate;
+    double rollRate;
+    double accel; // Forward
+};
+
+struct Scenario
+{
+    const char *name;
+    double pitchRate; // Tip rate while tipping over, 0 for none
+    double rollRate;
+    double rampDeg; // Standing nose up from the start
+};
+
+// Tip at a steady rate up to SIM_TIP_PEAK_DEG, hold, then fall back level just as fast
+static void tip(double rate, double t, double &angle, double &angleRate)
+{
+    double duration = SIM_TIP_PEAK_DEG / fabs(rate);
+    double start = SIM_TIP_AT_US / 1e6;
+    angle = 0;
+    angleRate = 0;
+    if (t < start)
+        return;
+    if (t < start + duration)
+    {
+        angle = rate * (t - start);
+        angleRate = rate;
+    }
+    else if (t < start + duration + 0.2)
+        angle = SIM_TIP_PEAK_DEG * (rate > 0 ? 1 : -1);
+    else if (t < start + 2 * duration + 0.2)
+    {
+        angle = rate * (start + 2 * duration + 0.2 - t);
+        angleRate = -rate;
+    }
+}
+
+static Motion motionAt(const Scenario &scenario, double t)
+{
+    Motion motion = {scenario.rampDeg, 0, 0, 0, 0};
+    if (scenario.pitchRate != 0)
+        tip(scenario.pitchRate, t, motion.pitch, motion.pitchRate);
+    if (scenario.rollRate != 0)
+        tip(scenario.rollRate, t, motion.roll, motion.rollRate);
+
+    // On the flat: a full-power launch and a hard stop every second
+    if (scenario.pitchRate == 0 && scenario.rollRate == 0 && scenario.rampDeg == 0)
+    {
+        double phase = fmod(t, 1.0);
+        motion.accel = phase >= 0.25 && phase < 0.5 ? 0.4 : phase >= 0.75 && phase < 0.92 ? -0.6 : 0;
+    }
+    return motion;
+}
+
+static double noise(double amplitude)
+{
+    return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// What the sensor reports at time t: the motion from IMU_FILTER_DELAY_US ago
+static void feed(SimulatedImu &imu, const Scenario &scenario, uint32_t now)
+{
+    double t = ((double)now - IMU_FILTER_DELAY_US) / 1e6;
+    Motion motion = motionAt(scenario, t < 0 ? 0 : t);
+    double pitch = motion.pitch * M_PI / 180;
+    double roll = motion.roll * M_PI / 180;
+
+    // Gravity seen from the tank, plus its own acceleration along X. Nose up turns
+    // negative about Y, left side up positive about X.
+    imu.setAccelG(sin(pitch) + motion.accel + noise(SIM_NOISE_G), cos(pitch) * sin(roll) + noise(SIM_NOISE_G),
+                  cos(pitch) * cos(roll) + noise(SIM_NOISE_G));
+    imu.setGyroDps(motion.rollRate + noise(SIM_NOISE_DPS), -motion.pitchRate + noise(SIM_NOISE_DPS),
+                   noise(SIM_NOISE_DPS));
+    imu.setTimeUs(now);
+}
+
+struct Result
+{
+    uint32_t cutUs;       // When the outputs went off, 0 if never
+    uint32_t restoredUs;  // When they came back, 0 if never
+    bool restoredStopped; // ...with every pin low
+    double maxPitch;      // Largest angle the guard saw
+    double maxRoll;
+    uint16_t lowestLimit;
+    uint16_t lastLimit;
+    uint32_t guardLatencyUs; // As the guard measured it
+};
+
+static TankMotors motors(33, 32, 25, 26);
+
+// Run a scenario with the motors driven forward, the first sample phaseUs in
+static Result run(const Scenario &scenario, uint32_t phaseUs, uint32_t durationUs, uint32_t failAtUs)
+{
+    motors.restoreOutputs(FORCE_OFF_TILT);
+    motors.stop();
+    SimulatedImu imu;
+    imu.begin();
+    TiltGuard guard;
+    guard.begin(motors);
+    ImuTask task;
+    task.begin(imu, guard);
+
+    Result result = {0, 0, false, 0, 0, 256, 256, 0};
+    uint32_t periodUs = IMU_TASK_PERIOD_MS * 1000;
+    for (uint32_t now = SIM_STEP_US; now < durationUs; now += SIM_STEP_US)
+    {
+        if (now % periodUs == phaseUs)
+        {
+            imu.setFailing(now >= failAtUs);
+            feed(imu, scenario, now);
+            task.step();
+            if (result.cutUs == 0 && motors.isForcedOff())
+            {
+                result.cutUs = now;
+                result.guardLatencyUs = guard.getLastCutLatencyUs();
+            }
+            if (fabs(guard.getPitch()) > result.maxPitch)
+                result.maxPitch = fabs(guard.getPitch());
+            if (fabs(guard.getRoll()) > result.maxRoll)
+                result.maxRoll = fabs(guard.getRoll());
+            if (guard.getPowerLimit() < result.lowestLimit)
+                result.lowestLimit = guard.getPowerLimit();
+            result.lastLimit = guard.getPowerLimit();
+        }
+
+        if (now % SIM_LOOP_US == 0)
+        {
+            // The loop: drive on as the cap allows, notice a trip or a reconnect
+            bool changed = guard.update(now);
+            if (changed && !guard.isTripped() && result.cutUs != 0 && result.restoredUs == 0)
+            {
+                result.restoredUs = now;
+                result.restoredStopped = MockMotorHal::pinLevel(33) == 0 && MockMotorHal::pinLevel(25) == 0 &&
+                                         motors.getLeftDirection() == MOTOR_STOPPED;
+            }
+            if (!guard.isTripped() && result.restoredUs == 0)
+            {
+                motors.leftForward(guard.limitPower(255));
+                motors.rightForward(guard.limitPower(255));
+            }
+        }
+    }
+    return result;
+}
+
+static void checkFlat()
+{
+    Scenario flat = {"flat, launch and brake", 0, 0, 0};
+    Result result = run(flat, 0, 5000000, UINT32_MAX);
+    printf("%-24s largest pitch %.1f deg, power %u/256\n", flat.name, result.maxPitch, result.lowestLimit);
+    check(result.cutUs == 0 && result.lowestLimit == 256, "launches and braking leave full power");
+}
+
+static void checkRamp()
+{
+    double ramp = (TILT_WARN_PITCH_DEG + TILT_CUT_PITCH_DEG) / 2.0;
+    Scenario scenario = {"standing on a ramp", 0, 0, ramp};
+    Result result = run(scenario, 0, 2000000, UINT32_MAX);
+    uint16_t expected = 256 - (256 - TILT_LIMIT_FLOOR) / 2;
+    printf("%-24s %.1f deg, power %u/256\n", scenario.name, ramp, result.lastLimit);
+    check(result.cutUs == 0 && abs(result.lastLimit - expected) <= 4, "power capped halfway to the floor");
+}
+
+static void checkTips(uint32_t phases)
+{
+    const Scenario tips[] = {
+        {"nose up, 200 dps", 200, 0, 0},
+        {"nose down, 200 dps", -200, 0, 0},
+        {"left side up, 200 dps", 0, 200, 0},
+        {"nose up, 20 dps", 20, 0, 0},
+    };
+    uint32_t periodUs = IMU_TASK_PERIOD_MS * 1000;
+    for (const Scenario &scenario : tips)
+    {
+        double cutDeg = scenario.pitchRate != 0 ? TILT_CUT_PITCH_DEG : TILT_CUT_ROLL_DEG;
+        double rate = fabs(scenario.pitchRate != 0 ? scenario.pitchRate : scenario.rollRate);
+        double tipUs = SIM_TIP_PEAK_DEG / rate * 1e6;
+        int32_t crossingUs = SIM_TIP_AT_US + (int32_t)(cutDeg / rate * 1e6);
+
+        // Under the clear angle again while falling back, the sensor sees it a little later
+        uint32_t clearUs = SIM_TIP_AT_US + (uint32_t)(2 * tipUs + 200000 - TILT_CLEAR_DEG / rate * 1e6) +
+                           IMU_FILTER_DELAY_US + TILT_CLEAR_MS * 1000;
+
+        int32_t earliest = INT32_MAX;
+        int32_t latest = INT32_MIN;
+        uint32_t worstGuard = 0;
+        uint32_t worstClear = 0;
+        for (uint32_t i = 0; i < phases; i++)
+        {
+            uint32_t phase = (i * periodUs / phases) / SIM_STEP_US * SIM_STEP_US;
+            Result result = run(scenario, phase, clearUs + 500000, UINT32_MAX);
+            check(result.cutUs != 0, "tipping over cuts the outputs");
+            if (result.cutUs == 0)
+                continue;
+
+            int32_t latency = (int32_t)result.cutUs - crossingUs;
+            earliest = latency < earliest ? latency : earliest;
+            latest = latency > latest ? latency : latest;
+            worstGuard = result.guardLatencyUs > worstGuard ? result.guardLatencyUs : worstGuard;
+
+            check(result.restoredUs != 0 && result.restoredStopped, "motors come back stopped");
+            uint32_t offset = abs((int32_t)(result.restoredUs - clearUs));
+            worstClear = offset > worstClear ? offset : worstClear;
+        }
+        printf("%-24s cut %d..%dus after the crossing (guard measured up to %uus), back %ums level +-%uus\n",
+               scenario.name, earliest, latest, worstGuard, TILT_CLEAR_MS, worstClear);
+        // Slowly, the filter's last tenth of a degree takes longer than the budget
+        check(latest <= TILT_MAX_CUT_LATENCY_US || latest * rate / 1e6 <= SIM_SLOW_CUT_DEG,
+              "cut within the latency budget");
+        check(-earliest * rate / 1e6 <= SIM_SLOW_CUT_DEG, "no cut well before the angle");
+        check(worstGuard + IMU_FILTER_DELAY_US <= TILT_MAX_CUT_LATENCY_US, "guard's own share within the budget");
+        check(worstClear <= SIM_CLEAR_SLACK_US, "motors held off until level for a while");
+    }
+    check(metrics.getCounter(METRIC_TILT_LATE_CUTS) == 0, "no cut counted late");
+}
+
+static void checkStale()
+{
+    Scenario flat = {"samples stop", 0, 0, 0};
+    uint32_t failAtUs = 1000000;
+    Result result = run(flat, 0, 1500000, failAtUs);
+    printf("%-24s cut %ums after the last sample\n", flat.name, (result.cutUs - failAtUs) / 1000);
+    check(result.cutUs > failAtUs && result.cutUs <= failAtUs + TILT_STALE_MS * 1000 + SIM_LOOP_US,
+          "stopped samples cut the outputs");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t phases = argc > 1 ? atoi(argv[1]) : 20;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    if (phases < 1)
+        phases = 1;
+
+    printf("budget %uus, %uus of it in the sensor's filter\n", TILT_MAX_CUT_LATENCY_US, IMU_FILTER_DELAY_US);
+    MockMotorHal::reset();
+    motors.begin();
+    checkFlat();
+    checkRamp();
+    checkTips(phases);
+    checkStale();
+
+    return checkResult();
+}
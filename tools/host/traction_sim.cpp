@@ -0,0 +1,175 @@
+// Host simulation of traction control, see tools/host_sim.sh.
+//
+// The tank stands parked for a moment, then the driver holds both sticks fully forward.
+// Each track reaches the power it gets with a first-order lag. Where the tracks grip, the
+// tank follows their speed; where they are stuck (in mud, against a step), the tracks spin
+// and the tank doesn't move at all. Some runs drive onto a 10 degree ramp, others stand on
+// it from the start. The tank's acceleration, pitch and pitch rate go through SimulatedImu
+// with sensor offsets and noise, and TractionControl runs every TRACTION_PERIOD_US with the
+// power it let through, the way processImuControl() does. Checks:
+// - gripping on the flat or onto a ramp, neither track is ever cut
+// - stuck tracks are cut to the floor and stay cut for as long as they spin, also when
+//   they get stuck after driving onto a ramp
+// - tracks that were stuck get full power back once they grip
+// Exits non-zero when a check fails.
+//
+// Usage: traction_sim [seconds driven] [seed]
+
+#include "Imu.h"
+#include "TractionControl.h"
+#include "check.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIM_STEP_US 1000
+#define SIM_PARKED_US 1000000       // Long enough to learn the accelerometer's zero
+#define SIM_TRACK_TAU_US 150000
+#define SIM_FULL_SPEED_MMS 550      // A bit slower than the model thinks
+#define SIM_STOP_TAU_US 20000       // Tank stopping when the tracks get stuck
+#define SIM_ACCEL_OFFSET_G 0.02     // Learned while parked
+#define SIM_NOISE_G 0.02
+#define SIM_GYRO_OFFSET_DPS 0.2     // Left after the bias measured at begin()
+#define SIM_GYRO_NOISE_DPS 0.5
+#define SIM_RAMP_DEG 10
+#define SIM_RAMP_US 300000          // Time to tip onto the ramp
+#define SIM_LATCHED_LIMIT 128       // Stuck tracks stay at or below this
+#define SIM_LATCH_CHECK_US 2000000  // Over the last 2 s
+#define SIM_NEVER UINT32_MAX
+#define SIM_DRIVEN(ms) (SIM_PARKED_US + (ms) * 1000) // Time since power on
+
+struct Scenario
+{
+    const char *name;
+    double rampDeg;      // Nose up
+    uint32_t rampAtUs;   // Since power on
+    uint32_t stuckFromUs;
+    uint32_t stuckUntilUs;
+};
+
+static double noise(double amplitude)
+{
+    return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// Pitch in degrees, tipping onto the ramp at a steady rate
+static double pitchAt(const Scenario &scenario, uint32_t now)
+{
+    if (now < scenario.rampAtUs)
+        return 0;
+    if (now >= scenario.rampAtUs + SIM_RAMP_US || scenario.rampAtUs == 0)
+        return scenario.rampDeg;
+    return scenario.rampDeg * (now - scenario.rampAtUs) / SIM_RAMP_US;
+}
+
+struct Result
+{
+    uint32_t slips;
+    uint16_t lowest;  // Lowest limit of either track
+    uint16_t highest; // Highest limit of either track over the last SIM_LATCH_CHECK_US
+    uint16_t last;    // Lower of the two limits at the end
+};
+
+static Result run(const Scenario &scenario, uint32_t drivenUs)
+{
+    SimulatedImu imu;
+    TractionControl traction;
+    imu.begin();
+
+    double track[2] = {0, 0}; // Track speed, mm/s
+    double speed = 0;         // Tank speed, mm/s
+    double tickSpeed = 0;     // ...at the last control step
+    Result result = {0, 256, 0, 256};
+    uint32_t endUs = SIM_PARKED_US + drivenUs;
+
+    for (uint32_t now = 0; now < endUs; now += SIM_STEP_US)
+    {
+        bool driving = now >= SIM_PARKED_US;
+        int16_t power[2] = {0, 0};
+        if (driving)
+        {
+            power[0] = traction.limitLeft(255);
+            power[1] = traction.limitRight(255);
+        }
+
+        // Tracks follow their power, the tank follows the tracks unless they are stuck, then
+        // it comes to a stop within a few tens of milliseconds
+        double alpha = (double)SIM_STEP_US / SIM_TRACK_TAU_US;
+        for (int i = 0; i < 2; i++)
+            track[i] += (power[i] * SIM_FULL_SPEED_MMS / 255.0 - track[i]) * alpha;
+        bool stuck = now >= scenario.stuckFromUs && now < scenario.stuckUntilUs;
+        speed = stuck ? speed * (1 - (double)SIM_STEP_US / SIM_STOP_TAU_US) : (track[0] + track[1]) / 2;
+
+        if (now % TRACTION_PERIOD_US == 0)
+        {
+            // The sensor's filter averages the acceleration over the step
+            double accelG = (speed - tickSpeed) / (TRACTION_PERIOD_US / 1e6) / 9807.0;
+            tickSpeed = speed;
+
+            // Nose up tips gravity towards +X and turns negative about Y
+            double pitch = pitchAt(scenario, now) * M_PI / 180;
+            double pitchRate = (pitchAt(scenario, now + SIM_STEP_US) - pitchAt(scenario, now)) * 1e6 / SIM_STEP_US;
+            imu.setAccelG(accelG + sin(pitch) + SIM_ACCEL_OFFSET_G + noise(SIM_NOISE_G), 0, cos(pitch));
+            imu.setGyroDps(0, -pitchRate + SIM_GYRO_OFFSET_DPS + noise(SIM_GYRO_NOISE_DPS), 0);
+            imu.setTimeUs(now);
+            ImuReading reading;
+            imu.read(reading);
+            traction.update(power[0], power[1], reading, 0);
+
+            uint16_t lower = traction.getLeftLimit() < traction.getRightLimit() ? traction.getLeftLimit()
+                                                                                 : traction.getRightLimit();
+            uint16_t higher = traction.getLeftLimit() > traction.getRightLimit() ? traction.getLeftLimit()
+                                                                                  : traction.getRightLimit();
+            if (lower < result.lowest)
+                result.lowest = lower;
+            if (now >= endUs - SIM_LATCH_CHECK_US && higher > result.highest)
+                result.highest = higher;
+            result.last = lower;
+        }
+    }
+    result.slips = traction.getLeftSlips() + traction.getRightSlips();
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t drivenUs = (argc > 1 ? atoi(argv[1]) : 5) * 1000000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    if (drivenUs < 5000000)
+        drivenUs = 5000000;
+
+    const Scenario gripping[] = {
+        {"grips, flat", 0, SIM_NEVER, SIM_NEVER, SIM_NEVER},
+        {"grips onto uphill", SIM_RAMP_DEG, SIM_DRIVEN(1500), SIM_NEVER, SIM_NEVER},
+        {"grips onto downhill", -SIM_RAMP_DEG, SIM_DRIVEN(1500), SIM_NEVER, SIM_NEVER},
+    };
+    const Scenario stuck[] = {
+        {"stuck, flat", 0, SIM_NEVER, 0, SIM_NEVER},
+        {"stuck, uphill", SIM_RAMP_DEG, 0, 0, SIM_NEVER},
+        {"stuck, downhill", -SIM_RAMP_DEG, 0, 0, SIM_NEVER},
+        {"up a ramp, stuck", SIM_RAMP_DEG, SIM_DRIVEN(1000), SIM_DRIVEN(2500), SIM_NEVER},
+        {"down a ramp, stuck", -SIM_RAMP_DEG, SIM_DRIVEN(1000), SIM_DRIVEN(2500), SIM_NEVER},
+    };
+    const Scenario freed = {"stuck for 1s, flat", 0, SIM_NEVER, 0, SIM_DRIVEN(1000)};
+
+    printf("%-21s %5s %7s %8s %5s  (limits of 256)\n", "", "slips", "lowest", "last 2s", "end");
+    for (const Scenario &scenario : gripping)
+    {
+        Result result = run(scenario, drivenUs);
+        printf("%-21s %5u %7u %8u %5u\n", scenario.name, result.slips, result.lowest, result.highest, result.last);
+        check(result.slips == 0 && result.lowest == 256, "gripping tracks keep full power");
+    }
+    for (const Scenario &scenario : stuck)
+    {
+        Result result = run(scenario, drivenUs);
+        printf("%-21s %5u %7u %8u %5u\n", scenario.name, result.slips, result.lowest, result.highest, result.last);
+        check(result.lowest == TRACTION_LIMIT_FLOOR, "stuck tracks are cut to the floor");
+        check(result.highest <= SIM_LATCHED_LIMIT, "stuck tracks stay cut while they spin");
+    }
+    Result result = run(freed, drivenUs);
+    printf("%-21s %5u %7u %8u %5u\n", freed.name, result.slips, result.lowest, result.highest, result.last);
+    check(result.slips > 0, "stuck tracks are cut");
+    check(result.last == 256, "full power back once they grip");
+
+    return checkResult();
+}
@@ -0,0 +1,271 @@
+// Host run of the serial firmware update against FileUpdatePartition, see tools/host_sim.sh.
+//
+// Plays the host side of tools/serial_update.py frame by frame into FirmwareUpdate and
+// checks every STATUS reply. The slot files behave like NOR flash, so an image written
+// over an old one only comes out right if every sector was erased first. Four updates:
+// - a fresh image into slot b, kept by the self test
+// - a fresh image into slot a
+// - an image over the old one in slot b, cut off halfway through, with a repeated and a
+//   misplaced chunk, then resumed with the same BEGIN
+// - an image sent with the wrong hash, which must not be activated
+// Prints each update's frames and loop passes and exits non-zero when a check fails.
+//
+// Usage: update_resume [image bytes] [seed]
+
+#include "FirmwareUpdate.h"
+#include "Sha256.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#define CHUNK 512
+
+static std::vector<uint8_t> replies;
+
+static void output(const uint8_t *data, size_t length)
+{
+    replies.insert(replies.end(), data, data + length);
+}
+
+// Same CRC-32 as the firmware and tools/serial_update.py
+static uint32_t crc32(const uint8_t *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (length--)
+    {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(value >> (8 * i));
+}
+
+static std::vector<uint8_t> frame(uint8_t type, const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> out = {FIRMWARE_UPDATE_SYNC, type, (uint8_t)payload.size(), (uint8_t)(payload.size() >> 8)};
+    out.insert(out.end(), payload.begin(), payload.end());
+    putU32(out, crc32(out.data() + 1, out.size() - 1));
+    return out;
+}
+
+struct Reply
+{
+    bool received;
+    uint8_t status;
+    uint32_t offset;
+};
+
+// Take the one STATUS frame the last request produced
+static Reply takeReply()
+{
+    Reply reply = {false, 0, 0};
+    if (replies.size() == 13 && replies[0] == FIRMWARE_UPDATE_SYNC && replies[1] == FIRMWARE_UPDATE_STATUS &&
+        crc32(replies.data() + 1, 8) == (uint32_t)(replies[9] | replies[10] << 8 | replies[11] << 16 | replies[12] << 24))
+    {
+        reply.received = true;
+        reply.status = replies[4];
+        reply.offset = replies[5] | replies[6] << 8 | replies[7] << 16 | (uint32_t)replies[8] << 24;
+    }
+    check(replies.empty() || reply.received, "reply is one well-formed STATUS frame");
+    replies.clear();
+    return reply;
+}
+
+struct Session
+{
+    FirmwareUpdate &update;
+    unsigned long now;
+    int frames;
+    int passes;
+
+    // One loop pass of the sketch's processFirmwareUpdate()
+    void pass(const std::vector<uint8_t> &bytes)
+    {
+        update.receive(bytes.data(), bytes.size(), now);
+        update.update(now);
+        now++;
+        passes++;
+    }
+
+    // Send a frame and run loop passes until the reply comes, like the host tool waiting
+    Reply request(uint8_t type, const std::vector<uint8_t> &payload)
+    {
+        frames++;
+        pass(frame(type, payload));
+        for (int wait = 0; replies.empty() && wait < 10000; wait++)
+            pass({});
+        return takeReply();
+    }
+
+    Reply begin(const std::vector<uint8_t> &image, const uint8_t *hash)
+    {
+        std::vector<uint8_t> payload;
+        putU32(payload, image.size());
+        payload.insert(payload.end(), hash, hash + SHA256_DIGEST_SIZE);
+        return request(FIRMWARE_UPDATE_BEGIN, payload);
+    }
+
+    Reply data(const std::vector<uint8_t> &image, uint32_t offset)
+    {
+        std::vector<uint8_t> payload;
+        putU32(payload, offset);
+        uint32_t length = image.size() - offset < CHUNK ? image.size() - offset : CHUNK;
+        payload.insert(payload.end(), image.begin() + offset, image.begin() + offset + length);
+        return request(FIRMWARE_UPDATE_DATA, payload);
+    }
+
+    // Send chunks from offset until the tank has stopAt bytes, returns its offset
+    uint32_t send(const std::vector<uint8_t> &image, uint32_t offset, uint32_t stopAt)
+    {
+        while (offset < stopAt)
+        {
+            Reply reply = data(image, offset);
+            check(reply.received && reply.status == UPDATE_OK, "chunk accepted");
+            if (!reply.received || reply.status != UPDATE_OK)
+                break;
+            offset = reply.offset;
+        }
+        return offset;
+    }
+};
+
+static std::vector<uint8_t> makeImage(size_t size)
+{
+    std::vector<uint8_t> image(size);
+    for (size_t i = 0; i < size; i++)
+        image[i] = rand();
+    return image;
+}
+
+static void hashImage(const std::vector<uint8_t> &image, uint8_t *hash)
+{
+    Sha256 sha;
+    sha.update(image.data(), image.size());
+    sha.finish(hash);
+}
+
+static bool slotHolds(const char *basePath, char slot, const std::vector<uint8_t> &image)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s.%c", basePath, slot);
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    std::vector<uint8_t> content(image.size());
+    bool ok = fread(content.data(), 1, content.size(), file) == content.size() && content == image;
+    fclose(file);
+    return ok;
+}
+
+// Run one update the way the host tool does, optionally cut off at cutAt bytes and resumed
+static void runUpdate(const char *name, const char *basePath, const std::vector<uint8_t> &image, uint32_t cutAt,
+                      bool badHash)
+{
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    hashImage(image, hash);
+    if (badHash)
+        hash[0] ^= 1;
+
+    FileUpdatePartition partition(basePath);
+    FirmwareUpdate update(partition, output);
+    Session session = {update, 1000, 0, 0};
+    char startSlot = partition.getBootSlot();
+
+    update.start(session.now);
+    Reply reply = session.begin(image, hash);
+    check(reply.received && reply.status == UPDATE_OK && reply.offset == 0, "BEGIN accepted");
+
+    uint32_t offset = session.send(image, 0, cutAt);
+    if (cutAt < image.size())
+    {
+        // A chunk sent twice is acknowledged again, one from the future is refused
+        reply = session.data(image, offset - CHUNK);
+        check(reply.received && reply.status == UPDATE_OK && reply.offset == offset, "repeated chunk acknowledged");
+        reply = session.data(image, offset + CHUNK);
+        check(reply.received && reply.status == UPDATE_BAD_OFFSET && reply.offset == offset, "misplaced chunk refused");
+
+        // The host goes away, the loop times update mode out, then the host starts over
+        session.now += FIRMWARE_UPDATE_TIMEOUT_MS + 1;
+        session.pass({});
+        check(!update.isActive(), "update mode times out");
+        update.start(session.now);
+
+        reply = session.begin(image, hash);
+        check(reply.received && reply.status == UPDATE_OK && reply.offset == offset, "BEGIN resumes at the last chunk");
+        offset = reply.offset;
+    }
+    offset = session.send(image, offset, image.size());
+
+    // END is answered only after the whole image was read back
+    int passesBefore = session.passes;
+    reply = session.request(FIRMWARE_UPDATE_END, {});
+    int verifyPasses = session.passes - passesBefore;
+    int slices = (image.size() + FIRMWARE_UPDATE_VERIFY_SLICE - 1) / FIRMWARE_UPDATE_VERIFY_SLICE;
+    check(verifyPasses >= slices, "image hashed over several loop passes");
+
+    char otherSlot = startSlot == 'a' ? 'b' : 'a';
+    if (badHash)
+    {
+        check(reply.received && reply.status == UPDATE_HASH_MISMATCH, "wrong hash refused");
+        check(!update.isComplete() && partition.getBootSlot() == startSlot, "wrong image not activated");
+    }
+    else
+    {
+        check(reply.received && reply.status == UPDATE_OK, "END verifies the image");
+        check(update.isComplete() && partition.getBootSlot() == otherSlot, "new slot boots next");
+        check(slotHolds(basePath, otherSlot, image), "slot holds the image");
+        check(partition.isPendingVerify(), "new image on probation");
+
+        // Next boot: the self test keeps it once it ran long enough
+        FirmwareUpdate booted(partition, output);
+        booted.checkSelfTest(FIRMWARE_UPDATE_SELF_TEST_MS + 1, true);
+        check(!partition.isPendingVerify(), "self test keeps the image");
+    }
+
+    printf("%-22s %7zu bytes  %4d frames  %5d loop passes  %3d to verify\n", name, image.size(), session.frames,
+           session.passes, verifyPasses);
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = argc > 1 ? atoi(argv[1]) : 100000 + 123;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    char directory[] = "/tmp/update_resume.XXXXXX";
+    if (mkdtemp(directory) == nullptr)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    char basePath[200];
+    snprintf(basePath, sizeof(basePath), "%s/slot", directory);
+
+    std::vector<uint8_t> first = makeImage(size);
+    std::vector<uint8_t> second = makeImage(size + 777);
+    std::vector<uint8_t> third = makeImage(size - 555);
+
+    runUpdate("fresh into b", basePath, first, size, false);
+    runUpdate("fresh into a", basePath, second, size + 777, false);
+    runUpdate("over b, resumed", basePath, third, (size - 555) / 2 / CHUNK * CHUNK, false);
+    runUpdate("wrong hash", basePath, makeImage(size), size, true);
+
+    char path[256];
+    for (const char *suffix : {".a", ".b", ".boot"})
+    {
+        snprintf(path, sizeof(path), "%s%s", basePath, suffix);
+        remove(path);
+    }
+    rmdir(directory);
+
+    return checkResult();
+}
@@ -0,0 +1,142 @@
+// Host simulation of closed-loop steering, see tools/host_sim.sh.
+//
+// Each track follows its power with a first-order lag (YAW_REFERENCE_SHIFT control
+// periods), and the ground turns the power difference into yaw rate with a gain k: 1 is
+// the ideal surface the feedforward assumes, below 1 is carpet, above 1 a slippery floor.
+// The yaw rate goes through SimulatedImu with a little gyro noise and the sketch's axis
+// sign, and YawRateController runs every YAW_CONTROL_PERIOD_US the way processImuControl()
+// does. Checks:
+// - open loop, a 90 dps command settles at k times that; closed loop it settles on the
+//   target for every k, without overshoot
+// - turning left settles exactly as far from the target as turning right
+// - the reference rate reaches the target from either side
+// - driving straight with one track 10% weaker, the heading drifts far less closed loop
+// Exits non-zero when a check fails.
+//
+// Usage: yaw_sim [seconds per run] [seed]
+
+#include "Imu.h"
+#include "TankConfig.h"
+#include "YawRateController.h"
+#include "check.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIM_STEP_US 1000
+#define SIM_TRACK_TAU_US (YAW_CONTROL_PERIOD_US << YAW_REFERENCE_SHIFT)
+#define SIM_NOISE_DPS 0.5
+#define SIM_TURN 127                // Stick differential for about 90 dps
+#define SIM_MAX_SETTLED_ERROR_DPS 0.5
+#define SIM_MAX_OVERSHOOT_DPS 2.0
+#define SIM_MAX_CLOSED_DRIFT_DEG 1.0
+
+struct Result
+{
+    double settled; // Mean rate over the last quarter, dps
+    double peak;    // Largest rate in the direction of the turn, dps
+    double heading; // deg
+};
+
+// Drive with forward and turn power for the given time, closed loop or open loop
+static Result run(double k, int16_t forward, int16_t turn, double rightGrip, bool closedLoop, uint32_t durationUs)
+{
+    SimulatedImu imu;
+    YawRateController controller;
+    imu.begin();
+    if (closedLoop)
+        controller.setCommand(forward, turn);
+
+    double left = 0, right = 0; // Track power actually delivered, -255..255
+    double rate = 0;            // Yaw rate, dps clockwise
+    int16_t leftPower = forward + turn;
+    int16_t rightPower = forward - turn;
+    Result result = {0, 0, 0};
+    uint32_t settledSamples = 0;
+    double direction = turn >= 0 ? 1 : -1;
+
+    for (uint32_t now = 0; now < durationUs; now += SIM_STEP_US)
+    {
+        if (closedLoop && now % YAW_CONTROL_PERIOD_US == 0)
+        {
+            // As processImuControl(): gyro through the chip's units and the axis sign
+            double noise = SIM_NOISE_DPS * (2.0 * rand() / RAND_MAX - 1.0);
+            imu.setGyroDps(0, 0, TANK_CONFIG.imuYawSign * (rate + noise));
+            imu.setTimeUs(now);
+            ImuReading reading;
+            imu.read(reading);
+            controller.update(TANK_CONFIG.imuYawSign * reading.gyro[IMU_Z], leftPower, rightPower);
+        }
+
+        // Tracks lag their power, the ground turns the difference into yaw rate
+        double alpha = (double)SIM_STEP_US / SIM_TRACK_TAU_US;
+        left += (leftPower - left) * alpha;
+        right += (rightPower * rightGrip - right) * alpha;
+        rate = k * YAW_MAX_RATE_DPS * (left - right) / (2.0 * 255);
+        result.heading += rate * SIM_STEP_US / 1e6;
+
+        if (rate * direction > result.peak)
+            result.peak = rate * direction;
+        if (now >= durationUs * 3 / 4)
+        {
+            result.settled += rate;
+            settledSamples++;
+        }
+    }
+    result.settled /= settledSamples;
+    return result;
+}
+
+static void checkReference()
+{
+    // Measured rate held at the target: the reference must end exactly on it both ways
+    for (int sign = -1; sign <= 1; sign += 2)
+    {
+        YawRateController controller;
+        controller.setCommand(0, sign * SIM_TURN);
+        int16_t left, right;
+        for (int i = 0; i < 400; i++)
+            controller.update(controller.getTargetRate(), left, right);
+        printf("reference %+ld of target %+ld LSB\n", (long)controller.getReferenceRate(),
+               (long)controller.getTargetRate());
+        check(controller.getReferenceRate() == controller.getTargetRate(), "reference reaches the target");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t durationUs = (argc > 1 ? atoi(argv[1]) : 2) * 1000000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    YawRateController probe;
+    probe.setCommand(0, SIM_TURN);
+    double target = probe.getTargetRate() * 10.0 / IMU_GYRO_LSB_PER_DPS_X10;
+    printf("target %.1f dps, track lag %dms\n", target, SIM_TRACK_TAU_US / 1000);
+
+    const double grips[] = {0.5, 1.0, 1.5};
+    for (double k : grips)
+    {
+        Result open = run(k, 0, SIM_TURN, 1.0, false, durationUs);
+        Result right = run(k, 0, SIM_TURN, 1.0, true, durationUs);
+        Result left = run(k, 0, -SIM_TURN, 1.0, true, durationUs);
+        printf("k %.1f: open loop %5.1f dps, closed loop %5.1f / %5.1f dps (right / left), overshoot %.1f dps\n", k,
+               open.settled, right.settled, left.settled, fmax(right.peak, left.peak) - target);
+
+        check(fabs(open.settled - k * target) < 1.0, "open loop follows the ground gain");
+        check(fabs(right.settled - target) < SIM_MAX_SETTLED_ERROR_DPS, "closed loop settles on the target");
+        check(fabs(right.settled + left.settled) < 0.2, "left and right turns settle alike");
+        check(right.peak - target < SIM_MAX_OVERSHOOT_DPS && left.peak - target < SIM_MAX_OVERSHOOT_DPS,
+              "no overshoot");
+    }
+
+    checkReference();
+
+    // Straight line with a weak right track
+    Result open = run(1.0, 200, 0, 0.9, false, durationUs);
+    Result closed = run(1.0, 200, 0, 0.9, true, durationUs);
+    printf("heading drift over %us with a 10%% weaker track: open loop %.1f deg, closed loop %.1f deg\n",
+           durationUs / 1000000, open.heading, closed.heading);
+    check(fabs(closed.heading) < SIM_MAX_CLOSED_DRIFT_DEG, "closed loop holds the heading");
+
+    return checkResult();
+}
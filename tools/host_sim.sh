@@ -0,0 +1,67 @@
+#!/bin/sh
+# Build and run a host simulation from tools/host against the sketch's own sources, no
+# board needed. Each one prints its numbers and exits non-zero when a check fails.
+#
+# Usage: tools/host_sim.sh <name> [args...]
+#   update_resume [image bytes] [seed]
+#                                     serial firmware update into file-backed slots,
+#                                     including an interrupted and resumed transfer
+#   fleet_loopback [tanks] [seconds driven]
+#                                     status frames and send rate over the UDP loopback link
+#   show_sync_sim [tanks] [minutes] [beacon loss %] [seed]
+#                                     clock sync and show steps across several tanks
+#   motor_hal_test [benchmark calls]  TankMotors pin writes on MockMotorHal, and their cost
+#   predict_replay [seconds] [seed]   input prediction vs holding the last report
+#   yaw_sim [seconds per run] [seed]  closed-loop steering on a simulated gyro and tracks
+#   traction_sim [seconds driven] [seed]
+#                                     traction control with tracks that grip or are stuck
+#   tilt_sim [phases per tip] [seed]  tilt guard cut latency, sensor filter delay included
+#
+# Set CXX to override the compiler.
+set -e
+
+NAME=$1
+CXX=${CXX:-g++}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD="$ROOT/build/host"
+
+case "$NAME" in
+update_resume)
+    SOURCES="FirmwareUpdate.cpp UpdatePartition.cpp Sha256.cpp"
+    ;;
+fleet_loopback)
+    SOURCES="FleetTelemetry.cpp FleetTransport.cpp"
+    ;;
+show_sync_sim)
+    SOURCES="ClockSync.cpp ChoreographyPlayer.cpp"
+    ;;
+motor_hal_test)
+    SOURCES="TankMotors.cpp Metrics.cpp Tracer.cpp"
+    ;;
+predict_replay)
+    SOURCES="InputPredictor.cpp Metrics.cpp"
+    ;;
+yaw_sim)
+    SOURCES="YawRateController.cpp Imu.cpp"
+    ;;
+traction_sim)
+    SOURCES="TractionControl.cpp Imu.cpp Metrics.cpp"
+    ;;
+tilt_sim)
+    SOURCES="TiltGuard.cpp ImuTask.cpp Imu.cpp TankMotors.cpp Metrics.cpp Tracer.cpp"
+    ;;
+*)
+    echo "Unknown simulation: $NAME" >&2
+    exit 2
+    ;;
+esac
+shift
+
+mkdir -p "$BUILD"
+FILES=""
+for SOURCE in $SOURCES; do
+    FILES="$FILES $ROOT/RobotController/$SOURCE"
+done
+$CXX -std=gnu++17 -O2 -Wall -Wextra -I"$ROOT/RobotController" \
+    "$ROOT/tools/host/$NAME.cpp" $FILES -o "$BUILD/$NAME"
+"$BUILD/$NAME" "$@"
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+"""Turn the tank's tokenized log frames back into text.
+
+A firmware built with -DLOG_TOKENIZED=1 (tools/build.sh tokenized) sends each
+LOG_BASIC/LOG_DETAILED/LOG_VERBOSE message as a small binary frame holding a
+hash of the format string and the raw arguments. This tool rebuilds the
+string table from the LOG_* calls in the sources, formats every frame the way
+printf would have on the tank, and passes plain console text through as is.
+
+Usage:
+    log_decode.py <port> [--baud 115200]      decode a live serial port
+    log_decode.py <capture file | ->          decode a saved capture or stdin
+    log_decode.py --dump-tokens tokens.json   only write the string table
+
+Use --tokens with the table saved by tools/build.sh when the sources have
+changed since the firmware was flashed. The frame format is documented in
+RobotController/Logger.h.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+SYNC = 0xA6
+LEVEL_NAMES = ['none', 'basic', 'detailed', 'verbose']
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+LOG_CALL = re.compile(r'\bLOG_(?:BASIC|DETAILED|VERBOSE)\s*\(\s*((?:"(?:[^"\\]|\\.)*"\s*)+)')
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+SPEC = re.compile(r'%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<precision>\*|\d*))?'
+                  r'(?P<length>hh|h|ll|l|j|z|t|L)?(?P<conversion>[diouxXeEfFgGaAcsp%])')
+
+
+def token(text):
+    """FNV-1a hash of the format string, same as logToken() in Logger.h."""
+    value = 2166136261
+    for byte in text.encode('latin-1'):
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def unescape(literal):
+    return literal.encode('latin-1').decode('unicode_escape')
+
+
+def extract_tokens(source_dir):
+    """Map token -> format string for every LOG_* call in the sketch."""
+    tokens = {}
+    for name in sorted(os.listdir(source_dir)):
+        if not name.endswith(('.ino', '.cpp', '.h')):
+            continue
+        with open(os.path.join(source_dir, name), encoding='utf-8') as source:
+            text = source.read()
+        for match in LOG_CALL.finditer(text):
+            fmt = ''.join(unescape(part) for part in LITERAL.findall(match.group(1)))
+            key = token(fmt)
+            if key in tokens and tokens[key] != fmt:
+                print('warning: token collision 0x%08x: %r and %r' % (key, tokens[key], fmt), file=sys.stderr)
+            tokens[key] = fmt
+    return tokens
+
+
+class Arguments:
+    """Reads the encoded arguments of one frame in order."""
+
+    def __init__(self, data):
+        self.data = data
+        self.position = 0
+
+    def integer(self):
+        value = shift = 0
+        while True:
+            if self.position >= len(self.data):
+                raise IndexError
+            byte = self.data[self.position]
+            self.position += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return (value >> 1) ^ -(value & 1)
+
+    def float(self):
+        if self.position + 4 > len(self.data):
+            raise IndexError
+        value, = struct.unpack_from('<f', self.data, self.position)
+        self.position += 4
+        return value
+
+    def string(self):
+        if self.position >= len(self.data):
+            raise IndexError
+        length = self.data[self.position]
+        text = self.data[self.position + 1:self.position + 1 + length]
+        self.position += 1 + length
+        return text.decode('latin-1')
+
+
+def format_message(fmt, arguments):
+    """printf on the host, reading each argument as its conversion expects."""
+    def replace(spec):
+        conversion = spec.group('conversion')
+        if conversion == '%':
+            return '%'
+        try:
+            width = spec.group('width') or ''
+            if width == '*':
+                width = str(arguments.integer())
+            precision = spec.group('precision')
+            if precision == '*':
+                precision = str(arguments.integer())
+            python_spec = '%' + spec.group('flags') + width
+            if precision is not None:
+                python_spec += '.' + precision
+
+            if conversion in 'di':
+                return (python_spec + 'd') % arguments.integer()
+            if conversion in 'ouxX':
+                bits = 64 if spec.group('length') in ('ll', 'j') else 32
+                return (python_spec + conversion.replace('u', 'd')) % (arguments.integer() & ((1 << bits) - 1))
+            if conversion in 'eEfFgGaA':
+                return (python_spec + conversion.replace('a', 'e').replace('A', 'E')) % arguments.float()
+            if conversion == 'c':
+                return (python_spec + 'c') % chr(arguments.integer() & 0xFF)
+            if conversion == 's':
+                return (python_spec + 's') % arguments.string()
+            return '0x%x' % (arguments.integer() & 0xFFFFFFFF)
+        except IndexError:
+            return '<missing>'
+
+    return SPEC.sub(replace, fmt)
+
+
+class Decoder:
+    def __init__(self, tokens, show_level=False, out=sys.stdout):
+        self.tokens = tokens
+        self.show_level = show_level
+        self.out = out
+        self.buffer = b''
+
+    def feed(self, data):
+        self.buffer += data
+        while self.buffer:
+            start = self.buffer.find(bytes([SYNC]))
+            if start < 0:
+                self.text(self.buffer)
+                self.buffer = b''
+                return
+            if start > 0:
+                self.text(self.buffer[:start])
+                self.buffer = self.buffer[start:]
+            if len(self.buffer) < 2 or len(self.buffer) < self.buffer[1] + 3:
+                return
+
+            length = self.buffer[1]
+            body = self.buffer[2:2 + length]
+            if length < 5 or sum(body) & 0xFF != self.buffer[2 + length]:
+                # Not a frame after all, show the byte and resync on the next one
+                self.text(self.buffer[:1])
+                self.buffer = self.buffer[1:]
+                continue
+
+            self.buffer = self.buffer[3 + length:]
+            level = body[0]
+            key, = struct.unpack_from('<I', body, 1)
+            fmt = self.tokens.get(key)
+            if fmt is None:
+                line = '<unknown token 0x%08x: %s>' % (key, body[5:].hex())
+            else:
+                line = format_message(fmt, Arguments(body[5:]))
+            if self.show_level:
+                level_name = LEVEL_NAMES[level] if level < len(LEVEL_NAMES) else str(level)
+                line = '[%s] %s' % (level_name, line)
+            self.out.write(line + '\n')
+        self.out.flush()
+
+    def text(self, data):
+        self.out.write(data.decode('latin-1'))
+        self.out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('input', nargs='?', help='serial port, capture file, or - for stdin')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--tokens', help='string table written by --dump-tokens (default: read the sources)')
+    parser.add_argument('--source', default=os.path.join(ROOT, 'RobotController'), help='sketch directory')
+    parser.add_argument('--dump-tokens', metavar='FILE', help='write the string table as JSON')
+    parser.add_argument('--level', action='store_true', help='prefix decoded messages with their level')
+    args = parser.parse_args()
+
+    if args.tokens:
+        with open(args.tokens) as table:
+            tokens = {int(key, 16): fmt for key, fmt in json.load(table).items()}
+    else:
+        tokens = extract_tokens(args.source)
+
+    if args.dump_tokens:
+        with open(args.dump_tokens, 'w') as table:
+            json.dump({'0x%08x' % key: tokens[key] for key in sorted(tokens)}, table, indent=4)
+            table.write('\n')
+        print('%d format strings written to %s' % (len(tokens), args.dump_tokens))
+        if not args.input:
+            return 0
+
+    if not args.input:
+        parser.error('no input given')
+
+    decoder = Decoder(tokens, args.level)
+    if args.input == '-':
+        stream = sys.stdin.buffer
+    elif os.path.isfile(args.input):
+        stream = open(args.input, 'rb')
+    else:
+        from serial_update import Link
+        link = Link(args.input, args.baud)
+        try:
+            while True:
+                decoder.feed(link.read(0.1))
+        except KeyboardInterrupt:
+            return 0
+
+    while True:
+        data = stream.read1(256) if hasattr(stream, 'read1') else stream.read(256)
+        if not data:
+            return 0
+        decoder.feed(data)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Convert the tank's metrics dump to Prometheus text exposition format.
+
+The 'metrics' serial command prints every counter, gauge, min/max pair and
+histogram in a compact line format (see RobotController/Metrics.h). This tool
+turns one dump into the text format Prometheus scrapes, with help text taken
+from the metric declarations in Metrics.h.
+
+Usage:
+    metrics_prom.py dump.txt                 convert a saved dump (- for stdin)
+    metrics_prom.py --port /dev/ttyUSB0      ask the tank for a fresh dump
+    metrics_prom.py --port /dev/ttyUSB0 --listen 9101
+                                             serve http://localhost:9101/metrics,
+                                             reading the tank on every scrape
+"""
+
+import argparse
+import os
+import re
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DECLARATION = re.compile(r'X\(\s*\w+\s*,\s*"([^"]+)"\s*,\s*"([^"]*)"\s*\)')
+BUCKETS = 17  # METRICS_HISTOGRAM_BUCKETS
+
+
+def load_help(header):
+    with open(header) as source:
+        return dict(DECLARATION.findall(source.read()))
+
+
+def bucket_bound(index):
+    """Upper bound of a histogram bucket: 0, then 2^i - 1, the last one open."""
+    if index == BUCKETS - 1:
+        return '+Inf'
+    return str((1 << index) - 1)
+
+
+def convert(lines, help_text):
+    out = []
+
+    def header(name, kind, help_name=None):
+        out.append('# HELP %s %s' % (name, help_text.get(help_name or name, name)))
+        out.append('# TYPE %s %s' % (name, kind))
+
+    for line in lines:
+        fields = line.split()
+        if not fields or fields[0] == 'end':
+            continue
+        kind = fields[0]
+        if kind == 'metrics':
+            out.append('# HELP tank_uptime_seconds Time since the tank started')
+            out.append('# TYPE tank_uptime_seconds gauge')
+            out.append('tank_uptime_seconds %.3f' % (int(fields[2]) / 1000.0))
+        elif kind == 'c':
+            header(fields[1], 'counter')
+            out.append('%s %s' % (fields[1], fields[2]))
+        elif kind == 'g':
+            header(fields[1], 'gauge')
+            out.append('%s %s' % (fields[1], fields[2]))
+        elif kind == 'm':
+            name, low, high, samples = fields[1], fields[2], fields[3], fields[4]
+            # Without samples the tank reports 0/0, which would look like a real reading
+            for suffix, value in (('_min', low), ('_max', high)):
+                header(name + suffix, 'gauge', name)
+                out.append('%s%s %s' % (name, suffix, value if samples != '0' else 'NaN'))
+            header(name + '_samples_total', 'counter', name)
+            out.append('%s_samples_total %s' % (name, samples))
+        elif kind == 'h':
+            name, total = fields[1], fields[2]
+            counts = [int(value) for value in fields[3:3 + BUCKETS]]
+            header(name, 'histogram')
+            cumulative = 0
+            for index, count in enumerate(counts):
+                cumulative += count
+                out.append('%s_bucket{le="%s"} %d' % (name, bucket_bound(index), cumulative))
+            out.append('%s_sum %s' % (name, total))
+            out.append('%s_count %d' % (name, cumulative))
+    return '\n'.join(out) + '\n'
+
+
+def read_dump(link, timeout=3.0):
+    """Send 'metrics' and collect lines from the 'metrics' header to 'end'."""
+    link.write(b'\nmetrics\n')
+    deadline = time.time() + timeout
+    text = b''
+    while time.time() < deadline:
+        text += link.read(0.1)
+        start = text.find(b'metrics ')
+        end = text.find(b'\nend', start)
+        if start >= 0 and end >= 0:
+            return text[start:end].decode('latin-1').splitlines()
+    raise RuntimeError('no metrics dump from the tank')
+
+
+def serve(port, link, help_text):
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path != '/metrics':
+                self.send_error(404)
+                return
+            try:
+                body = convert(read_dump(link), dict(help_text)).encode()
+            except RuntimeError as error:
+                self.send_error(503, str(error))
+                return
+            self.send_response(200)
+            self.send_header('Content-Type', 'text/plain; version=0.0.4')
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    print('Serving http://localhost:%d/metrics' % port, file=sys.stderr)
+    HTTPServer(('', port), Handler).serve_forever()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('dump', nargs='?', help='saved dump, or - for stdin')
+    parser.add_argument('--port', help='serial port of the tank (text console)')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--listen', type=int, metavar='HTTP_PORT', help='serve /metrics over HTTP')
+    parser.add_argument('--header', default=os.path.join(ROOT, 'RobotController', 'Metrics.h'))
+    args = parser.parse_args()
+
+    help_text = load_help(args.header)
+
+    if args.port:
+        from serial_update import Link
+        link = Link(args.port, args.baud)
+        if args.listen:
+            serve(args.listen, link, help_text)
+            return 0
+        sys.stdout.write(convert(read_dump(link), help_text))
+        return 0
+
+    if not args.dump:
+        parser.error('give a dump file or --port')
+    source = sys.stdin if args.dump == '-' else open(args.dump)
+    sys.stdout.write(convert(source.read().splitlines(), help_text))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
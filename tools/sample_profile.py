@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+"""Symbolize the tank's sampling profiler dump into a flat profile or flame graph input.
+
+Needs a firmware built with tools/build.sh profile. On the tank, 'prof start' samples
+both cores until 'prof dump' (see RobotController/SamplingProfiler.h). Addresses are
+resolved against the ELF from the same build with the toolchain's addr2line.
+
+Usage:
+    sample_profile.py dump.txt                       flat profile of a saved dump
+    sample_profile.py --port /dev/ttyUSB0 --seconds 10
+                                                     profile the running tank
+    sample_profile.py dump.txt --collapsed out.txt   stacks for flamegraph.pl or speedscope
+    sample_profile.py --port /dev/ttyUSB0 --check    bench check that samples see tasks
+"""
+
+import argparse
+import collections
+import os
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+IN_INTERRUPT = 0xff  # SAMPLING_PROFILER_IN_INTERRUPT
+UNKNOWN_TASK = 0xfe  # SAMPLING_PROFILER_UNKNOWN_TASK
+
+# Where a function's source lives tells us whose code it is
+LIBRARIES = [
+    ('RobotController', 'tank'),
+    ('bluepad32', 'Bluepad32'),
+    ('btstack', 'Bluepad32'),
+    ('cores/esp32', 'Arduino core'),
+    ('libraries/', 'Arduino core'),
+    ('components/', 'ESP-IDF'),
+    ('esp-idf', 'ESP-IDF'),
+]
+
+
+def parse(lines):
+    """Return hz, sample totals, task names and (count, core, task, pcs) stacks."""
+    header = None
+    tasks = {}
+    stacks = []
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == 'profile':
+            header = (int(fields[2]), int(fields[3]), int(fields[4]))
+            tasks, stacks = {}, []
+        elif header is None:
+            continue
+        elif fields[0] == 'end':
+            break
+        elif fields[0] == 't':
+            tasks[(int(fields[1]), int(fields[2]))] = ' '.join(fields[3:])
+        elif fields[0] == 's':
+            pcs = [int(value, 16) for value in fields[4:]]
+            stacks.append((int(fields[1]), int(fields[2]), int(fields[3]), pcs))
+    return header, tasks, stacks
+
+
+class Symbolizer:
+    def __init__(self, elf, addr2line):
+        self.elf = elf
+        self.addr2line = addr2line
+        self.cache = {}
+
+    def resolve(self, addresses):
+        missing = sorted(set(addresses) - set(self.cache))
+        if not missing:
+            return
+        if not self.elf:
+            for address in missing:
+                self.cache[address] = ('0x%08x' % address, '')
+            return
+        output = subprocess.run([self.addr2line, '-f', '-C', '-e', self.elf] + ['0x%08x' % a for a in missing],
+                                check=True, capture_output=True, text=True).stdout.splitlines()
+        for index, address in enumerate(missing):
+            function = output[2 * index]
+            location = output[2 * index + 1]
+            if function == '??':
+                function = '0x%08x' % address
+            self.cache[address] = (function, location)
+
+    def function(self, address):
+        return self.cache[address][0]
+
+    def library(self, address):
+        location = self.cache[address][1]
+        for marker, name in LIBRARIES:
+            if marker in location:
+                return name
+        return 'other' if location and not location.startswith('??') else 'unknown'
+
+
+def task_name(tasks, core, task):
+    if task == IN_INTERRUPT:
+        return '[interrupt]'
+    return tasks.get((core, task), '[task %d]' % task)
+
+
+def check_tasks(stacks):
+    """Fail unless some samples caught a task; all-interrupt samples mean the ISR can't see them."""
+    total = sum(count for count, _, _, _ in stacks)
+    in_tasks = sum(count for count, _, task, pcs in stacks if task != IN_INTERRUPT and pcs)
+    print('%d of %d samples caught a task with its PC' % (in_tasks, total))
+    if in_tasks == 0:
+        print('FAIL: every sample was taken as an interrupt', file=sys.stderr)
+        return 1
+    return 0
+
+
+def print_flat(header, tasks, stacks, symbols, limit):
+    hz, samples, dropped = header
+    total = sum(count for count, _, _, _ in stacks) or 1
+    cores = len(set(core for _, core, _, _ in stacks))
+    print('%d samples at %dHz (%.1fs per core), %d dropped' % (samples, hz, samples / float(hz * cores), dropped))
+
+    by_task = collections.Counter()
+    by_library = collections.Counter()
+    self_time = collections.Counter()
+    total_time = collections.Counter()
+    for count, core, task, pcs in stacks:
+        by_task['core %d %s' % (core, task_name(tasks, core, task))] += count
+        if not pcs:
+            by_library['[interrupt]'] += count
+            self_time['[interrupt]'] += count
+            continue
+        by_library[symbols.library(pcs[0])] += count
+        self_time[symbols.function(pcs[0])] += count
+        for function in set(symbols.function(pc) for pc in pcs):
+            total_time[function] += count
+
+    def table(title, counter, rows):
+        print('\n%s' % title)
+        for name, count in counter.most_common(rows):
+            print('  %6.2f%%  %7d  %s' % (100.0 * count / total, count, name))
+
+    table('By task:', by_task, None)
+    table('By library (where the sampled PC was):', by_library, None)
+    table('Self (function the PC was in):', self_time, limit)
+
+    print('\nTotal (function anywhere in the sampled %d-deep stack):' % max(len(pcs) for _, _, _, pcs in stacks))
+    for name, count in total_time.most_common(limit):
+        print('  %6.2f%%  %7d  %s' % (100.0 * count / total, count, name))
+
+
+def write_collapsed(tasks, stacks, symbols, output):
+    """One line per stack, root first, in the format flamegraph.pl and speedscope read."""
+    collapsed = collections.Counter()
+    for count, core, task, pcs in stacks:
+        frames = ['core %d' % core, task_name(tasks, core, task)]
+        frames += [symbols.function(pc).replace(';', ':') for pc in reversed(pcs)]
+        collapsed[';'.join(frames)] += count
+    for stack, count in sorted(collapsed.items()):
+        output.write('%s %d\n' % (stack, count))
+
+
+def capture(port, baud, seconds, hz):
+    from serial_update import Link
+    link = Link(port, baud)
+    link.write(b'\nprof start %d\n' % hz)
+    time.sleep(seconds)
+    link.write(b'prof dump\n')
+    text = b''
+    deadline = time.time() + 10
+    while time.time() < deadline and b'\nend' not in text[text.find(b'profile '):]:
+        text += link.read(0.1)
+    return text.decode('latin-1').splitlines()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('dump', nargs='?', help='saved dump, or - for stdin')
+    parser.add_argument('--port', help='serial port of the tank (text console)')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--seconds', type=float, default=5.0, help='how long to sample with --port')
+    parser.add_argument('--hz', type=int, default=997, help='sample rate with --port')
+    parser.add_argument('--elf', default=os.path.join(ROOT, 'build', 'profile', 'RobotController.ino.elf'),
+                        help='firmware ELF of the profiled build')
+    parser.add_argument('--addr2line', default='xtensa-esp32-elf-addr2line')
+    parser.add_argument('--collapsed', metavar='FILE', help='write collapsed stacks (- for stdout)')
+    parser.add_argument('--top', type=int, default=30, help='functions listed in the flat profile')
+    parser.add_argument('--check', action='store_true', help='only check that samples caught tasks, exit 1 if not')
+    args = parser.parse_args()
+
+    if args.port:
+        lines = capture(args.port, args.baud, args.seconds, args.hz)
+    elif args.dump:
+        source = sys.stdin if args.dump == '-' else open(args.dump)
+        lines = source.read().splitlines()
+    else:
+        parser.error('give a dump file or --port')
+
+    header, tasks, stacks = parse(lines)
+    if header is None or not stacks:
+        print('No profile samples found', file=sys.stderr)
+        return 1
+    if args.check:
+        return check_tasks(stacks)
+
+    elf = args.elf if os.path.exists(args.elf) else None
+    if elf is None:
+        print('No ELF at %s, showing raw addresses' % args.elf, file=sys.stderr)
+    symbols = Symbolizer(elf, args.addr2line)
+    symbols.resolve([pc for _, _, _, pcs in stacks for pc in pcs])
+
+    if args.collapsed:
+        output = sys.stdout if args.collapsed == '-' else open(args.collapsed, 'w')
+        write_collapsed(tasks, stacks, symbols, output)
+        if output is not sys.stdout:
+            output.close()
+    else:
+        print_flat(header, tasks, stacks, symbols, args.top)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""Drive the tank from a joystick plugged into this PC, over the serial cable.
+
+Reads a Linux joystick device (/dev/input/js*), turns its state into the same
+report the tank copies out of a Bluetooth gamepad (GamepadSnapshot) and sends
+it as a GAMEPAD control message on the framed serial link: at once whenever
+something changes, and --rate times a second while nothing does, so the
+tank's 3 second input check and hardware failsafe behave as they do with a
+Bluetooth controller. While reports keep coming they take over from any
+Bluetooth controller. Log lines from the tank are shown as they arrive.
+
+The default mapping is a PS4/PS5 pad on the kernel's hid-playstation driver.
+For other pads run with --show, move each stick and press each button, then
+give the numbers with --axes and --hat (buttons are in BUTTONS below).
+
+Usage:
+    serial_joystick.py <port> [--device /dev/input/js0] [--baud 2000000] [--rate 50]
+    serial_joystick.py --show [--device /dev/input/js0]
+
+The frame format is documented in RobotController/SerialMux.h.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import time
+
+from log_decode import extract_tokens, ROOT
+from serial_mux import CONTROL, CLOSE, Mux, enter_framed_mode
+from serial_update import Link
+
+GAMEPAD = 0x06  # SERIAL_MUX_GAMEPAD
+SNAPSHOT = struct.Struct('<hhhhhhHHBB')  # GamepadSnapshot
+JS_EVENT = struct.Struct('<IhBB')  # struct js_event
+JS_EVENT_BUTTON, JS_EVENT_AXIS, JS_EVENT_INIT = 0x01, 0x02, 0x80
+
+# Joystick button number -> (field, bit), bits as in RobotController/GamepadSnapshot.h
+BUTTONS = {
+    0: ('buttons', 0x0001),  # Cross = A
+    1: ('buttons', 0x0002),  # Circle = B
+    2: ('buttons', 0x0008),  # Triangle = Y
+    3: ('buttons', 0x0004),  # Square = X
+    4: ('buttons', 0x0010),  # L1
+    5: ('buttons', 0x0020),  # R1
+    6: ('buttons', 0x0040),  # L2
+    7: ('buttons', 0x0080),  # R2
+    11: ('buttons', 0x0100),  # Left stick press
+    12: ('buttons', 0x0200),  # Right stick press
+    10: ('misc', 0x01),  # PS = system
+    8: ('misc', 0x02),  # Share = select
+    9: ('misc', 0x04),  # Options = start
+}
+DPAD_UP, DPAD_DOWN, DPAD_RIGHT, DPAD_LEFT = 0x01, 0x02, 0x04, 0x08
+
+
+class Pad:
+    """Joystick state, kept in the tank's units."""
+
+    def __init__(self, axes, hat):
+        self.stick_axes = axes[:4]
+        self.brake_axis, self.throttle_axis = axes[4], axes[5]
+        self.hat = hat
+        self.sticks = [0, 0, 0, 0]
+        self.triggers = [0, 0]
+        self.buttons = 0
+        self.misc = 0
+        self.dpad = 0
+
+    def event(self, kind, number, value):
+        if kind & JS_EVENT_AXIS:
+            if number in self.stick_axes:
+                # -32767..32767 to Bluepad32's -512..511
+                self.sticks[self.stick_axes.index(number)] = max(-512, min(511, value >> 6))
+            elif number == self.brake_axis or number == self.throttle_axis:
+                # Triggers rest at -32767, Bluepad32 gives 0..1023
+                self.triggers[0 if number == self.brake_axis else 1] = (value + 32767) * 1023 // 65534
+            elif number == self.hat[0]:
+                self.dpad = (self.dpad & (DPAD_UP | DPAD_DOWN)) | (DPAD_LEFT if value < 0 else DPAD_RIGHT if value > 0 else 0)
+            elif number == self.hat[1]:
+                self.dpad = (self.dpad & (DPAD_LEFT | DPAD_RIGHT)) | (DPAD_UP if value < 0 else DPAD_DOWN if value > 0 else 0)
+        elif kind & JS_EVENT_BUTTON and number in BUTTONS:
+            field, bit = BUTTONS[number]
+            state = getattr(self, field)
+            setattr(self, field, state | bit if value else state & ~bit)
+
+    def report(self):
+        return SNAPSHOT.pack(*self.sticks, *self.triggers, self.buttons, self.misc, self.dpad, 0)
+
+
+def read_events(fd):
+    """Every event queued on the non-blocking joystick device."""
+    events = []
+    while True:
+        try:
+            data = os.read(fd, JS_EVENT.size * 64)
+        except BlockingIOError:
+            return events
+        if not data:
+            return events
+        for offset in range(0, len(data) - JS_EVENT.size + 1, JS_EVENT.size):
+            _, value, kind, number = JS_EVENT.unpack_from(data, offset)
+            events.append((kind, number, value))
+
+
+def show(device):
+    fd = os.open(device, os.O_RDONLY)
+    print('Move each stick and press each button, Ctrl-C to stop', file=sys.stderr)
+    try:
+        while True:
+            _, value, kind, number = JS_EVENT.unpack(os.read(fd, JS_EVENT.size))
+            if not kind & JS_EVENT_INIT:
+                print('%s %d = %d' % ('axis' if kind & JS_EVENT_AXIS else 'button', number, value))
+    except KeyboardInterrupt:
+        return 0
+
+
+def numbers(text, count):
+    values = [int(value) for value in text.split(',')]
+    if len(values) != count:
+        raise argparse.ArgumentTypeError('expected %d numbers' % count)
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('port', nargs='?')
+    parser.add_argument('--device', default='/dev/input/js0', help='Linux joystick device')
+    parser.add_argument('--baud', type=int, default=2000000, help='framed link baud rate (max 2000000)')
+    parser.add_argument('--start-baud', type=int, default=115200, help='baud rate of the text console')
+    parser.add_argument('--attach', action='store_true', help='the tank is already framed at --baud')
+    parser.add_argument('--rate', type=float, default=50, help='reports per second while nothing changes')
+    parser.add_argument('--axes', type=lambda text: numbers(text, 6), default=[0, 1, 3, 4, 2, 5],
+                        help='axis numbers of left X, left Y, right X, right Y, L2, R2 (default 0,1,3,4,2,5)')
+    parser.add_argument('--hat', type=lambda text: numbers(text, 2), default=[6, 7],
+                        help='axis numbers of the d-pad X and Y (default 6,7)')
+    parser.add_argument('--show', action='store_true', help='print raw joystick events to work out a mapping')
+    args = parser.parse_args()
+
+    if args.show:
+        return show(args.device)
+    if not args.port:
+        parser.error('the serial port is required')
+
+    joystick = os.open(args.device, os.O_RDONLY | os.O_NONBLOCK)
+    pad = Pad(args.axes, args.hat)
+
+    link = Link(args.port, args.start_baud)
+    if args.attach:
+        link.set_baud(args.baud)
+    elif not enter_framed_mode(link, args.baud, args.start_baud):
+        print('The tank did not switch to framed mode', file=sys.stderr)
+        return 1
+
+    mux = Mux(link, extract_tokens(os.path.join(ROOT, 'RobotController')), None)
+    if mux.hello() is None:
+        print('No HELLO from the tank, it went back to text mode', file=sys.stderr)
+        return 1
+    print('Driving from %s, Ctrl-C to stop' % args.device, file=sys.stderr)
+
+    interval = 1.0 / args.rate
+    sent = 0
+    last_report = None
+    next_send = time.time()
+    try:
+        while True:
+            ready, _, _ = select.select([joystick], [], [], max(0.0, next_send - time.time()))
+            if ready:
+                for kind, number, value in read_events(joystick):
+                    pad.event(kind, number, value)
+
+            report = pad.report()
+            if report != last_report or time.time() >= next_send:
+                mux.send(CONTROL, bytes([GAMEPAD]) + report)
+                sent += 1
+                last_report = report
+                next_send = time.time() + interval
+            mux.poll(0)
+    except KeyboardInterrupt:
+        # Centre everything first so the tank stops even if the close is lost
+        mux.send(CONTROL, bytes([GAMEPAD]) + Pad(args.axes, args.hat).report())
+        mux.send(CONTROL, bytes([CLOSE]))
+        print('%d reports sent' % sent, file=sys.stderr)
+        return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
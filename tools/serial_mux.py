@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+"""Talk to the tank over its framed serial link.
+
+Types 'mux <baud>' on the serial console, follows the tank to the new baud
+rate and then splits the link into its channels: log messages (plain or
+tokenized, see log_decode.py), motor telemetry records and command replies.
+Lines typed on stdin are sent as commands. Lines starting with '/' are for
+the link itself:
+
+    /pause log telemetry   stop a channel at the tank (flow control)
+    /resume                resume all channels
+    /stats                 dropped bytes per channel
+    /baud 1000000          change the baud rate
+    /close                 return the tank to plain text and quit
+
+Usage:
+    serial_mux.py <port> [--baud 2000000] [--telemetry motors.csv]
+
+The frame format is documented in RobotController/SerialMux.h.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import time
+
+from log_decode import Decoder, extract_tokens, ROOT
+from serial_update import Link
+
+SYNC = 0xA7
+CONTROL, TELEMETRY, COMMAND, LOG = range(4)
+CHANNEL_NAMES = ['control', 'telemetry', 'command', 'log']
+HELLO, FLOW, BAUD, CLOSE, STATS = 0x01, 0x02, 0x03, 0x04, 0x05
+MAX_PAYLOAD = 64  # SERIAL_MUX_MAX_PAYLOAD
+TELEMETRY = struct.Struct('<IhhB')  # MotorTelemetryRecord
+TELEMETRY_FLAGS = ['forced-off', 'failsafe', 'connected']
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, same as the tank."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def frame(channel, payload):
+    header = bytes([channel, len(payload)])
+    return bytes([SYNC]) + header + payload + struct.pack('<H', crc16(header + payload))
+
+
+class Prefixed:
+    """File-like output that starts every line with a channel tag."""
+
+    def __init__(self, tag):
+        self.tag = tag
+        self.at_line_start = True
+
+    def write(self, text):
+        for line in text.splitlines(True):
+            if self.at_line_start:
+                sys.stdout.write(self.tag)
+            sys.stdout.write(line)
+            self.at_line_start = line.endswith('\n')
+
+    def flush(self):
+        sys.stdout.flush()
+
+
+class Mux:
+    def __init__(self, link, tokens, telemetry_file):
+        self.link = link
+        self.buffer = b''
+        self.bad_frames = 0
+        self.log = Decoder(tokens, out=Prefixed('[log] '))
+        self.command = Prefixed('')
+        self.telemetry_file = telemetry_file
+        self.telemetry = b''
+        self.control = []
+
+    def send(self, channel, payload):
+        for start in range(0, max(len(payload), 1), MAX_PAYLOAD):
+            self.link.write(frame(channel, payload[start:start + MAX_PAYLOAD]))
+
+    def poll(self, timeout):
+        self.buffer += self.link.read(timeout)
+        while True:
+            start = self.buffer.find(bytes([SYNC]))
+            if start < 0:
+                self.buffer = b''
+                return
+            self.buffer = self.buffer[start:]
+            if len(self.buffer) < 3:
+                return
+            channel, length = self.buffer[1], self.buffer[2]
+            if channel >= len(CHANNEL_NAMES) or length > MAX_PAYLOAD:
+                self.bad_frames += 1
+                self.buffer = self.buffer[1:]
+                continue
+            if len(self.buffer) < length + 5:
+                return
+            payload = self.buffer[3:3 + length]
+            crc, = struct.unpack_from('<H', self.buffer, 3 + length)
+            if crc != crc16(self.buffer[1:3 + length]):
+                self.bad_frames += 1
+                self.buffer = self.buffer[1:]
+                continue
+            self.buffer = self.buffer[5 + length:]
+            self.handle(channel, payload)
+
+    def handle(self, channel, payload):
+        if channel == CONTROL:
+            self.control.append(payload)
+        elif channel == COMMAND:
+            self.command.write(payload.decode('latin-1'))
+            self.command.flush()
+        elif channel == LOG:
+            self.log.feed(payload)
+        else:
+            # Records can span frames, so reassemble them by size
+            self.telemetry += payload
+            while len(self.telemetry) >= TELEMETRY.size:
+                self.show_telemetry(*TELEMETRY.unpack_from(self.telemetry))
+                self.telemetry = self.telemetry[TELEMETRY.size:]
+
+    def show_telemetry(self, millis, left, right, flags):
+        if self.telemetry_file:
+            self.telemetry_file.write('%d,%d,%d,%d\n' % (millis, left, right, flags))
+            return
+        names = [name for bit, name in enumerate(TELEMETRY_FLAGS) if flags & (1 << bit)]
+        sys.stdout.write('[telemetry] t=%dms left=%d right=%d %s\n' % (millis, left, right, ' '.join(names)))
+
+    def wait_control(self, kind, timeout):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            self.poll(0.05)
+            for message in self.control:
+                if message[:1] == bytes([kind]):
+                    self.control.remove(message)
+                    return message[1:]
+        return None
+
+    def hello(self, retries=3):
+        for _ in range(retries):
+            self.send(CONTROL, bytes([HELLO]))
+            reply = self.wait_control(HELLO, 0.5)
+            if reply is not None:
+                return reply
+        return None
+
+
+def enter_framed_mode(link, baud, start_baud):
+    """Ask the text console for framed mode and follow it to the new rate."""
+    link.write(b'\nmux %d\n' % baud)
+    deadline = time.time() + 3
+    text = b''
+    while time.time() < deadline and b'Switching to framed serial' not in text:
+        text += link.read(0.1)
+    if b'Switching to framed serial' not in text:
+        return False
+    # Let the tank finish reading the command line before the first frame arrives
+    time.sleep(0.1)
+    if baud != start_baud:
+        link.set_baud(baud)
+    return True
+
+
+def local_command(mux, line):
+    words = line[1:].split()
+    if not words:
+        return True
+    if words[0] == 'pause' or words[0] == 'resume':
+        mask = 0
+        if words[0] == 'pause':
+            for name in words[1:] or ['log']:
+                if name in CHANNEL_NAMES[1:]:
+                    mask |= 1 << CHANNEL_NAMES.index(name)
+        mux.send(CONTROL, bytes([FLOW, mask]))
+    elif words[0] == 'stats':
+        mux.send(CONTROL, bytes([STATS]))
+        reply = mux.wait_control(STATS, 1.0)
+        if reply:
+            counts = struct.unpack('<%dI' % (len(reply) // 4), reply)
+            print('dropped: ' + ' '.join('%s=%d' % pair for pair in zip(CHANNEL_NAMES, counts)))
+        print('bad frames received here: %d' % mux.bad_frames)
+    elif words[0] == 'baud' and len(words) == 2:
+        baud = int(words[1])
+        mux.send(CONTROL, bytes([BAUD]) + struct.pack('<I', baud))
+        reply = mux.wait_control(BAUD, 1.0)
+        if reply is None:
+            print('no reply to baud change')
+            return True
+        baud, = struct.unpack('<I', reply)
+        time.sleep(0.05)
+        mux.link.set_baud(baud)
+        print('baud %d %s' % (baud, 'confirmed' if mux.hello() is not None else 'not confirmed'))
+    elif words[0] in ('close', 'quit'):
+        mux.send(CONTROL, bytes([CLOSE]))
+        return False
+    else:
+        print('unknown link command: %s' % words[0])
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('port')
+    parser.add_argument('--baud', type=int, default=2000000, help='framed link baud rate (max 2000000)')
+    parser.add_argument('--start-baud', type=int, default=115200, help='baud rate of the text console')
+    parser.add_argument('--attach', action='store_true', help='the tank is already framed at --baud')
+    parser.add_argument('--tokens', help='string table for tokenized logs (default: read the sources)')
+    parser.add_argument('--telemetry', metavar='CSV', help='write telemetry records to a CSV file instead')
+    args = parser.parse_args()
+
+    if args.tokens:
+        import json
+        with open(args.tokens) as table:
+            tokens = {int(key, 16): fmt for key, fmt in json.load(table).items()}
+    else:
+        tokens = extract_tokens(os.path.join(ROOT, 'RobotController'))
+
+    link = Link(args.port, args.start_baud)
+    if args.attach:
+        link.set_baud(args.baud)
+    elif not enter_framed_mode(link, args.baud, args.start_baud):
+        print('The tank did not switch to framed mode', file=sys.stderr)
+        return 1
+
+    telemetry_file = None
+    if args.telemetry:
+        telemetry_file = open(args.telemetry, 'w')
+        telemetry_file.write('time_ms,left,right,flags\n')
+
+    mux = Mux(link, tokens, telemetry_file)
+    reply = mux.hello()
+    if reply is None:
+        print('No HELLO from the tank, it went back to text mode', file=sys.stderr)
+        return 1
+    version, channels = reply[0], reply[1]
+    baud, = struct.unpack_from('<I', reply, 2)
+    print('Framed link v%d, %d channels at %d baud' % (version, channels, baud), file=sys.stderr)
+
+    try:
+        while True:
+            mux.poll(0.05)
+            ready, _, _ = select.select([sys.stdin], [], [], 0)
+            if not ready:
+                continue
+            line = sys.stdin.readline()
+            if not line:
+                local_command(mux, '/close')
+                return 0
+            line = line.strip()
+            if line.startswith('/'):
+                if not local_command(mux, line):
+                    return 0
+            elif line:
+                mux.send(COMMAND, line.encode() + b'\n')
+    except KeyboardInterrupt:
+        mux.send(CONTROL, bytes([CLOSE]))
+        return 0
+    finally:
+        if telemetry_file:
+            telemetry_file.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
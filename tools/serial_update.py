@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Send a firmware image to the tank over its serial port.
+
+Types 'update' on the serial console to put the tank into update mode, then
+streams the image in chunks, waiting for the tank's STATUS reply to each one.
+If the transfer is interrupted, running the tool again with the same image
+resumes where it stopped. After the tank verifies the SHA-256 it switches to
+the new partition and restarts; if the new image fails its self test it rolls
+back to the previous one by itself.
+
+Usage:
+    serial_update.py <port> <firmware.bin> [--baud 115200]
+
+The frame format is documented in RobotController/FirmwareUpdate.h.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+import time
+import zlib
+
+SYNC = 0xA5
+BEGIN, DATA, END, ABORT, STATUS = 0x01, 0x02, 0x03, 0x04, 0x81
+CHUNK = 512  # FIRMWARE_UPDATE_MAX_CHUNK
+STATUS_NAMES = ['ok', 'bad frame', 'bad offset', 'no session', 'too large',
+                'write error', 'hash mismatch', 'activate error']
+
+
+class Link:
+    """Serial port through pyserial, or a plain tty/pty path without it."""
+
+    def __init__(self, port, baud):
+        try:
+            import serial
+            self._serial = serial.Serial(port, baud, timeout=0.1)
+            self._fd = None
+        except ImportError:
+            import tty
+            self._serial = None
+            self._fd = os.open(port, os.O_RDWR | os.O_NOCTTY)
+            tty.setraw(self._fd)
+            self.set_baud(baud)
+
+    def set_baud(self, baud):
+        if self._serial:
+            self._serial.baudrate = baud
+            return
+        import termios
+        attributes = termios.tcgetattr(self._fd)
+        speed = getattr(termios, 'B%d' % baud, termios.B115200)
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(self._fd, termios.TCSANOW, attributes)
+
+    def write(self, data):
+        if self._serial:
+            self._serial.write(data)
+        else:
+            os.write(self._fd, data)
+
+    def read(self, timeout):
+        if self._serial:
+            self._serial.timeout = timeout
+            return self._serial.read(256)
+        import select
+        ready, _, _ = select.select([self._fd], [], [], timeout)
+        return os.read(self._fd, 256) if ready else b''
+
+
+def frame(frame_type, payload=b''):
+    header = struct.pack('<BH', frame_type, len(payload))
+    return bytes([SYNC]) + header + payload + struct.pack('<I', zlib.crc32(header + payload))
+
+
+class Updater:
+    def __init__(self, link):
+        self.link = link
+        self.buffer = b''
+
+    def request(self, data, timeout=5.0, retries=3):
+        """Send a frame and return (status, next offset) from the reply."""
+        for _ in range(retries):
+            self.link.write(data)
+            deadline = time.time() + timeout
+            while time.time() < deadline:
+                self.buffer += self.link.read(0.1)
+                reply = self.parse_status()
+                if reply is not None:
+                    return reply
+        raise RuntimeError('no reply from tank')
+
+    def parse_status(self):
+        # Skip any console text printed before update mode started
+        while True:
+            start = self.buffer.find(bytes([SYNC, STATUS]))
+            if start < 0:
+                self.buffer = self.buffer[-1:]
+                return None
+            if len(self.buffer) - start < 13:
+                self.buffer = self.buffer[start:]
+                return None
+            packet = self.buffer[start:start + 13]
+            self.buffer = self.buffer[start + 13:]
+            crc, = struct.unpack('<I', packet[9:13])
+            if zlib.crc32(packet[1:9]) == crc:
+                return packet[4], struct.unpack('<I', packet[5:9])[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('port')
+    parser.add_argument('image')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as image_file:
+        image = image_file.read()
+    digest = hashlib.sha256(image).digest()
+
+    link = Link(args.port, args.baud)
+    link.write(b'\nupdate\n')
+    time.sleep(0.2)
+    updater = Updater(link)
+
+    status, offset = updater.request(frame(BEGIN, struct.pack('<I', len(image)) + digest))
+    if status != 0:
+        print('Tank refused the update: %s' % STATUS_NAMES[status], file=sys.stderr)
+        return 1
+    if offset:
+        print('Resuming at %d of %d bytes' % (offset, len(image)))
+
+    start = time.time()
+    while offset < len(image):
+        chunk = image[offset:offset + CHUNK]
+        status, next_offset = updater.request(frame(DATA, struct.pack('<I', offset) + chunk))
+        if status not in (0, 2):
+            print('\nWrite failed at %d: %s' % (offset, STATUS_NAMES[status]), file=sys.stderr)
+            return 1
+        # On a bad offset the tank tells us where it actually is
+        offset = next_offset
+        sys.stdout.write('\r%d / %d bytes' % (offset, len(image)))
+        sys.stdout.flush()
+
+    print('\nSent in %.1fs, verifying...' % (time.time() - start))
+    status, _ = updater.request(frame(END), timeout=30.0)
+    if status != 0:
+        print('Update failed: %s' % STATUS_NAMES[status], file=sys.stderr)
+        return 1
+
+    print('Update verified, tank is restarting into the new firmware')
+    return 0
+
+
+if __name__ == '__main__':
+    try:
+        sys.exit(main())
+    except (RuntimeError, OSError) as error:
+        print('\n%s' % error, file=sys.stderr)
+        sys.exit(1)
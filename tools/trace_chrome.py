@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Convert the tank's trace dump to Chrome trace JSON for Perfetto or chrome://tracing.
+
+On the tank, 'trace on' starts recording and 'trace dump' stops and prints the last
+events (see RobotController/Tracer.h). Each core becomes a thread in the viewer, so
+the loop task, Bluetooth callbacks and timer interrupts line up on one timeline.
+
+Usage:
+    trace_chrome.py dump.txt -o trace.json     convert a saved dump (- for stdin)
+    trace_chrome.py --port /dev/ttyUSB0 -o trace.json
+                                               start tracing, wait, then dump
+Open the result at https://ui.perfetto.dev or chrome://tracing.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+PHASES = {'B': 'B', 'E': 'E', 'I': 'i'}
+
+
+def parse(lines):
+    """Return the name table and (time, core, phase, id) events of one dump."""
+    names = {}
+    events = []
+    in_dump = False
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == 'trace':
+            in_dump = True
+            names, events = {}, []
+        elif not in_dump:
+            continue
+        elif fields[0] == 'end':
+            break
+        elif fields[0] == 'n':
+            names[int(fields[1])] = ' '.join(fields[2:])
+        elif len(fields) == 4 and fields[2] in PHASES:
+            events.append((int(fields[0]), int(fields[1]), fields[2], int(fields[3])))
+    return names, events
+
+
+def convert(names, events):
+    trace = []
+    cores = sorted({core for _, core, _, _ in events})
+    for core in cores:
+        trace.append({'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': core, 'args': {'name': 'core %d' % core}})
+
+    # Timestamps are 32-bit microseconds, undo the wrap (every ~71 minutes)
+    offset = 0
+    last = None
+    open_spans = {core: [] for core in cores}
+    for stamp, core, phase, event_id in events:
+        if last is not None and stamp + offset < last - (1 << 31):
+            offset += 1 << 32
+        stamp += offset
+        last = stamp
+
+        # The oldest events were overwritten, so a span may end without a recorded start
+        if phase == 'B':
+            open_spans[core].append(event_id)
+        elif phase == 'E':
+            if event_id not in open_spans[core]:
+                continue
+            open_spans[core].remove(event_id)
+
+        entry = {'name': names.get(event_id, 'event %d' % event_id), 'ph': PHASES[phase],
+                 'ts': stamp, 'pid': 1, 'tid': core}
+        if phase == 'I':
+            entry['s'] = 't'
+        trace.append(entry)
+    return {'traceEvents': trace, 'displayTimeUnit': 'ms'}
+
+
+def capture(port, baud, seconds):
+    from serial_update import Link
+    link = Link(port, baud)
+    link.write(b'\ntrace on\n')
+    time.sleep(seconds)
+    link.write(b'trace dump\n')
+    text = b''
+    deadline = time.time() + 10
+    while time.time() < deadline and b'\nend' not in text[text.find(b'trace '):]:
+        text += link.read(0.1)
+    return text.decode('latin-1').splitlines()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('dump', nargs='?', help='saved dump, or - for stdin')
+    parser.add_argument('--port', help='serial port of the tank (text console)')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--seconds', type=float, default=1.0, help='how long to trace with --port')
+    parser.add_argument('-o', '--output', default='-', help='JSON output file (default: stdout)')
+    args = parser.parse_args()
+
+    if args.port:
+        lines = capture(args.port, args.baud, args.seconds)
+    elif args.dump:
+        source = sys.stdin if args.dump == '-' else open(args.dump)
+        lines = source.read().splitlines()
+    else:
+        parser.error('give a dump file or --port')
+
+    names, events = parse(lines)
+    if not events:
+        print('No trace events found', file=sys.stderr)
+        return 1
+
+    output = sys.stdout if args.output == '-' else open(args.output, 'w')
+    json.dump(convert(names, events), output)
+    if output is not sys.stdout:
+        output.close()
+        print('%d events written to %s' % (len(events), args.output), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())